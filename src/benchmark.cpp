@@ -0,0 +1,868 @@
+#include "benchmark.h"
+#include "imageIO.h"
+#include "layerStack.h"
+#include "pixelOps.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/resource.h>
+
+
+//size of the images the pixels are checked with. odd, so kernels working on multiple pixels at once must handle the rest
+static const uint32_t CHECK_WIDTH = 37;
+static const uint32_t CHECK_HEIGHT = 13;
+//where the image is blitted to. framebuffers are bigger, so pixels written outside of the image are found
+static const uint32_t CHECK_X = 5;
+static const uint32_t CHECK_Y = 3;
+static const uint32_t CHECK_SIZE = 48;
+
+//how many times every operation is measured and how long. the median is used, so a few disturbed windows do not matter
+static const uint32_t MEASURE_ROUNDS = 5;
+static const uint32_t MEASURE_MILLISECONDS = 20;
+//single combinations are noisier than averages, so they only fail if they got much slower, e.g. because a kernel is not used anymore
+static const float COMBINATION_TOLERANCE = 0.5f;
+
+//scanlines are padded, so kernels stepping through lines with the wrong stride are found
+static uint32_t paddedLineLength(uint32_t width, Framebuffer::PixelFormat format)
+{
+	return ((width * Framebuffer::getPixelFormatInfo(format).bytesPerPixel + 3) & ~3) + 12;
+}
+
+//scale a color component to another number of bits by repeating its bits, so the maximum value stays the maximum, e.g. 5bit 0x1f becomes 8bit 0xff.
+//components get fewer bits by truncating them
+static uint32_t repeatBits(uint32_t value, uint32_t bits, uint32_t toBits)
+{
+	value &= (1 << bits) - 1;
+	uint32_t result = 0;
+	for (int32_t shift = (int32_t)toBits - (int32_t)bits; shift > -(int32_t)bits; shift -= bits) {
+		result |= shift >= 0 ? value << shift : value >> -shift;
+	}
+	return result;
+}
+
+//the reference conversion works on single pixels and only uses the layout in Framebuffer::getPixelFormatInfo(), so it shares no code with the kernels.
+//read a pixel as X8R8G8B8. palette indices are looked up in the palette
+static uint32_t referenceRead(const uint8_t * pixel, Framebuffer::PixelFormat format, const Palette & palette)
+{
+	if (format == Framebuffer::PALETTE8) {
+		return 0xff000000 | palette.getColors()[*pixel];
+	}
+	if (format == Framebuffer::GREY8) {
+		return 0xff000000 | *pixel * 0x010101;
+	}
+	const Framebuffer::PixelFormatInfo & info = Framebuffer::getPixelFormatInfo(format);
+	uint32_t value = 0;
+	for (uint32_t byte = 0; byte < info.bytesPerPixel; ++byte) {
+		value |= (uint32_t)pixel[byte] << (byte * 8);
+	}
+	return 0xff000000 | repeatBits(value >> info.shiftRed, info.bitsRed, 8) << 16 | repeatBits(value >> info.shiftGreen, info.bitsGreen, 8) << 8 | repeatBits(value >> info.shiftBlue, info.bitsBlue, 8);
+}
+
+//write an X8R8G8B8 color as a pixel. components are scaled like \sa repeatBits() and bits that are no color component are set, e.g. X in X8R8G8B8
+static void referenceWrite(uint8_t * pixel, Framebuffer::PixelFormat format, uint32_t color)
+{
+	const uint32_t red = (color >> 16) & 0xff;
+	const uint32_t green = (color >> 8) & 0xff;
+	const uint32_t blue = color & 0xff;
+	if (format == Framebuffer::GREY8) {
+		*pixel = (red + green + blue) / 3;
+		return;
+	}
+	const Framebuffer::PixelFormatInfo & info = Framebuffer::getPixelFormatInfo(format);
+	uint32_t value = ~(((1 << info.bitsRed) - 1) << info.shiftRed | ((1 << info.bitsGreen) - 1) << info.shiftGreen | ((1 << info.bitsBlue) - 1) << info.shiftBlue);
+	value |= repeatBits(red, 8, info.bitsRed) << info.shiftRed | repeatBits(green, 8, info.bitsGreen) << info.shiftGreen | repeatBits(blue, 8, info.bitsBlue) << info.shiftBlue;
+	for (uint32_t byte = 0; byte < info.bytesPerPixel; ++byte) {
+		pixel[byte] = value >> (byte * 8);
+	}
+}
+
+//check if a palette index is one of the nearest palette entries to a color. which one of equally near entries is picked does not matter
+static bool isNearest(uint8_t index, uint32_t color, const Palette & palette)
+{
+	if (index >= palette.getColorCount()) {
+		return false;
+	}
+	const std::vector<uint32_t> & colors = palette.getColors();
+	auto distance = [color](uint32_t entry) {
+		const int32_t red = (int32_t)((color >> 16) & 0xff) - (int32_t)((entry >> 16) & 0xff);
+		const int32_t green = (int32_t)((color >> 8) & 0xff) - (int32_t)((entry >> 8) & 0xff);
+		const int32_t blue = (int32_t)(color & 0xff) - (int32_t)(entry & 0xff);
+		return 3 * red * red + 4 * green * green + 2 * blue * blue;
+	};
+	const int32_t pixelDistance = distance(colors[index]);
+	for (uint32_t entry = 0; entry < palette.getColorCount(); ++entry) {
+		if (distance(colors[entry]) < pixelDistance) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//check if a pixel is what the reference makes of an X8R8G8B8 color.
+//a palette index must be one of the nearest palette entries to the 15bit color the inverse colormap looks up
+static bool isWritten(const uint8_t * pixel, Framebuffer::PixelFormat format, uint32_t color, const Palette & palette)
+{
+	if (format == Framebuffer::PALETTE8) {
+		return isNearest(*pixel, repeatBits(color >> 19, 5, 8) << 16 | repeatBits(color >> 11, 5, 8) << 8 | repeatBits(color >> 3, 5, 8), palette);
+	}
+	uint8_t expected[4];
+	referenceWrite(expected, format, color);
+	return memcmp(pixel, expected, Framebuffer::getPixelFormatInfo(format).bytesPerPixel) == 0;
+}
+
+//check if a pixel is what the reference makes of a source pixel. pixels with the same layout are copied unchanged, including bits that are no color component
+static bool isConverted(const uint8_t * pixel, Framebuffer::PixelFormat format, const uint8_t * source, Framebuffer::PixelFormat sourceFormat, const Palette & palette)
+{
+	if (format == sourceFormat || (format == Framebuffer::X8R8G8B8 && sourceFormat == Framebuffer::A8R8G8B8)) {
+		return memcmp(pixel, source, Framebuffer::getPixelFormatInfo(format).bytesPerPixel) == 0;
+	}
+	return isWritten(pixel, format, referenceRead(source, sourceFormat, palette), palette);
+}
+
+//rounded division by 255 for the blending and interpolation references
+static uint32_t divide255(uint32_t value)
+{
+	return (value + 127) / 255;
+}
+
+//blend a premultiplied A8R8G8B8 color over an X8R8G8B8 color: dest = source * opacity + dest * (1 - alpha * opacity). the result is opaque
+static uint32_t referenceBlend(uint32_t dest, uint32_t source, uint8_t opacity)
+{
+	const uint32_t alpha = divide255((source >> 24) * opacity);
+	uint32_t result = 0xff000000;
+	for (uint32_t shift = 0; shift < 24; shift += 8) {
+		const uint32_t component = divide255(((source >> shift) & 0xff) * opacity) + divide255(((dest >> shift) & 0xff) * (255 - alpha));
+		result |= std::min(component, 255u) << shift;
+	}
+	return result;
+}
+
+//check if a pixel is the interpolation of two pixels. the formats in the table are interpolated channel by channel at the bit depth of their channels,
+//palette indices and the layouts of devices interpolate their 8bit colors, which are then written like any other color. palette indices use the fixed R3G3B2 palette
+static bool isInterpolated(const uint8_t * pixel, Framebuffer::PixelFormat format, const uint8_t * from, const uint8_t * to, uint8_t weight, const Palette & palette)
+{
+	auto interpolate = [weight](uint32_t a, uint32_t b) {
+		return divide255(a * (255 - weight) + b * weight);
+	};
+	if (format == Framebuffer::PALETTE8 || format >= Framebuffer::pixelFormatCount) {
+		const uint32_t fromColor = referenceRead(from, format, palette);
+		const uint32_t toColor = referenceRead(to, format, palette);
+		uint32_t color = 0;
+		for (uint32_t shift = 0; shift < 24; shift += 8) {
+			color |= interpolate((fromColor >> shift) & 0xff, (toColor >> shift) & 0xff) << shift;
+		}
+		//lerpLine() rounds to the nearest palette entry without the 15bit inverse colormap
+		return format == Framebuffer::PALETTE8 ? isNearest(*pixel, color, palette) : isWritten(pixel, format, color, palette);
+	}
+	const Framebuffer::PixelFormatInfo & info = Framebuffer::getPixelFormatInfo(format);
+	uint32_t value = 0;
+	uint32_t fromValue = 0;
+	uint32_t toValue = 0;
+	for (uint32_t byte = 0; byte < info.bytesPerPixel; ++byte) {
+		value |= (uint32_t)pixel[byte] << (byte * 8);
+		fromValue |= (uint32_t)from[byte] << (byte * 8);
+		toValue |= (uint32_t)to[byte] << (byte * 8);
+	}
+	//GREY8 only has the red channel in the table
+	const uint32_t bits[3] = {info.bitsRed, info.bitsGreen, info.bitsBlue};
+	const uint32_t shifts[3] = {info.shiftRed, info.shiftGreen, info.shiftBlue};
+	for (uint32_t channel = 0; channel < 3; ++channel) {
+		const uint32_t mask = (1 << bits[channel]) - 1;
+		if (((value >> shifts[channel]) & mask) != interpolate((fromValue >> shifts[channel]) & mask, (toValue >> shifts[channel]) & mask)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void appendBigEndian(std::vector<uint8_t> & data, uint32_t value)
+{
+	for (int32_t shift = 24; shift >= 0; shift -= 8) {
+		data.push_back(value >> shift);
+	}
+}
+
+static uint32_t crc32(const uint8_t * data, size_t size)
+{
+	uint32_t crc = 0xffffffff;
+	for (size_t i = 0; i < size; ++i) {
+		crc ^= data[i];
+		for (uint32_t bit = 0; bit < 8; ++bit) {
+			crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
+
+//write an 8bit RGB image as PNG. the data is stored uncompressed, so this needs no zlib and does not depend on the code that is checked
+static bool writePng(int file, const std::vector<uint8_t> & rgb, uint32_t width, uint32_t height)
+{
+	std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	auto appendChunk = [&png](const char * type, const std::vector<uint8_t> & data) {
+		appendBigEndian(png, data.size());
+		const size_t start = png.size();
+		png.insert(png.end(), type, type + 4);
+		png.insert(png.end(), data.cbegin(), data.cend());
+		appendBigEndian(png, crc32(png.data() + start, png.size() - start));
+	};
+	//8bit RGB, deflate, adaptive filtering, not interlaced
+	std::vector<uint8_t> header;
+	appendBigEndian(header, width);
+	appendBigEndian(header, height);
+	header.insert(header.end(), {8, 2, 0, 0, 0});
+	//every scanline starts with its filter type. 0 is none
+	std::vector<uint8_t> scanlines;
+	for (uint32_t row = 0; row < height; ++row) {
+		scanlines.push_back(0);
+		scanlines.insert(scanlines.end(), rgb.cbegin() + row * width * 3, rgb.cbegin() + (row + 1) * width * 3);
+	}
+	//zlib stream with stored deflate blocks of at most 65535 Bytes and an Adler-32 checksum
+	std::vector<uint8_t> stream = {0x78, 0x01};
+	size_t offset = 0;
+	do {
+		const uint32_t size = std::min<size_t>(scanlines.size() - offset, 65535);
+		stream.push_back(offset + size == scanlines.size() ? 1 : 0);
+		stream.insert(stream.end(), {(uint8_t)size, (uint8_t)(size >> 8), (uint8_t)~size, (uint8_t)(~size >> 8)});
+		stream.insert(stream.end(), scanlines.cbegin() + offset, scanlines.cbegin() + offset + size);
+		offset += size;
+	} while (offset < scanlines.size());
+	uint32_t a = 1;
+	uint32_t b = 0;
+	for (size_t i = 0; i < scanlines.size(); ++i) {
+		a = (a + scanlines[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	appendBigEndian(stream, b << 16 | a);
+	appendChunk("IHDR", header);
+	appendChunk("IDAT", stream);
+	appendChunk("IEND", std::vector<uint8_t>());
+	return write(file, png.data(), png.size()) == (ssize_t)png.size();
+}
+
+Benchmark::Benchmark(const std::string & baselineFile, bool record, float tolerance, uint32_t width, uint32_t height)
+	: m_baselineFile(baselineFile)
+	, m_record(record)
+	, m_tolerance(tolerance)
+	, m_width(width)
+	, m_height(height)
+	, m_hasBaseline(false)
+	, m_regressions(0)
+{
+}
+
+void Benchmark::fillPattern(std::vector<uint8_t> & data, uint32_t seed)
+{
+	for (size_t i = 0; i < data.size(); ++i) {
+		seed = seed * 1664525 + 1013904223;
+		data[i] = seed >> 24;
+	}
+}
+
+//make pseudo-random A8R8G8B8 pixels premultiplied, so no color component is bigger than alpha.
+//fully transparent and opaque pixels take other paths in some kernels, so every 5th pixel is transparent and every 7th opaque
+static void premultiplyPattern(std::vector<uint8_t> & data)
+{
+	for (size_t pixel = 0; pixel + 4 <= data.size(); pixel += 4) {
+		if ((pixel / 4) % 5 == 0) {
+			data[pixel + 3] = 0;
+		}
+		else if ((pixel / 4) % 7 == 0) {
+			data[pixel + 3] = 255;
+		}
+		for (size_t component = 0; component < 3; ++component) {
+			data[pixel + component] = std::min(data[pixel + component], data[pixel + 3]);
+		}
+	}
+}
+
+bool Benchmark::checkBlit(Framebuffer::PixelFormat destFormat, Framebuffer::PixelFormat sourceFormat) const
+{
+	const Framebuffer::PixelFormatInfo & sourceInfo = Framebuffer::getPixelFormatInfo(sourceFormat);
+	const Framebuffer::PixelFormatInfo & destInfo = Framebuffer::getPixelFormatInfo(destFormat);
+	const uint32_t sourceLineLength = paddedLineLength(CHECK_WIDTH, sourceFormat);
+	std::vector<uint8_t> source(CHECK_HEIGHT * sourceLineLength);
+	fillPattern(source, destFormat * 256 + sourceFormat);
+	//fill the framebuffer with a pattern first, so pixels that are not written are found too.
+	//the dither pattern would hide which palette entry is the nearest, so do not dither
+	const uint32_t width = CHECK_WIDTH + 7;
+	const uint32_t height = CHECK_HEIGHT + 5;
+	const uint32_t lineLength = paddedLineLength(width, destFormat);
+	Framebuffer framebuffer(width, height, destFormat, lineLength);
+	framebuffer.setDithering(false);
+	std::vector<uint8_t> background(height * lineLength);
+	fillPattern(background, sourceFormat * 256 + destFormat);
+	framebuffer.blit(0, 0, background.data(), width, height, destFormat, lineLength);
+	const std::vector<uint8_t> before(framebuffer.getData(), framebuffer.getData() + height * lineLength);
+	framebuffer.blit(CHECK_X, CHECK_Y, source.data(), CHECK_WIDTH, CHECK_HEIGHT, sourceFormat, sourceLineLength);
+	const Palette & palette = framebuffer.getPalette();
+	const uint8_t * result = framebuffer.getData();
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t i = 0; i < lineLength; ++i) {
+			const uint32_t x = i / destInfo.bytesPerPixel;
+			const size_t offset = y * lineLength + i;
+			bool correct = true;
+			if (y < CHECK_Y || y >= CHECK_Y + CHECK_HEIGHT || x < CHECK_X || x >= CHECK_X + CHECK_WIDTH) {
+				correct = result[offset] == before[offset];
+			}
+			else if (i % destInfo.bytesPerPixel == 0) {
+				correct = isConverted(result + offset, destFormat, source.data() + (y - CHECK_Y) * sourceLineLength + (x - CHECK_X) * sourceInfo.bytesPerPixel, sourceFormat, palette);
+			}
+			if (!correct) {
+				std::cout << "Blitting " << sourceInfo.name << " to " << destInfo.name << " is wrong at line " << y << ", Byte " << i << "!" << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool Benchmark::checkOrientations(Framebuffer::PixelFormat destFormat, Framebuffer::PixelFormat sourceFormat) const
+{
+	const uint32_t sourceLineLength = paddedLineLength(CHECK_WIDTH, sourceFormat);
+	std::vector<uint8_t> source(CHECK_HEIGHT * sourceLineLength);
+	fillPattern(source, destFormat * 256 + sourceFormat);
+	//the framebuffer is square, so the image is at the same place in drawing coordinates for every orientation.
+	//the dither pattern depends on the position on the panel, so do not dither
+	const uint32_t lineLength = paddedLineLength(CHECK_SIZE, destFormat);
+	Framebuffer unrotated(CHECK_SIZE, CHECK_SIZE, destFormat, lineLength);
+	unrotated.setDithering(false);
+	unrotated.blit(CHECK_X, CHECK_Y, source.data(), CHECK_WIDTH, CHECK_HEIGHT, sourceFormat, sourceLineLength);
+	std::vector<uint32_t> reference(CHECK_SIZE * CHECK_SIZE);
+	unrotated.readRect(reference.data(), 0, 0, CHECK_SIZE, CHECK_SIZE);
+	std::vector<uint32_t> result(CHECK_SIZE * CHECK_SIZE);
+	for (uint32_t orientation = Framebuffer::ROTATE_0; orientation <= Framebuffer::ROTATE_270; ++orientation) {
+		for (uint32_t mirror = 0; mirror < 2; ++mirror) {
+			if (orientation == Framebuffer::ROTATE_0 && mirror == 0) {
+				continue;
+			}
+			Framebuffer rotated(CHECK_SIZE, CHECK_SIZE, destFormat, lineLength);
+			rotated.setDithering(false);
+			rotated.setOrientation((Framebuffer::Orientation)orientation, mirror != 0);
+			rotated.blit(CHECK_X, CHECK_Y, source.data(), CHECK_WIDTH, CHECK_HEIGHT, sourceFormat, sourceLineLength);
+			rotated.readRect(result.data(), 0, 0, CHECK_SIZE, CHECK_SIZE);
+			if (result != reference) {
+				std::cout << "Blitting " << Framebuffer::getPixelFormatInfo(sourceFormat).name << " to " << Framebuffer::getPixelFormatInfo(destFormat).name;
+				std::cout << " rotated by " << orientation * 90 << " degrees" << (mirror ? " and mirrored" : "") << " is wrong!" << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool Benchmark::checkImage(Framebuffer::PixelFormat destFormat) const
+{
+	std::vector<uint8_t> rgb(CHECK_WIDTH * CHECK_HEIGHT * 3);
+	fillPattern(rgb, destFormat);
+	char fileName[] = "/tmp/sfivt-check-XXXXXX.png";
+	const int file = mkstemps(fileName, 4);
+	if (file < 0) {
+		std::cout << "Failed to create a temporary file!" << std::endl;
+		return false;
+	}
+	const bool written = writePng(file, rgb, CHECK_WIDTH, CHECK_HEIGHT);
+	close(file);
+	//the framebuffer is as high as the image, so it is fitted without scaling and gets borders on the left and right
+	const uint32_t frameWidth = CHECK_WIDTH + 16;
+	const uint32_t frameHeight = CHECK_HEIGHT;
+	uint32_t width = frameWidth;
+	uint32_t height = frameHeight;
+	ImageIO::Orientation orientation = {Framebuffer::ROTATE_0, false};
+	const ImageBuffer data = written ? ImageIO::loadFile_RGBA32(fileName, width, height, true, &orientation) : ImageBuffer();
+	unlink(fileName);
+	if (data.empty() || width != CHECK_WIDTH || height != CHECK_HEIGHT) {
+		std::cout << "Loading a " << CHECK_WIDTH << "x" << CHECK_HEIGHT << " PNG image failed!" << std::endl;
+		return false;
+	}
+	const Framebuffer::PixelFormatInfo & destInfo = Framebuffer::getPixelFormatInfo(destFormat);
+	const uint32_t lineLength = paddedLineLength(frameWidth, destFormat);
+	Framebuffer framebuffer(frameWidth, frameHeight, destFormat, lineLength);
+	framebuffer.setDithering(false);
+	std::vector<uint8_t> background(frameHeight * lineLength);
+	fillPattern(background, destFormat);
+	framebuffer.blit(0, 0, background.data(), frameWidth, frameHeight, destFormat, lineLength);
+	const std::vector<uint8_t> before(framebuffer.getData(), framebuffer.getData() + frameHeight * lineLength);
+	//display the image like the viewer does
+	framebuffer.addOrientation(orientation.rotation, orientation.mirror);
+	if (destFormat == Framebuffer::PALETTE8) {
+		framebuffer.setPalette(Palette::fromImage(data.data(), width, height));
+	}
+	const uint32_t x = (frameWidth - width) / 2;
+	const uint32_t y = (frameHeight - height) / 2;
+	uint8_t clearColor[4];
+	framebuffer.convertColor(clearColor, 0);
+	framebuffer.fillRect(0, 0, frameWidth, y, clearColor);
+	framebuffer.fillRect(0, y + height, frameWidth, frameHeight - (y + height), clearColor);
+	framebuffer.fillRect(0, y, x, height, clearColor);
+	framebuffer.fillRect(x + width, y, frameWidth - (x + width), height, clearColor);
+	framebuffer.blit(x, y, data.data(), width, height, Framebuffer::X8R8G8B8);
+	//every pixel must have the color of the PNG data or be black, which the viewer clears the borders with. the padding must not change
+	const uint8_t * result = framebuffer.getData();
+	for (uint32_t row = 0; row < frameHeight; ++row) {
+		const uint8_t * line = result + row * lineLength;
+		for (uint32_t column = 0; column < frameWidth; ++column) {
+			//X8R8G8B8 Bytes are B, G, R, X. decoded images are opaque
+			uint8_t pixel[4] = {0, 0, 0, 0};
+			if (row >= y && row < y + height && column >= x && column < x + width) {
+				const uint8_t * rgbPixel = rgb.data() + ((row - y) * width + column - x) * 3;
+				pixel[0] = rgbPixel[2];
+				pixel[1] = rgbPixel[1];
+				pixel[2] = rgbPixel[0];
+				pixel[3] = 0xff;
+			}
+			if (!isConverted(line + column * destInfo.bytesPerPixel, destFormat, pixel, Framebuffer::X8R8G8B8, framebuffer.getPalette())) {
+				std::cout << "Displaying a PNG image on " << destInfo.name << " is wrong at line " << row << ", pixel " << column << "!" << std::endl;
+				return false;
+			}
+		}
+		if (memcmp(line + frameWidth * destInfo.bytesPerPixel, before.data() + row * lineLength + frameWidth * destInfo.bytesPerPixel, lineLength - frameWidth * destInfo.bytesPerPixel) != 0) {
+			std::cout << "Displaying a PNG image on " << destInfo.name << " changed the padding of line " << row << "!" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Benchmark::checkBlend(Framebuffer::PixelFormat destFormat) const
+{
+	const Framebuffer::PixelFormatInfo & destInfo = Framebuffer::getPixelFormatInfo(destFormat);
+	const uint32_t sourceLineLength = paddedLineLength(CHECK_WIDTH, Framebuffer::A8R8G8B8);
+	std::vector<uint8_t> source(CHECK_HEIGHT * sourceLineLength);
+	fillPattern(source, destFormat * 256 + Framebuffer::A8R8G8B8);
+	premultiplyPattern(source);
+	//blend over a pattern, so every pixel of the framebuffer is read back and pixels that are not written are found too
+	const uint32_t width = CHECK_WIDTH + 7;
+	const uint32_t height = CHECK_HEIGHT + 5;
+	const uint32_t lineLength = paddedLineLength(width, destFormat);
+	std::vector<uint8_t> background(height * lineLength);
+	fillPattern(background, Framebuffer::A8R8G8B8 * 256 + destFormat);
+	const uint8_t opacities[] = {255, 160};
+	for (size_t index = 0; index < sizeof(opacities); ++index) {
+		const uint8_t opacity = opacities[index];
+		Framebuffer framebuffer(width, height, destFormat, lineLength);
+		framebuffer.setDithering(false);
+		framebuffer.blit(0, 0, background.data(), width, height, destFormat, lineLength);
+		const std::vector<uint8_t> before(framebuffer.getData(), framebuffer.getData() + height * lineLength);
+		framebuffer.blitBlend(CHECK_X, CHECK_Y, source.data(), CHECK_WIDTH, CHECK_HEIGHT, opacity, sourceLineLength);
+		const Palette & palette = framebuffer.getPalette();
+		const uint8_t * result = framebuffer.getData();
+		for (uint32_t y = 0; y < height; ++y) {
+			for (uint32_t i = 0; i < lineLength; ++i) {
+				const uint32_t x = i / destInfo.bytesPerPixel;
+				const size_t offset = y * lineLength + i;
+				bool correct = true;
+				if (y < CHECK_Y || y >= CHECK_Y + CHECK_HEIGHT || x < CHECK_X || x >= CHECK_X + CHECK_WIDTH) {
+					correct = result[offset] == before[offset];
+				}
+				else if (i % destInfo.bytesPerPixel == 0) {
+					uint32_t sourceColor = 0;
+					memcpy(&sourceColor, source.data() + (y - CHECK_Y) * sourceLineLength + (x - CHECK_X) * 4, 4);
+					const uint32_t color = referenceBlend(referenceRead(before.data() + offset, destFormat, palette), sourceColor, opacity);
+					//pixels under fully transparent pixels may be left as they are
+					correct = isWritten(result + offset, destFormat, color, palette)
+						|| (divide255((sourceColor >> 24) * opacity) == 0 && memcmp(result + offset, before.data() + offset, destInfo.bytesPerPixel) == 0);
+				}
+				if (!correct) {
+					std::cout << "Blending A8R8G8B8 with opacity " << (uint32_t)opacity << " over " << destInfo.name << " is wrong at line " << y << ", Byte " << i << "!" << std::endl;
+					return false;
+				}
+			}
+		}
+	}
+	//the framebuffer is square, so the image is at the same place in drawing coordinates for every orientation
+	const uint32_t squareLineLength = paddedLineLength(CHECK_SIZE, destFormat);
+	std::vector<uint8_t> pattern(CHECK_SIZE * CHECK_SIZE * 4);
+	fillPattern(pattern, destFormat);
+	std::vector<uint32_t> reference(CHECK_SIZE * CHECK_SIZE);
+	std::vector<uint32_t> result(CHECK_SIZE * CHECK_SIZE);
+	for (uint32_t orientation = Framebuffer::ROTATE_0; orientation <= Framebuffer::ROTATE_270; ++orientation) {
+		for (uint32_t mirror = 0; mirror < 2; ++mirror) {
+			const bool unrotated = orientation == Framebuffer::ROTATE_0 && mirror == 0;
+			Framebuffer framebuffer(CHECK_SIZE, CHECK_SIZE, destFormat, squareLineLength);
+			framebuffer.setDithering(false);
+			framebuffer.setOrientation((Framebuffer::Orientation)orientation, mirror != 0);
+			framebuffer.blit(0, 0, pattern.data(), CHECK_SIZE, CHECK_SIZE, Framebuffer::X8R8G8B8);
+			framebuffer.blitBlend(CHECK_X, CHECK_Y, source.data(), CHECK_WIDTH, CHECK_HEIGHT, 160, sourceLineLength);
+			framebuffer.readRect(unrotated ? reference.data() : result.data(), 0, 0, CHECK_SIZE, CHECK_SIZE);
+			if (!unrotated && result != reference) {
+				std::cout << "Blending A8R8G8B8 over " << destInfo.name << " rotated by " << orientation * 90 << " degrees" << (mirror ? " and mirrored" : "") << " is wrong!" << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool Benchmark::checkLerp(Framebuffer::PixelFormat format) const
+{
+	const Framebuffer::PixelFormatInfo & info = Framebuffer::getPixelFormatInfo(format);
+	const uint32_t bytesPerPixel = info.bytesPerPixel;
+	//longer than the chunks some formats are interpolated in
+	const uint32_t count = CHECK_WIDTH * 3;
+	std::vector<uint8_t> from(count * bytesPerPixel);
+	std::vector<uint8_t> to(count * bytesPerPixel);
+	std::vector<uint8_t> result(count * bytesPerPixel);
+	fillPattern(from, format);
+	fillPattern(to, format * 256 + 255);
+	//palette indices are interpolated through the fixed R3G3B2 palette
+	const Palette palette;
+	const uint8_t weights[] = {0, 1, 77, 128, 254, 255};
+	for (size_t index = 0; index < sizeof(weights); ++index) {
+		const uint8_t weight = weights[index];
+		PixelOps::lerpLine(result.data(), from.data(), to.data(), format, count, weight);
+		for (uint32_t pixel = 0; pixel < count; ++pixel) {
+			const size_t offset = pixel * bytesPerPixel;
+			if (!isInterpolated(result.data() + offset, format, from.data() + offset, to.data() + offset, weight, palette)) {
+				std::cout << "Interpolating " << info.name << " with weight " << (uint32_t)weight << " is wrong at pixel " << pixel << "!" << std::endl;
+				return false;
+			}
+		}
+		//the result may be written over one of the scanlines it is interpolated from
+		std::vector<uint8_t> inPlace(to);
+		PixelOps::lerpLine(inPlace.data(), from.data(), inPlace.data(), format, count, weight);
+		if (inPlace != result) {
+			std::cout << "Interpolating " << info.name << " in place with weight " << (uint32_t)weight << " is wrong!" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Benchmark::checkLayers() const
+{
+	//what the reference needs to know about a layer. data is straight alpha A8R8G8B8, or X8R8G8B8 with random alpha if the layer has no alpha
+	struct Layer
+	{
+		std::vector<uint8_t> data;
+		uint32_t width;
+		uint32_t height;
+		int32_t x;
+		int32_t y;
+		bool hasAlpha;
+		uint8_t opacity;
+		bool visible;
+	};
+	std::vector<Layer> layers = {
+		{std::vector<uint8_t>(), 29, 17, -6, 4, true, 255, true}, //partly outside on the left
+		{std::vector<uint8_t>(), 13, 31, 20, -9, false, 200, true}, //no alpha, but global opacity. partly outside on the top
+		{std::vector<uint8_t>(), 41, 9, 11, 30, true, 255, true}, //only opaque pixels, so it is copied
+		{std::vector<uint8_t>(), 7, 5, 50, 3, true, 128, true}, //outside on the right
+	};
+	const uint32_t width = CHECK_SIZE;
+	const uint32_t height = CHECK_SIZE - 7;
+	uint32_t backgroundColor = 0x123456;
+	LayerStack stack(width, height, backgroundColor);
+	for (size_t index = 0; index < layers.size(); ++index) {
+		Layer & layer = layers[index];
+		layer.data.resize(layer.width * layer.height * 4);
+		fillPattern(layer.data, Framebuffer::pixelFormatCount + index);
+		for (size_t pixel = 0; pixel < layer.data.size(); pixel += 4) {
+			if (index == 2 || (pixel / 4) % 7 == 0) {
+				layer.data[pixel + 3] = 255;
+			}
+			else if ((pixel / 4) % 5 == 0) {
+				layer.data[pixel + 3] = 0;
+			}
+		}
+		stack.addLayer(ImageBuffer(layer.data.cbegin(), layer.data.cend()), layer.width, layer.height, layer.x, layer.y, layer.hasAlpha, layer.opacity);
+	}
+	//the composition is presented with an offset on a bigger framebuffer, which must show it unchanged
+	const uint32_t presentX = 5;
+	const uint32_t presentY = 3;
+	Framebuffer framebuffer(width + 16, height + 8, Framebuffer::X8R8G8B8);
+	std::vector<uint32_t> presented(width * height);
+	//change layers after every present, so only parts of the composition are composited again
+	for (uint32_t change = 0; change < 3; ++change) {
+		if (change == 1) {
+			layers[0].x = 25;
+			layers[0].y = 20;
+			stack.setLayerPosition(0, layers[0].x, layers[0].y);
+			layers[1].opacity = 90;
+			stack.setLayerOpacity(1, layers[1].opacity);
+			layers[2].visible = false;
+			stack.setLayerVisible(2, false);
+		}
+		else if (change == 2) {
+			backgroundColor = 0xabcdef;
+			stack.setBackgroundColor(backgroundColor);
+			layers[2].visible = true;
+			stack.setLayerVisible(2, true);
+			layers[3].x = 40;
+			layers[3].y = 35;
+			stack.setLayerPosition(3, layers[3].x, layers[3].y);
+		}
+		stack.present(framebuffer, presentX, presentY);
+		const uint32_t * composition = reinterpret_cast<const uint32_t *>(stack.getData());
+		framebuffer.readRect(presented.data(), presentX, presentY, width, height);
+		for (uint32_t y = 0; y < height; ++y) {
+			for (uint32_t x = 0; x < width; ++x) {
+				//blend the layers over the background, bottom to top
+				uint32_t color = 0xff000000 | backgroundColor;
+				for (auto layer = layers.cbegin(); layer != layers.cend(); ++layer) {
+					const int32_t layerX = (int32_t)x - layer->x;
+					const int32_t layerY = (int32_t)y - layer->y;
+					if (!layer->visible || layerX < 0 || layerY < 0 || layerX >= (int32_t)layer->width || layerY >= (int32_t)layer->height) {
+						continue;
+					}
+					uint32_t source = 0;
+					memcpy(&source, layer->data.data() + (layerY * layer->width + layerX) * 4, 4);
+					if (!layer->hasAlpha) {
+						source |= 0xff000000;
+					}
+					const uint32_t alpha = source >> 24;
+					uint32_t premultiplied = alpha << 24;
+					for (uint32_t shift = 0; shift < 24; shift += 8) {
+						premultiplied |= divide255(((source >> shift) & 0xff) * alpha) << shift;
+					}
+					color = referenceBlend(color, premultiplied, layer->opacity);
+				}
+				const size_t pixel = y * width + x;
+				if (composition[pixel] != color || presented[pixel] != composition[pixel]) {
+					std::cout << "Compositing layers is wrong at " << x << "," << y << " after " << change << " changes!" << std::endl;
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+template <typename OPERATION>
+double Benchmark::measure(OPERATION operation) const
+{
+	typedef std::chrono::steady_clock Clock;
+	//the first run touches all memory and fills the caches
+	operation();
+	const Clock::time_point start = Clock::now();
+	const Clock::time_point end = start + std::chrono::milliseconds(MEASURE_MILLISECONDS);
+	uint32_t runs = 0;
+	Clock::time_point now;
+	do {
+		operation();
+		runs++;
+		now = Clock::now();
+	} while (now < end);
+	return (double)m_width * m_height * runs / std::chrono::duration<double, std::micro>(now - start).count();
+}
+
+void Benchmark::addResult(const std::string & name, double value, bool higherIsBetter, float tolerance)
+{
+	m_results.push_back(std::make_pair(name, value));
+	std::cout << name << ": " << std::fixed << std::setprecision(1) << value;
+	auto baseline = m_baseline.find(name);
+	if (baseline != m_baseline.end()) {
+		std::cout << " (baseline " << baseline->second << ")";
+		const bool worse = higherIsBetter ? (value < baseline->second * (1.0 - tolerance)) : (value > baseline->second * (1.0 + tolerance));
+		if (worse) {
+			std::cout << " - REGRESSION!";
+			m_regressions++;
+		}
+	}
+	std::cout << std::endl;
+}
+bool Benchmark::readBaseline()
+{
+	std::ifstream in(m_baselineFile.c_str());
+	if (!in.is_open()) {
+		return false;
+	}
+	std::string name;
+	double value = 0;
+	while (in >> name >> value) {
+		m_baseline[name] = value;
+	}
+	return true;
+}
+
+bool Benchmark::writeBaseline() const
+{
+	std::ofstream out(m_baselineFile.c_str(), std::ios::trunc);
+	for (auto result = m_results.cbegin(); result != m_results.cend(); ++result) {
+		out << result->first << " " << std::fixed << std::setprecision(1) << result->second << std::endl;
+	}
+	return out.good();
+}
+
+//A8R8G8B8 is only a source format
+static void listFormats(std::vector<Framebuffer::PixelFormat> & sourceFormats, std::vector<Framebuffer::PixelFormat> & destFormats)
+{
+	for (size_t format = Framebuffer::BAD_PIXELFORMAT + 1; format < Framebuffer::pixelFormatCount; ++format) {
+		sourceFormats.push_back((Framebuffer::PixelFormat)format);
+		if (format != Framebuffer::A8R8G8B8) {
+			destFormats.push_back((Framebuffer::PixelFormat)format);
+		}
+	}
+}
+
+//channel layouts of devices that no named format has, as length and offset of red, green and blue. they get formats added by Framebuffer::screenInfoToPixelFormat()
+static const uint32_t DEVICE_LAYOUTS[][7] = {
+	{24, 6, 12, 6, 6, 6, 0}, //RGB666 in 24bit
+	{16, 4, 8, 4, 4, 4, 0}, //RGB444
+	{32, 10, 20, 10, 10, 10, 0}, //2-10-10-10
+	{16, 3, 0, 3, 3, 2, 6}, //BGR233, channels with less than 4 bits
+};
+
+static bool listDeviceFormats(std::vector<Framebuffer::PixelFormat> & formats)
+{
+	for (size_t index = 0; index < sizeof(DEVICE_LAYOUTS) / sizeof(DEVICE_LAYOUTS[0]); ++index) {
+		const uint32_t * layout = DEVICE_LAYOUTS[index];
+		struct fb_var_screeninfo screenInfo;
+		memset(&screenInfo, 0, sizeof(screenInfo));
+		screenInfo.bits_per_pixel = layout[0];
+		screenInfo.red.length = layout[1];
+		screenInfo.red.offset = layout[2];
+		screenInfo.green.length = layout[3];
+		screenInfo.green.offset = layout[4];
+		screenInfo.blue.length = layout[5];
+		screenInfo.blue.offset = layout[6];
+		const Framebuffer::PixelFormat format = Framebuffer::screenInfoToPixelFormat(screenInfo);
+		if (format == Framebuffer::BAD_PIXELFORMAT) {
+			std::cout << "No pixel format for a " << layout[0] << "bpp device with red " << layout[1] << "@" << layout[2] << ", green " << layout[3] << "@" << layout[4] << ", blue " << layout[5] << "@" << layout[6] << "!" << std::endl;
+			return false;
+		}
+		formats.push_back(format);
+	}
+	return true;
+}
+
+bool Benchmark::check() const
+{
+	std::vector<Framebuffer::PixelFormat> sourceFormats;
+	std::vector<Framebuffer::PixelFormat> destFormats;
+	listFormats(sourceFormats, destFormats);
+	uint32_t wrong = 0;
+	//device formats are converted by the generic kernels only, so check them from and to every other format
+	std::vector<Framebuffer::PixelFormat> deviceFormats;
+	if (!listDeviceFormats(deviceFormats)) {
+		wrong++;
+	}
+	sourceFormats.insert(sourceFormats.end(), deviceFormats.cbegin(), deviceFormats.cend());
+	destFormats.insert(destFormats.end(), deviceFormats.cbegin(), deviceFormats.cend());
+	for (auto destFormat = destFormats.cbegin(); destFormat != destFormats.cend(); ++destFormat) {
+		for (auto sourceFormat = sourceFormats.cbegin(); sourceFormat != sourceFormats.cend(); ++sourceFormat) {
+			if (!checkBlit(*destFormat, *sourceFormat) || !checkOrientations(*destFormat, *sourceFormat)) {
+				wrong++;
+			}
+		}
+		if (!checkBlend(*destFormat)) {
+			wrong++;
+		}
+		if (!checkLerp(*destFormat)) {
+			wrong++;
+		}
+		if (!checkImage(*destFormat)) {
+			wrong++;
+		}
+	}
+	if (!checkLayers()) {
+		wrong++;
+	}
+	std::cout << "Checked " << destFormats.size() * sourceFormats.size() << " format combinations, blending, interpolating and displaying images in " << destFormats.size() << " formats and compositing layers, " << wrong << " wrong." << std::endl;
+	return wrong == 0;
+}
+
+bool Benchmark::run()
+{
+	//a run without a baseline would pass no matter how slow it is, so the baseline has to be recorded explicitly
+	m_hasBaseline = !m_record && readBaseline();
+	if (!m_record && !m_hasBaseline) {
+		std::cout << "Baseline " << m_baselineFile << " does not exist! Record it with --record on an idle machine first." << std::endl;
+		return false;
+	}
+	//check pixels first. how fast wrong pixels are drawn does not matter
+	const bool correct = check();
+	std::vector<Framebuffer::PixelFormat> sourceFormats;
+	std::vector<Framebuffer::PixelFormat> destFormats;
+	listFormats(sourceFormats, destFormats);
+	//measure throughput in MPixels/s on a framebuffer of the size of a typical panel
+	std::cout << "Measuring " << m_width << "x" << m_height << " blits in MPixels/s..." << std::endl;
+	//other processes can slow down the CPU for a while. measure everything in a few rounds and use the median, so a slow phase does not look like a regression.
+	//buffers are allocated again for every round, because how fast memory is copied can also depend on where the buffers are
+	std::vector<std::string> names;
+	std::vector<std::vector<double>> samples;
+	for (uint32_t round = 0; round < MEASURE_ROUNDS; ++round) {
+		std::vector<uint8_t> source;
+		size_t index = 0;
+		auto addSample = [&](const std::string & name, double throughput) {
+			if (round == 0) {
+				names.push_back(name);
+				samples.push_back(std::vector<double>());
+			}
+			samples[index++].push_back(throughput);
+		};
+		for (auto destFormat = destFormats.cbegin(); destFormat != destFormats.cend(); ++destFormat) {
+			Framebuffer framebuffer(m_width, m_height, *destFormat);
+			const std::string destName = Framebuffer::pixelFormatInfo[*destFormat].name;
+			for (auto sourceFormat = sourceFormats.cbegin(); sourceFormat != sourceFormats.cend(); ++sourceFormat) {
+				source.resize(m_width * m_height * Framebuffer::pixelFormatInfo[*sourceFormat].bytesPerPixel);
+				fillPattern(source, *sourceFormat);
+				addSample("blit." + Framebuffer::pixelFormatInfo[*sourceFormat].name + "." + destName, measure([&]() {
+					framebuffer.blit(0, 0, source.data(), m_width, m_height, *sourceFormat);
+				}));
+			}
+			//images are drawn as X8R8G8B8, so that is what rotated displays and overlays are measured with.
+			//blended pixels must be premultiplied, so no color component may be bigger than alpha
+			source.resize(m_width * m_height * 4);
+			fillPattern(source, Framebuffer::A8R8G8B8);
+			premultiplyPattern(source);
+			addSample("blend.A8R8G8B8." + destName, measure([&]() {
+				framebuffer.blitBlend(0, 0, source.data(), m_width, m_height, 255);
+			}));
+			framebuffer.setOrientation(Framebuffer::ROTATE_90);
+			addSample("blitRotated.X8R8G8B8." + destName, measure([&]() {
+				framebuffer.blit(0, 0, source.data(), framebuffer.getWidth(), framebuffer.getHeight(), Framebuffer::X8R8G8B8);
+			}));
+		}
+	}
+	//single combinations only fail if they got much slower. the averages of all combinations drawing to a format,
+	//of all blends and of all rotated blits are much less noisy, so they are compared with the given tolerance.
+	//averages are geometric means, so every combination counts the same, no matter how fast it is
+	std::map<std::string, std::pair<double, uint32_t>> averages;
+	std::vector<std::string> averageNames;
+	for (size_t index = 0; index < names.size(); ++index) {
+		std::vector<double> & values = samples[index];
+		std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+		const double median = values[values.size() / 2];
+		addResult(names[index], median, true, COMBINATION_TOLERANCE);
+		//blit.R5G6B5.X8R8G8B8 counts for blit.X8R8G8B8, blend.A8R8G8B8.X8R8G8B8 for blend
+		const std::string operation = names[index].substr(0, names[index].find('.'));
+		const std::string averageName = operation == "blit" ? operation + names[index].substr(names[index].rfind('.')) : operation;
+		auto average = averages.find(averageName);
+		if (average == averages.end()) {
+			averageNames.push_back(averageName);
+			average = averages.insert(std::make_pair(averageName, std::make_pair(0.0, 0))).first;
+		}
+		average->second.first += std::log(median);
+		average->second.second++;
+	}
+	for (auto averageName = averageNames.cbegin(); averageName != averageNames.cend(); ++averageName) {
+		const std::pair<double, uint32_t> & average = averages[*averageName];
+		addResult(*averageName, std::exp(average.first / average.second), true, m_tolerance);
+	}
+	//ru_maxrss is in kB on Linux
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	addResult("peakRss", usage.ru_maxrss, false, m_tolerance);
+	if (!correct) {
+		std::cout << "Pixels are wrong. Not writing a baseline." << std::endl;
+		return false;
+	}
+	if (m_record) {
+		if (!writeBaseline()) {
+			std::cout << "Failed to write baseline " << m_baselineFile << "!" << std::endl;
+			return false;
+		}
+		std::cout << "Wrote baseline " << m_baselineFile << "." << std::endl;
+		return true;
+	}
+	std::cout << m_regressions << " of " << m_results.size() << " results are worse than the baseline. Averages may be " << (uint32_t)(m_tolerance * 100.0f + 0.5f) << "% worse, single combinations ";
+	std::cout << (uint32_t)(COMBINATION_TOLERANCE * 100.0f + 0.5f) << "%." << std::endl;
+	return m_regressions == 0;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "framebuffer.h"
+
+#include <string>
+#include <vector>
+#include <map>
+
+
+/*!
+Checks and measures the drawing code on virtual framebuffers, so it needs no display and gives the same pixels on every machine.
+Every source format is blitted to every framebuffer format with odd sizes and padded scanlines and every pixel is compared to a simple
+per-pixel reference built from \sa Framebuffer::getPixelFormatInfo(), which shares no code with the conversion kernels. Untouched pixels and
+padding must not change and rotated and mirrored blits must match unrotated ones. Blending, interpolating scanlines and compositing layers
+are checked against per-pixel references too. A PNG file is also loaded, fitted and displayed like images are, which must give the same pixels.
+Then the throughput of every combination, of rotated blits and of blending is measured, as well as the peak memory use.
+The numbers are compared to a baseline file, which must have been recorded before. A run fails if the averages over all combinations are
+slower or use more memory than the tolerance allows, or if a single combination is less than half as fast as before.
+*/
+class Benchmark
+{
+public:
+	/*!
+	Construct benchmark.
+	\param[in] baselineFile File with the results of an earlier run.
+	\param[in] record Optional. Pass true to write the results to the baseline file instead of comparing to it.
+	\param[in] tolerance Optional. How much worse than the baseline the results may be, e.g. 0.2 for 20%.
+	\param[in] width Optional. Width of the framebuffer used to measure throughput.
+	\param[in] height Optional. Height of the framebuffer used to measure throughput.
+	*/
+	Benchmark(const std::string & baselineFile, bool record = false, float tolerance = 0.2f, uint32_t width = 1280, uint32_t height = 720);
+
+	/*!
+	Check all pixels without measuring anything.
+	\return Returns false if any pixel was wrong.
+	*/
+	bool check() const;
+
+	/*!
+	Check all pixels, measure and compare to the baseline.
+	\return Returns false if any pixel was wrong, any result was worse than the baseline or the baseline does not exist. When recording, returns false if any pixel was wrong or the baseline could not be written.
+	*/
+	bool run();
+
+private:
+	/*!
+	Blit a small, odd-sized image in a format to a framebuffer in another format and compare the result to the reference.
+	\return Returns false if any pixel or any Byte outside of the image differs.
+	*/
+	bool checkBlit(Framebuffer::PixelFormat destFormat, Framebuffer::PixelFormat sourceFormat) const;
+
+	/*!
+	Blit a small image with every orientation and compare what is visible to the unrotated blit.
+	\return Returns false if any pixel differs.
+	*/
+	bool checkOrientations(Framebuffer::PixelFormat destFormat, Framebuffer::PixelFormat sourceFormat) const;
+
+	/*!
+	Write an image to a PNG file, load it with \sa ImageIO::loadFile_RGBA32(), center it on a framebuffer and clear the borders like the viewer does.
+	\return Returns false if the image could not be loaded or any pixel differs from the image or the black borders.
+	*/
+	bool checkImage(Framebuffer::PixelFormat destFormat) const;
+
+	/*!
+	Blend a small premultiplied A8R8G8B8 image over a pattern with and without global opacity and compare the result to the reference.
+	Blends with every orientation must match the unrotated one.
+	\return Returns false if any pixel or any Byte outside of the image differs.
+	*/
+	bool checkBlend(Framebuffer::PixelFormat destFormat) const;
+
+	/*!
+	Interpolate scanlines with \sa PixelOps::lerpLine() with different weights, also in place, and compare every channel to the reference.
+	\return Returns false if any pixel differs.
+	*/
+	bool checkLerp(Framebuffer::PixelFormat format) const;
+
+	/*!
+	Composite layers with alpha, opacity, negative positions and hidden layers with \sa LayerStack, present them and change them.
+	The composition and the framebuffer must match the reference after every change.
+	\return Returns false if any pixel differs.
+	*/
+	bool checkLayers() const;
+
+	/*!
+	Measure how long a drawing operation takes. It is repeated for a fixed time, which averages out short interruptions.
+	\return Returns the throughput in MPixels/s for an operation that draws \sa m_width * \sa m_height pixels.
+	*/
+	template <typename OPERATION>
+	double measure(OPERATION operation) const;
+
+	/*!
+	Store a result and print it with its baseline.
+	\param[in] name Name of the result in the baseline file.
+	\param[in] value Measured value.
+	\param[in] higherIsBetter Pass true for throughput and false for memory use.
+	\param[in] tolerance How much worse than the baseline the result may be, e.g. 0.2 for 20%.
+	*/
+	void addResult(const std::string & name, double value, bool higherIsBetter, float tolerance);
+
+	/*!
+	Read the baseline file to \sa m_baseline.
+	\return Returns false if the file does not exist.
+	*/
+	bool readBaseline();
+
+	/*!
+	Write \sa m_results to the baseline file.
+	*/
+	bool writeBaseline() const;
+
+	/*!
+	Fill buffer with pseudo-random Bytes. The generator is seeded, so the data is the same on every run.
+	*/
+	static void fillPattern(std::vector<uint8_t> & data, uint32_t seed);
+
+	std::string m_baselineFile;
+	bool m_record; //!<True if the results are written to the baseline file instead of being compared to it.
+	float m_tolerance;
+	uint32_t m_width;
+	uint32_t m_height;
+	bool m_hasBaseline; //!<True if the baseline file could be read.
+	std::map<std::string, double> m_baseline;
+	std::vector<std::pair<std::string, double>> m_results; //!<Results in the order they were measured.
+	uint32_t m_regressions; //!<Number of results worse than the baseline.
+};
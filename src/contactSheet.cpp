@@ -0,0 +1,145 @@
+#include "contactSheet.h"
+#include "imageIO.h"
+#include "mappedFile.h"
+#include "terminalInput.h"
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <sys/stat.h>
+
+
+ContactSheet::ContactSheet(Framebuffer & framebuffer, const std::string & directory, const std::string & cacheDirectory, uint32_t cellSize, uint32_t threadCount)
+	: m_framebuffer(framebuffer)
+	, m_directory(directory)
+	, m_cellSize(cellSize > 0 ? cellSize : std::max(32u, std::min(framebuffer.getWidth(), framebuffer.getHeight()) / 4))
+	, m_threadPool(threadCount)
+{
+	//leave a gap between thumbnails, so images with black borders can be told apart
+	m_cellSize = std::min(m_cellSize, std::min(framebuffer.getWidth(), framebuffer.getHeight()));
+	const uint32_t gap = std::max(2u, m_cellSize / 16);
+	m_thumbnail.width = m_cellSize > gap ? m_cellSize - gap : m_cellSize;
+	m_thumbnail.height = m_thumbnail.width;
+	m_thumbnail.format = framebuffer.getFormat();
+	m_thumbnail.lineLength = m_thumbnail.width * framebuffer.getFormatInfo().bytesPerPixel;
+	m_columns = framebuffer.getWidth() / m_cellSize;
+	m_rows = framebuffer.getHeight() / m_cellSize;
+	m_originX = (framebuffer.getWidth() - m_columns * m_cellSize + gap) / 2;
+	m_originY = (framebuffer.getHeight() - m_rows * m_cellSize + gap) / 2;
+	//thumbnails for other displays are kept in their own subdirectories, so switching displays does not throw away the cache
+	if (!cacheDirectory.empty()) {
+		m_cacheDirectory = cacheDirectory + "/" + Prerenderer::targetToString(m_thumbnail);
+		mkdir(cacheDirectory.c_str(), 0755);
+		if (mkdir(m_cacheDirectory.c_str(), 0755) != 0 && errno != EEXIST) {
+			std::cout << "Failed to create thumbnail cache " << m_cacheDirectory << ". Thumbnails will not be cached." << std::endl;
+			m_cacheDirectory.clear();
+		}
+	}
+}
+
+bool ContactSheet::showThumbnail(size_t index, uint32_t cell, ImageBuffer & frame, bool & cached)
+{
+	const std::string inputFile = m_directory + "/" + m_files[index];
+	const std::string frameFile = m_cacheDirectory.empty() ? std::string() : m_cacheDirectory + "/" + m_files[index] + ".raw";
+	const uint32_t x = m_originX + (cell % m_columns) * m_cellSize;
+	const uint32_t y = m_originY + (cell / m_columns) * m_cellSize;
+	//cached thumbnails are already in the framebuffer format and are copied from the mapped file
+	cached = !frameFile.empty() && Prerenderer::isUpToDate(inputFile, frameFile, m_thumbnail);
+	if (cached) {
+		const MappedFile file(frameFile);
+		if (file.isValid() && file.getSize() == (size_t)m_thumbnail.height * m_thumbnail.lineLength) {
+			std::lock_guard<std::mutex> lock(m_drawMutex);
+			m_framebuffer.blit(x, y, file.getData(), m_thumbnail.width, m_thumbnail.height, m_thumbnail.format, m_thumbnail.lineLength);
+			return true;
+		}
+		cached = false;
+	}
+	//decoders only decode at the scale needed for the thumbnail
+	if (!Prerenderer::renderFrame(inputFile, m_thumbnail, frame)) {
+		return false;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_drawMutex);
+		m_framebuffer.blit(x, y, frame.data(), m_thumbnail.width, m_thumbnail.height, m_thumbnail.format, m_thumbnail.lineLength);
+	}
+	if (!frameFile.empty()) {
+		Prerenderer::writeFrame(frameFile, frame);
+	}
+	return true;
+}
+
+void ContactSheet::showPage(uint32_t page)
+{
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point start = Clock::now();
+	const uint32_t cellCount = m_columns * m_rows;
+	const size_t first = (size_t)page * cellCount;
+	const size_t count = std::min((size_t)cellCount, m_files.size() - first);
+	const uint32_t black = 0;
+	uint8_t clearColor[4];
+	m_framebuffer.convertColor(clearColor, black);
+	m_framebuffer.clear(clearColor);
+	//hand out single files, they take very different times to decode
+	std::atomic<uint32_t> cached(0);
+	std::atomic<uint32_t> failed(0);
+	m_threadPool.parallelFor(count, [&](size_t begin, size_t end) {
+		ImageBuffer frame;
+		for (size_t cell = begin; cell < end; ++cell) {
+			bool fromCache = false;
+			if (!showThumbnail(first + cell, cell, frame, fromCache)) {
+				failed++;
+			}
+			else if (fromCache) {
+				cached++;
+			}
+		}
+	}, 1);
+	const uint32_t pageCount = (m_files.size() + cellCount - 1) / cellCount;
+	std::cout << "Page " << page + 1 << "/" << pageCount << ": " << m_files[first] << " - " << m_files[first + count - 1] << ", " << cached << " of " << count << " from cache";
+	if (failed > 0) {
+		std::cout << ", " << failed << " failed";
+	}
+	std::cout << ", " << std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count() << "ms." << std::endl;
+}
+
+bool ContactSheet::run()
+{
+	if (!ImageIO::listImageFiles(m_directory, m_files)) {
+		return false;
+	}
+	if (m_files.empty()) {
+		std::cout << "No images found in " << m_directory << "!" << std::endl;
+		return false;
+	}
+	const uint32_t cellCount = m_columns * m_rows;
+	const uint32_t pageCount = (m_files.size() + cellCount - 1) / cellCount;
+	std::cout << "Displaying " << m_files.size() << " images as " << m_columns << "x" << m_rows << " thumbnails of " << m_thumbnail.width << "x" << m_thumbnail.height << " on " << pageCount << " pages." << std::endl;
+	TerminalInput terminal;
+	uint32_t page = 0;
+	showPage(page);
+	bool quit = false;
+	std::vector<int32_t> keys;
+	while (!quit) {
+		//keys pressed while a page was drawn are read at once, so fast paging skips pages instead of drawing all of them
+		if (!TerminalInput::readKeys(keys)) {
+			//stdin closed
+			break;
+		}
+		int32_t step = 0;
+		for (size_t i = 0; i < keys.size() && !quit; ++i) {
+			switch (keys[i]) {
+				case TerminalInput::KEY_UP: case TerminalInput::KEY_LEFT: case TerminalInput::KEY_PAGE_UP: step--; break;
+				case TerminalInput::KEY_DOWN: case TerminalInput::KEY_RIGHT: case TerminalInput::KEY_PAGE_DOWN: case ' ': step++; break;
+				case 'q': case 'Q': case '\e': quit = true; break;
+			}
+		}
+		const uint32_t newPage = (uint32_t)std::max(0, std::min((int32_t)pageCount - 1, (int32_t)page + step));
+		if (!quit && newPage != page) {
+			page = newPage;
+			showPage(page);
+		}
+	}
+	return true;
+}
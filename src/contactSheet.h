@@ -0,0 +1,66 @@
+#pragma once
+
+#include "framebuffer.h"
+#include "prerender.h"
+#include "threadPool.h"
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+
+/*!
+Displays all images in a directory as a grid of thumbnails, page by page.
+Thumbnails of a page are decoded in parallel at reduced scale and each one is drawn as soon as it is ready.
+They are cached as raw frames in the framebuffer format, so opening the grid again only copies files to the screen.
+Use the cursor keys, space or page up/down to change pages and q or ESC to quit.
+*/
+class ContactSheet
+{
+public:
+	/*!
+	Construct contact sheet.
+	\param[in] framebuffer Framebuffer to display the grid on.
+	\param[in] directory Directory of images to display.
+	\param[in] cacheDirectory Directory to store thumbnails in. Created if it does not exist. Thumbnails for different cell sizes and pixel formats are kept apart.
+	Pass an empty string to not cache thumbnails.
+	\param[in] cellSize Optional. Size of a grid cell in pixels. Pass 0 to fit 4 rows or columns to the screen, whatever is smaller.
+	\param[in] threadCount Optional. Number of images to decode at the same time. Pass 0 to use one thread per CPU core.
+	*/
+	ContactSheet(Framebuffer & framebuffer, const std::string & directory, const std::string & cacheDirectory, uint32_t cellSize = 0, uint32_t threadCount = 0);
+
+	/*!
+	Display the first page, then read keys from stdin and change pages until the user quits.
+	\return Returns false if the directory could not be read or contains no images.
+	*/
+	bool run();
+
+private:
+	/*!
+	Clear the screen and draw all thumbnails of a page.
+	*/
+	void showPage(uint32_t page);
+
+	/*!
+	Get thumbnail from the cache or render and cache it, then draw it into its cell.
+	\param[in] index Index of file in \sa m_files.
+	\param[in] cell Position of cell on the page.
+	\param[in] frame Buffer to render the thumbnail to. Reused for all thumbnails of a thread.
+	\param[out] cached Upon return is true if the thumbnail was read from the cache.
+	\return Returns false if the image could not be loaded.
+	*/
+	bool showThumbnail(size_t index, uint32_t cell, ImageBuffer & frame, bool & cached);
+
+	Framebuffer & m_framebuffer;
+	std::string m_directory;
+	std::string m_cacheDirectory; //!<Subdirectory of the cache for \sa m_thumbnail. Empty if thumbnails are not cached.
+	Prerenderer::Target m_thumbnail; //!<Thumbnails are prerendered frames of this size.
+	uint32_t m_cellSize; //!<Distance between thumbnails in pixels.
+	uint32_t m_columns;
+	uint32_t m_rows;
+	uint32_t m_originX; //!<Position of the top-left cell. The grid is centered on the screen.
+	uint32_t m_originY;
+	std::vector<std::string> m_files;
+	ThreadPool m_threadPool;
+	std::mutex m_drawMutex; //!<Thumbnails are drawn by the thread that rendered them, but one at a time.
+};
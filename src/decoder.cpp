@@ -0,0 +1,106 @@
+#include "decoder.h"
+
+#include "freeImageDecoder.h"
+#ifdef HAVE_LIBJPEG
+	#include "jpegDecoder.h"
+#endif
+#ifdef HAVE_LIBPNG
+	#include "pngDecoder.h"
+#endif
+
+#include <vector>
+#include <algorithm>
+
+
+Decoder::~Decoder()
+{
+}
+
+uint32_t Decoder::getMaxScaleDenominator() const
+{
+	return 1;
+}
+
+ImageBuffer Decoder::decodePreview(const MappedFile &, uint32_t, uint32_t, uint32_t &, uint32_t &) const
+{
+	return ImageBuffer();
+}
+
+uint32_t Decoder::scaledSize(uint32_t size, uint32_t scaleDenominator)
+{
+	//round up like libjpeg does, so partial blocks at the edge still get a pixel
+	return (size + scaleDenominator - 1) / scaleDenominator;
+}
+
+static std::vector<const Decoder *> createDecoders()
+{
+	std::vector<const Decoder *> decoders;
+#ifdef HAVE_LIBJPEG
+	static const JpegDecoder jpegDecoder;
+	decoders.push_back(&jpegDecoder);
+#endif
+#ifdef HAVE_LIBPNG
+	static const PngDecoder pngDecoder;
+	decoders.push_back(&pngDecoder);
+#endif
+	//FreeImage reads everything, so it comes last
+	static const FreeImageDecoder freeImageDecoder;
+	decoders.push_back(&freeImageDecoder);
+	return decoders;
+}
+
+const Decoder * Decoder::find(const MappedFile & file, const Decoder * previous)
+{
+	static const std::vector<const Decoder *> decoders = createDecoders();
+	auto decoder = decoders.cbegin();
+	if (previous != nullptr)
+	{
+		decoder = std::find(decoders.cbegin(), decoders.cend(), previous);
+		if (decoder == decoders.cend())
+		{
+			return nullptr;
+		}
+		++decoder;
+	}
+	for (; decoder != decoders.cend(); ++decoder)
+	{
+		if ((*decoder)->canDecode(file))
+		{
+			return *decoder;
+		}
+	}
+	return nullptr;
+}
+
+ImageIO::Orientation Decoder::readExifOrientation(const uint8_t * data, size_t size)
+{
+	//TIFF header: byte order "II" or "MM", 42, offset of first IFD
+	if (size < 8 || !((data[0] == 'I' && data[1] == 'I') || (data[0] == 'M' && data[1] == 'M')))
+	{
+		return ImageIO::orientationFromExif(1);
+	}
+	const bool bigEndian = data[0] == 'M';
+	auto read16 = [data, bigEndian](size_t offset) -> uint32_t {
+		return bigEndian ? (data[offset] << 8) | data[offset + 1] : data[offset] | (data[offset + 1] << 8);
+	};
+	auto read32 = [read16, bigEndian](size_t offset) -> uint32_t {
+		return bigEndian ? (read16(offset) << 16) | read16(offset + 2) : read16(offset) | (read16(offset + 2) << 16);
+	};
+	const size_t ifd = read32(4);
+	if (read16(2) != 42 || ifd > size - 2)
+	{
+		return ImageIO::orientationFromExif(1);
+	}
+	//IFD entries are 12 Bytes: tag, type, count, value
+	const size_t entries = read16(ifd);
+	for (size_t i = 0; i < entries && ifd + 2 + (i + 1) * 12 <= size; ++i)
+	{
+		const size_t entry = ifd + 2 + i * 12;
+		//orientation, SHORT
+		if (read16(entry) == 0x0112 && read16(entry + 2) == 3)
+		{
+			return ImageIO::orientationFromExif(read16(entry + 8));
+		}
+	}
+	return ImageIO::orientationFromExif(1);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <inttypes.h>
+#include <cstddef>
+
+#include "mappedFile.h"
+#include "imageIO.h"
+
+
+/*!
+Interface of an image decoder backend. Decoders write X8R8G8B8 pixels with straight alpha top-down into a buffer the caller owns,
+so there are no intermediate bitmaps, conversions or flips. Use \sa find() to get a decoder for a file.
+Decoders are stateless and can be used from multiple threads at once.
+*/
+class Decoder
+{
+public:
+	/*! Image properties that can be read without decoding the pixels. */
+	struct Info
+	{
+		uint32_t width; //!<Width of image as stored.
+		uint32_t height; //!<Height of image as stored.
+		ImageIO::Orientation orientation; //!<How the image has to be rotated to be displayed upright.
+	};
+
+	virtual ~Decoder();
+
+	/*!
+	Get name of decoder for messages.
+	*/
+	virtual const char * getName() const = 0;
+
+	/*!
+	Check if the decoder can read a file by looking at its signature.
+	*/
+	virtual bool canDecode(const MappedFile & file) const = 0;
+
+	/*!
+	Read dimensions and orientation of an image without decoding it.
+	\param[in] file File to read.
+	\param[out] info Image properties.
+	\return Returns false if the file is broken or uses a feature the decoder does not support.
+	*/
+	virtual bool readInfo(const MappedFile & file, Info & info) const = 0;
+
+	/*!
+	Get the biggest factor the decoder can shrink images by while decoding. Scale denominators are powers of two up to this.
+	*/
+	virtual uint32_t getMaxScaleDenominator() const;
+
+	/*!
+	Decode an image to X8R8G8B8 with straight alpha. Images without alpha channel are opaque.
+	\param[in] file File to decode.
+	\param[out] dest Destination buffer. Must hold all scanlines of the scaled image, \sa destLineLength Bytes apart.
+	\param[in] destLineLength Length of a destination scanline in Bytes.
+	\param[in] scaleDenominator Decode the image at 1/scaleDenominator of its size. Must be a power of two <= \sa getMaxScaleDenominator().
+	The scaled image is \sa scaledSize(width, scaleDenominator) x \sa scaledSize(height, scaleDenominator) pixels.
+	\return Returns false if the image could not be decoded. The destination may then be partially written.
+	\note The image is not oriented. Use \sa Info::orientation to display it upright.
+	*/
+	virtual bool decode(const MappedFile & file, uint8_t * dest, uint32_t destLineLength, uint32_t scaleDenominator = 1) const = 0;
+
+	/*!
+	Decode a coarse version of an image much faster than the image itself, e.g. an embedded preview or a JPEG at 1/8 scale.
+	\param[in] file File to decode.
+	\param[in] minWidth Minimum width of the preview. Pass 0 to accept any size.
+	\param[in] minHeight Minimum height of the preview. Pass 0 to accept any size.
+	\param[out] width Upon return contains the width of the preview.
+	\param[out] height Upon return contains the height of the preview.
+	\return Returns the X8R8G8B8 preview, which shows the whole image, or an empty buffer if there is no preview that is big enough.
+	The default implementation has no preview.
+	\note The preview is not oriented, like \sa decode().
+	*/
+	virtual ImageBuffer decodePreview(const MappedFile & file, uint32_t minWidth, uint32_t minHeight, uint32_t & width, uint32_t & height) const;
+
+	/*!
+	Get the size of an image dimension when decoded at 1/scaleDenominator scale.
+	*/
+	static uint32_t scaledSize(uint32_t size, uint32_t scaleDenominator);
+
+	/*!
+	Find a decoder for a file. Direct decoders for JPEG and PNG are tried first, then FreeImage.
+	\param[in] file File to find a decoder for.
+	\param[in] previous Optional. Pass the decoder that failed to get the next one that recognizes the file, e.g. FreeImage for CMYK JPEGs.
+	\return Returns a decoder or nullptr if no (other) decoder recognizes the file.
+	*/
+	static const Decoder * find(const MappedFile & file, const Decoder * previous = nullptr);
+
+protected:
+	/*!
+	Read the orientation from EXIF data.
+	\param[in] data EXIF data starting at the TIFF header, e.g. from the "Exif\0\0" APP1 marker of a JPEG or the eXIf chunk of a PNG.
+	\param[in] size Size of EXIF data.
+	\return Returns the orientation or no rotation if the data has no valid orientation tag.
+	*/
+	static ImageIO::Orientation readExifOrientation(const uint8_t * data, size_t size);
+};
@@ -0,0 +1,155 @@
+#include "displayGroup.h"
+#include "imageIO.h"
+
+#include <iostream>
+#include <algorithm>
+
+
+DisplayGroup::DisplayGroup(const std::vector<std::string> & devices)
+	: m_orientation(Framebuffer::ROTATE_0)
+	, m_mirror(false)
+	, m_wall(false)
+	, m_wallWidth(0)
+	, m_wallHeight(0)
+	, m_threadPool(devices.size())
+{
+	for (auto deviceIt = devices.cbegin(); deviceIt != devices.cend(); ++deviceIt) {
+		Display display = {std::make_shared<Framebuffer>(*deviceIt), 0, 0};
+		m_displays.push_back(display);
+	}
+}
+
+bool DisplayGroup::isAvailable() const
+{
+	for (auto displayIt = m_displays.cbegin(); displayIt != m_displays.cend(); ++displayIt) {
+		if (!displayIt->framebuffer->isAvailable()) {
+			return false;
+		}
+	}
+	return !m_displays.empty();
+}
+
+void DisplayGroup::setOrientation(Framebuffer::Orientation orientation, bool mirror)
+{
+	m_orientation = orientation;
+	m_mirror = mirror;
+	for (auto displayIt = m_displays.begin(); displayIt != m_displays.end(); ++displayIt) {
+		displayIt->framebuffer->setOrientation(orientation, mirror);
+	}
+}
+
+void DisplayGroup::setDithering(bool enabled)
+{
+	for (auto displayIt = m_displays.begin(); displayIt != m_displays.end(); ++displayIt) {
+		displayIt->framebuffer->setDithering(enabled);
+	}
+}
+
+bool DisplayGroup::setWall(uint32_t columns, uint32_t rows)
+{
+	if (columns * rows != m_displays.size()) {
+		std::cout << "A " << columns << "x" << rows << " wall needs " << columns * rows << " framebuffers, but " << m_displays.size() << " were given!" << std::endl;
+		return false;
+	}
+	m_wallWidth = 0;
+	m_wallHeight = 0;
+	for (uint32_t row = 0; row < rows; ++row) {
+		uint32_t x = 0;
+		uint32_t rowHeight = 0;
+		for (uint32_t column = 0; column < columns; ++column) {
+			Display & display = m_displays[row * columns + column];
+			display.x = x;
+			display.y = m_wallHeight;
+			x += display.framebuffer->getWidth();
+			rowHeight = std::max(rowHeight, display.framebuffer->getHeight());
+		}
+		m_wallWidth = std::max(m_wallWidth, x);
+		m_wallHeight += rowHeight;
+	}
+	m_wall = true;
+	return true;
+}
+
+void DisplayGroup::getImageSize(uint32_t & width, uint32_t & height) const
+{
+	if (m_wall) {
+		width = m_wallWidth;
+		height = m_wallHeight;
+		return;
+	}
+	width = 0;
+	height = 0;
+	for (auto displayIt = m_displays.cbegin(); displayIt != m_displays.cend(); ++displayIt) {
+		width = std::max(width, displayIt->framebuffer->getWidth());
+		height = std::max(height, displayIt->framebuffer->getHeight());
+	}
+}
+
+void DisplayGroup::clear(Framebuffer & framebuffer)
+{
+	uint8_t clearColor[4];
+	framebuffer.convertColor(clearColor, 0);
+	framebuffer.clear(clearColor);
+}
+
+void DisplayGroup::showFitted(Framebuffer & framebuffer, const ImageBuffer & data, uint32_t width, uint32_t height)
+{
+	uint32_t fittedWidth = framebuffer.getWidth();
+	uint32_t fittedHeight = framebuffer.getHeight();
+	const ImageBuffer fitted = ImageIO::resize_RGBA32(data, width, height, fittedWidth, fittedHeight);
+	clear(framebuffer);
+	if (!fitted.empty()) {
+		const uint32_t x = fittedWidth < framebuffer.getWidth() ? (framebuffer.getWidth() - fittedWidth) / 2 : 0;
+		const uint32_t y = fittedHeight < framebuffer.getHeight() ? (framebuffer.getHeight() - fittedHeight) / 2 : 0;
+		framebuffer.blit(x, y, fitted.data(), fittedWidth, fittedHeight, Framebuffer::X8R8G8B8);
+	}
+}
+
+void DisplayGroup::showTile(const Display & display, const ImageBuffer & data, uint32_t width, uint32_t height) const
+{
+	Framebuffer & framebuffer = *display.framebuffer;
+	clear(framebuffer);
+	//intersect image centered on wall with framebuffer area
+	const int64_t imageX = ((int64_t)m_wallWidth - width) / 2;
+	const int64_t imageY = ((int64_t)m_wallHeight - height) / 2;
+	const int64_t left = std::max(imageX, (int64_t)display.x);
+	const int64_t top = std::max(imageY, (int64_t)display.y);
+	const int64_t right = std::min(imageX + width, (int64_t)display.x + framebuffer.getWidth());
+	const int64_t bottom = std::min(imageY + height, (int64_t)display.y + framebuffer.getHeight());
+	if (left >= right || top >= bottom) {
+		return;
+	}
+	//blit sub-rectangle of image directly from the image data
+	const uint8_t * source = data.data() + ((top - imageY) * width + (left - imageX)) * 4;
+	framebuffer.blit(left - display.x, top - display.y, source, right - left, bottom - top, Framebuffer::X8R8G8B8, width * 4);
+}
+
+void DisplayGroup::show(const ImageBuffer & data, uint32_t width, uint32_t height, const ImageIO::Orientation & orientation)
+{
+	//palettized framebuffers share one palette made for the image, so a wall looks the same everywhere
+	bool palettized = false;
+	for (auto displayIt = m_displays.cbegin(); displayIt != m_displays.cend(); ++displayIt) {
+		palettized = palettized || displayIt->framebuffer->getFormat() == Framebuffer::PALETTE8;
+	}
+	if (palettized) {
+		const Palette palette = Palette::fromImage(data.data(), width, height, 0, Palette::MAX_COLORS, &m_threadPool);
+		for (auto displayIt = m_displays.begin(); displayIt != m_displays.end(); ++displayIt) {
+			displayIt->framebuffer->setPalette(palette);
+		}
+	}
+	//every framebuffer gets its own thread for scaling and conversion
+	m_threadPool.parallelFor(m_displays.size(), [&](size_t begin, size_t end) {
+		for (size_t index = begin; index < end; ++index) {
+			if (m_wall) {
+				showTile(m_displays[index], data, width, height);
+			}
+			else {
+				//rotate image upright while blitting
+				Framebuffer & framebuffer = *m_displays[index].framebuffer;
+				framebuffer.setOrientation(m_orientation, m_mirror);
+				framebuffer.addOrientation(orientation.rotation, orientation.mirror);
+				showFitted(framebuffer, data, width, height);
+			}
+		}
+	}, 1);
+}
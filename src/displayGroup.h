@@ -0,0 +1,95 @@
+#pragma once
+
+#include "framebuffer.h"
+#include "threadPool.h"
+#include "imageIO.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+
+
+/*!
+Displays one decoded image on multiple framebuffers that may have different resolutions and pixel formats.
+Either every framebuffer shows the whole image or the framebuffers form a video wall and every one shows its part of the image.
+Scaling and conversion for the framebuffers run in parallel.
+*/
+class DisplayGroup
+{
+public:
+	/*!
+	Open framebuffers.
+	\param[in] devices Framebuffer devices, e.g. /dev/fb0.
+	*/
+	DisplayGroup(const std::vector<std::string> & devices);
+
+	/*!
+	Check if all framebuffers could be opened.
+	*/
+	bool isAvailable() const;
+
+	/*!
+	Set orientation of all framebuffers. See \sa Framebuffer::setOrientation. Call before \sa setWall.
+	*/
+	void setOrientation(Framebuffer::Orientation orientation, bool mirror);
+
+	/*!
+	Enable or disable dithering on palettized framebuffers. See \sa Framebuffer::setDithering.
+	*/
+	void setDithering(bool enabled);
+
+	/*!
+	Arrange framebuffers as a wall. They are placed row by row in the order they were passed to the constructor.
+	Framebuffers in a row are placed next to each other, the height of a row is the height of its highest framebuffer.
+	\param[in] columns Number of framebuffers per row.
+	\param[in] rows Number of rows.
+	\return Returns false if columns * rows is not the number of framebuffers.
+	*/
+	bool setWall(uint32_t columns, uint32_t rows);
+
+	/*!
+	Get the size images should be decoded to. This is the size of the wall or the biggest width and height of all framebuffers.
+	*/
+	void getImageSize(uint32_t & width, uint32_t & height) const;
+
+	/*!
+	Display 32bit image centered on all framebuffers or the wall.
+	\param[in] data Image data in X8R8G8B8 format.
+	\param[in] width Width of image.
+	\param[in] height Height of image.
+	\param[in] orientation Rotation of the image. Not supported for walls, pass upright images there.
+	\note When not using a wall images are resized to fit each framebuffer, so pass an image of \sa getImageSize to avoid upscaling.
+	*/
+	void show(const ImageBuffer & data, uint32_t width, uint32_t height, const ImageIO::Orientation & orientation);
+
+private:
+	struct Display
+	{
+		std::shared_ptr<Framebuffer> framebuffer;
+		uint32_t x; //!<Horizontal position on wall.
+		uint32_t y; //!<Vertical position on wall.
+	};
+
+	/*!
+	Clear framebuffer to black.
+	*/
+	static void clear(Framebuffer & framebuffer);
+
+	/*!
+	Fit image to framebuffer and display it centered.
+	*/
+	static void showFitted(Framebuffer & framebuffer, const ImageBuffer & data, uint32_t width, uint32_t height);
+
+	/*!
+	Display the part of the image centered on the wall that is covered by the framebuffer.
+	*/
+	void showTile(const Display & display, const ImageBuffer & data, uint32_t width, uint32_t height) const;
+
+	std::vector<Display> m_displays;
+	Framebuffer::Orientation m_orientation; //!<Orientation of all framebuffers before rotating the image.
+	bool m_mirror;
+	bool m_wall;
+	uint32_t m_wallWidth;
+	uint32_t m_wallHeight;
+	ThreadPool m_threadPool;
+};
@@ -0,0 +1,150 @@
+#include "folderWatcher.h"
+#include "imageIO.h"
+#include "terminalInput.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+
+FolderWatcher::FolderWatcher(const std::string & directory, uint32_t debounce)
+	: m_directory(directory)
+	, m_debounce(debounce)
+	, m_inotify(-1)
+	, m_watchInput(true)
+{
+	m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_inotify < 0) {
+		std::cout << "Failed to initialize inotify!" << std::endl;
+		return;
+	}
+	//files that are written in place are reported when closed, files that are renamed into the directory when moved. both are complete then
+	if (inotify_add_watch(m_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0) {
+		std::cout << "Failed to watch " << directory << "!" << std::endl;
+		close(m_inotify);
+		m_inotify = -1;
+	}
+}
+
+FolderWatcher::~FolderWatcher()
+{
+	if (m_inotify >= 0) {
+		close(m_inotify);
+	}
+}
+
+bool FolderWatcher::isValid() const
+{
+	return m_inotify >= 0;
+}
+
+bool FolderWatcher::readEvents(std::string & fileName, Clock::time_point & arrival, uint32_t & count)
+{
+	//events are variable-sized, but a name is at most NAME_MAX long
+	alignas(struct inotify_event) char buffer[64 * (sizeof(struct inotify_event) + 256)];
+	for (;;) {
+		const ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+		if (length < 0) {
+			//EAGAIN means there are no more events
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		const Clock::time_point now = Clock::now();
+		for (ssize_t offset = 0; offset < length; ) {
+			const struct inotify_event * event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+			offset += sizeof(struct inotify_event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW) {
+				//events have been lost, maybe including the newest file. look at the directory itself
+				std::string newest;
+				if (findNewestFile(newest)) {
+					fileName = newest;
+					arrival = now;
+					count++;
+				}
+			}
+			else if (event->len > 0 && (event->mask & IN_ISDIR) == 0 && ImageIO::isImageFile(event->name)) {
+				//events are in order, so the last one is the newest file
+				fileName = m_directory + "/" + event->name;
+				arrival = now;
+				count++;
+			}
+		}
+	}
+}
+
+bool FolderWatcher::findNewestFile(std::string & fileName) const
+{
+	std::vector<std::string> fileNames;
+	if (!ImageIO::listImageFiles(m_directory, fileNames)) {
+		return false;
+	}
+	struct timespec newestTime = {0, 0};
+	bool found = false;
+	for (const auto & name : fileNames) {
+		//timestamps are coarse. of files written at the same tick the last one by name wins, which is the newest for numbered files
+		struct stat info;
+		const std::string path = m_directory + "/" + name;
+		if (stat(path.c_str(), &info) == 0 && (!found || info.st_mtim.tv_sec > newestTime.tv_sec || (info.st_mtim.tv_sec == newestTime.tv_sec && info.st_mtim.tv_nsec >= newestTime.tv_nsec))) {
+			newestTime = info.st_mtim;
+			fileName = path;
+			found = true;
+		}
+	}
+	return found;
+}
+
+FolderWatcher::Result FolderWatcher::wait(std::string & fileName, Clock::time_point & arrival, uint32_t & dropped, int32_t timeout)
+{
+	if (!isValid()) {
+		return FAILED;
+	}
+	const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(std::max(timeout, 0));
+	Clock::time_point burstEnd;
+	uint32_t count = 0;
+	for (;;) {
+		//sleep until a file arrives or the user presses <ENTER>. after a file arrived, wait until the burst is over
+		int32_t wait = -1;
+		if (count > 0) {
+			//a burst ends a fixed time after its first file, so files arriving faster than that are still displayed
+			wait = (int32_t)std::chrono::duration_cast<std::chrono::milliseconds>(burstEnd - Clock::now()).count();
+			if (wait <= 0) {
+				dropped = count - 1;
+				return FILE_ARRIVED;
+			}
+		}
+		else if (timeout >= 0) {
+			wait = std::max((int32_t)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count(), 0);
+		}
+		const TerminalInput::Result result = TerminalInput::wait(wait, m_inotify, m_watchInput);
+		if (result == TerminalInput::FAILED) {
+			return FAILED;
+		}
+		if (result == TerminalInput::TIMEOUT) {
+			if (count == 0) {
+				return TIMEOUT;
+			}
+			//no more files for a while. the newest one wins
+			dropped = count - 1;
+			return FILE_ARRIVED;
+		}
+		if (result == TerminalInput::INPUT) {
+			if (TerminalInput::skipInput()) {
+				return INPUT;
+			}
+			//stdin is closed, e.g. when running as a service. keep watching until killed
+			m_watchInput = false;
+		}
+		else {
+			const bool burstStarts = (count == 0);
+			if (!readEvents(fileName, arrival, count)) {
+				return FAILED;
+			}
+			if (burstStarts && count > 0) {
+				burstEnd = Clock::now() + std::chrono::milliseconds(m_debounce);
+			}
+		}
+	}
+}
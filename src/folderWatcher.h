@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <inttypes.h>
+
+
+/*!
+Watches a directory for image files that have been completely written or moved into it, using inotify.
+Bursts of files are collected and only the newest one is reported, so a display always shows the latest content.
+*/
+class FolderWatcher
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	enum Result { FILE_ARRIVED, INPUT, TIMEOUT, FAILED };
+
+	/*!
+	Start watching a directory.
+	\param[in] directory Directory to watch.
+	\param[in] debounce Optional. Time in milliseconds to wait for more files after the first file of a burst arrived.
+	*/
+	FolderWatcher(const std::string & directory, uint32_t debounce = 50);
+
+	FolderWatcher(const FolderWatcher &) = delete;
+	FolderWatcher & operator=(const FolderWatcher &) = delete;
+
+	~FolderWatcher();
+
+	/*!
+	Check if the directory is being watched.
+	*/
+	bool isValid() const;
+
+	/*!
+	Wait until an image file arrives or <ENTER> is pressed. If stdin is closed, only files are waited for.
+	\param[out] fileName Upon return contains the path of the newest file that arrived.
+	\param[out] arrival Upon return contains the time the newest file was reported by the kernel.
+	\param[out] dropped Upon return contains the number of older files that arrived in the same burst and were skipped.
+	\param[in] timeout Optional. Maximum time to wait for a file in milliseconds, e.g. to update a clock. Pass -1 to wait forever.
+	\return Returns FILE_ARRIVED if there is a new file, INPUT if the user pressed <ENTER>, TIMEOUT if no file arrived in time or FAILED if reading events failed.
+	*/
+	Result wait(std::string & fileName, Clock::time_point & arrival, uint32_t & dropped, int32_t timeout = -1);
+
+private:
+	/*!
+	Read all pending events and remember the newest image file.
+	\return Returns false if reading events failed.
+	*/
+	bool readEvents(std::string & fileName, Clock::time_point & arrival, uint32_t & count);
+
+	/*!
+	Find the image file in the directory that was modified last. Used when the kernel dropped events because the queue overflowed.
+	\param[out] fileName Upon return contains the path of the newest image file.
+	\return Returns false if the directory could not be read or contains no image files.
+	*/
+	bool findNewestFile(std::string & fileName) const;
+
+	std::string m_directory;
+	uint32_t m_debounce; //!<Time in milliseconds to wait for more files after the first file of a burst arrived.
+	int m_inotify; //!<inotify instance or -1.
+	bool m_watchInput; //!<False if stdin has been closed, so <ENTER> can not be pressed.
+};
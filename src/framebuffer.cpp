@@ -1,7 +1,13 @@
 #include "framebuffer.h"
+#include "pixelOps.h"
 
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <sstream>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
@@ -12,20 +18,38 @@ const Framebuffer::PixelFormatInfo Framebuffer::pixelFormatInfo[] = {
 	{BAD_PIXELFORMAT, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, "bad pixel format"},
 	{R8G8B8X8, 32, 4, 8, 8, 8, 8, 24, 16,  8,  0, "R8G8B8X8"},
 	{X8R8G8B8, 32, 4, 8, 8, 8, 8, 16,  8,  0, 24, "X8R8G8B8"},
-	{  R8G8B8, 24, 3, 8, 8, 8, 0, 24, 16,  8,  0, "R8G8B8"},
+	{  R8G8B8, 24, 3, 8, 8, 8, 0, 16,  8,  0,  0, "R8G8B8"},
 	{X1R5G5B5, 16, 2, 5, 5, 5, 1, 10,  5,  0, 15, "X1R5G5B5"},
 	{  R5G6B5, 16, 2, 5, 6, 5, 0, 11,  5,  0,  0, "R5G6B5"},
 	{   GREY8,  8, 1, 8, 0, 0, 0,  0,  0,  0,  0, "GREY8"},
+	{A8R8G8B8, 32, 4, 8, 8, 8, 8, 16,  8,  0, 24, "A8R8G8B8"},
+	{PALETTE8,  8, 1, 3, 3, 2, 0,  5,  2,  0,  0, "PALETTE8"},
+	{  B8G8R8, 24, 3, 8, 8, 8, 0,  0,  8, 16,  0, "B8G8R8"},
+	{X8B8G8R8, 32, 4, 8, 8, 8, 8,  0,  8, 16, 24, "X8B8G8R8"},
+	{B8G8R8X8, 32, 4, 8, 8, 8, 8,  8, 16, 24,  0, "B8G8R8X8"},
+	{  B5G6R5, 16, 2, 5, 6, 5, 0,  0,  5, 11,  0, "B5G6R5"},
+	{X1B5G5R5, 16, 2, 5, 5, 5, 1,  0,  5, 10, 15, "X1B5G5R5"},
 };
 
-Framebuffer::Framebuffer(const std::string & device)
+const size_t Framebuffer::pixelFormatCount = sizeof(pixelFormatInfo) / sizeof(PixelFormatInfo);
+
+//formats added for the channel layouts of devices. a deque does not move its entries, so references to them stay valid
+static std::mutex deviceFormatMutex;
+static std::deque<Framebuffer::PixelFormatInfo> deviceFormatInfo;
+
+Framebuffer::Framebuffer(const std::string & device, bool keepMode)
 	: m_frameBufferDevice(0)
 	, m_frameBuffer(nullptr)
 	, m_frameBufferSize(0)
 	, m_format(BAD_PIXELFORMAT)
 	, m_formatInfo(pixelFormatInfo[0])
+	, m_pageFlipping(false)
+	, m_drawOffsetY(0)
+	, m_orientation(ROTATE_0)
+	, m_mirror(false)
+	, m_dither(true)
 {
-	create(0, 0, 0, device);
+	create(0, 0, 0, device, keepMode);
 }
 
 Framebuffer::Framebuffer(uint32_t width, uint32_t height, uint32_t bitsPerPixel, const std::string & device)
@@ -34,11 +58,56 @@ Framebuffer::Framebuffer(uint32_t width, uint32_t height, uint32_t bitsPerPixel,
 	, m_frameBufferSize(0)
 	, m_format(BAD_PIXELFORMAT)
 	, m_formatInfo(pixelFormatInfo[0])
+	, m_pageFlipping(false)
+	, m_drawOffsetY(0)
+	, m_orientation(ROTATE_0)
+	, m_mirror(false)
+	, m_dither(true)
+{
+	create(width, height, bitsPerPixel, device, false);
+}
+
+Framebuffer::Framebuffer(uint32_t width, uint32_t height, PixelFormat format, uint32_t lineLength)
+	: m_frameBufferDevice(0)
+	, m_frameBuffer(nullptr)
+	, m_frameBufferSize(0)
+	, m_format(format)
+	, m_formatInfo(getPixelFormatInfo(format))
+	, m_pageFlipping(false)
+	, m_drawOffsetY(0)
+	, m_orientation(ROTATE_0)
+	, m_mirror(false)
+	, m_dither(true)
 {
-	create(width, height, bitsPerPixel, device);
+	//set up a mode matching the format, so the virtual framebuffer looks like a real one
+	memset(&m_currentMode, 0, sizeof(fb_var_screeninfo));
+	m_currentMode.xres = width;
+	m_currentMode.yres = height;
+	m_currentMode.xres_virtual = width;
+	m_currentMode.yres_virtual = height;
+	m_currentMode.bits_per_pixel = m_formatInfo.bitsPerPixel;
+	m_currentMode.red.offset = m_formatInfo.shiftRed;
+	m_currentMode.red.length = m_formatInfo.bitsRed;
+	m_currentMode.green.offset = m_formatInfo.shiftGreen;
+	m_currentMode.green.length = m_formatInfo.bitsGreen;
+	m_currentMode.blue.offset = m_formatInfo.shiftBlue;
+	m_currentMode.blue.length = m_formatInfo.bitsBlue;
+	m_currentMode.transp.offset = m_formatInfo.shiftAlpha;
+	m_currentMode.transp.length = m_formatInfo.bitsAlpha;
+	memcpy(&m_oldMode, &m_currentMode, sizeof(fb_var_screeninfo));
+	memset(&m_fixedMode, 0, sizeof(fb_fix_screeninfo));
+	m_fixedMode.line_length = (lineLength != 0) ? lineLength : width * m_formatInfo.bytesPerPixel;
+	m_fixedMode.visual = (format == PALETTE8) ? FB_VISUAL_PSEUDOCOLOR : FB_VISUAL_TRUECOLOR;
+	//allocate pixel memory
+	if (format != BAD_PIXELFORMAT) {
+		m_frameBufferSize = height * m_fixedMode.line_length;
+		m_fixedMode.smem_len = m_frameBufferSize;
+		m_memory.resize(m_frameBufferSize);
+		m_frameBuffer = m_memory.data();
+	}
 }
 
-void Framebuffer::create(uint32_t width, uint32_t height, uint32_t bitsPerPixel, const std::string & device)
+void Framebuffer::create(uint32_t width, uint32_t height, uint32_t bitsPerPixel, const std::string & device, bool keepMode)
 {
 	std::cout << "Opening framebuffer " << device << "..." << std::endl;
 
@@ -62,19 +131,24 @@ void Framebuffer::create(uint32_t width, uint32_t height, uint32_t bitsPerPixel,
 	memcpy(&m_oldMode, &m_currentMode, sizeof(fb_var_screeninfo));
 
 	//change screen mode. check if the user passed some values
-	if (width != 0) {
-		m_currentMode.xres = width;
-	}
-	if (height != 0) {
-		m_currentMode.yres = height;
-	}
-	if (bitsPerPixel != 0) {
-		m_currentMode.bits_per_pixel = bitsPerPixel;
+	if (!keepMode) {
+		if (width != 0) {
+			m_currentMode.xres = width;
+		}
+		if (height != 0) {
+			m_currentMode.yres = height;
+		}
+		if (bitsPerPixel != 0) {
+			m_currentMode.bits_per_pixel = bitsPerPixel;
+		}
+		m_currentMode.xres_virtual = m_currentMode.xres;
+		m_currentMode.yres_virtual = m_currentMode.yres;
 	}
-	m_currentMode.xres_virtual = m_currentMode.xres;
-	m_currentMode.yres_virtual = m_currentMode.yres;
-	if (ioctl(m_frameBufferDevice, FBIOPUT_VSCREENINFO, &m_currentMode)) {
-		std::cout << "Failed to set mode to " << m_currentMode.xres << "x" << m_currentMode.yres << "@" << m_currentMode.bits_per_pixel << "!" << std::endl;
+	//only set the mode if it changes. drivers may reinitialize the display even if it is the same mode, which takes time and flickers
+	if (memcmp(&m_currentMode, &m_oldMode, sizeof(fb_var_screeninfo)) != 0) {
+		if (ioctl(m_frameBufferDevice, FBIOPUT_VSCREENINFO, &m_currentMode)) {
+			std::cout << "Failed to set mode to " << m_currentMode.xres << "x" << m_currentMode.yres << "@" << m_currentMode.bits_per_pixel << "!" << std::endl;
+		}
 	}
 	
 	//get fixed screen information
@@ -86,14 +160,24 @@ void Framebuffer::create(uint32_t width, uint32_t height, uint32_t bitsPerPixel,
 	m_format = screenInfoToPixelFormat(m_currentMode);
 	//check if we can use it
 	if (m_format == BAD_PIXELFORMAT) {
-		std::cout << "Unusable pixel format!" << std::endl;
+		std::cout << "Unusable pixel format " << m_currentMode.bits_per_pixel << "bpp, red " << m_currentMode.red.length << "@" << m_currentMode.red.offset;
+		std::cout << ", green " << m_currentMode.green.length << "@" << m_currentMode.green.offset << ", blue " << m_currentMode.blue.length << "@" << m_currentMode.blue.offset << "!" << std::endl;
 		destroy();
 		return;
 	}
-	m_formatInfo = pixelFormatInfo[m_format];
+	//we need to be able to load our own palette
+	if (m_format == PALETTE8 && m_fixedMode.visual != FB_VISUAL_PSEUDOCOLOR) {
+		std::cout << "Unusable pixel format! 8bit modes need to be pseudocolor." << std::endl;
+		destroy();
+		return;
+	}
+	m_formatInfo = getPixelFormatInfo(m_format);
 
-	//map framebuffer into user memory.
-	m_frameBufferSize = m_currentMode.yres * m_fixedMode.line_length;
+	//map framebuffer into user memory. map the whole virtual screen, so the displayed page can be reached if it is not the first
+	m_frameBufferSize = std::max(m_currentMode.yres, m_currentMode.yres_virtual) * m_fixedMode.line_length;
+	if (m_fixedMode.smem_len >= m_currentMode.yres * m_fixedMode.line_length) {
+		m_frameBufferSize = std::min(m_frameBufferSize, m_fixedMode.smem_len);
+	}
 	m_frameBuffer = static_cast<uint8_t *>(mmap(nullptr, m_frameBufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_frameBufferDevice, 0));
 	if (m_frameBuffer == MAP_FAILED) {
 		std::cout << "Failed to map framebuffer to user memory!" << std::endl;
@@ -101,6 +185,34 @@ void Framebuffer::create(uint32_t width, uint32_t height, uint32_t bitsPerPixel,
 		return;
 	}
 	
+	//draw to the page that is currently displayed
+	m_drawOffsetY = m_currentMode.yoffset;
+
+	if (m_format == PALETTE8) {
+		//store palette for restoring it and load the fixed palette until someone sets a better one
+		m_oldColorMap.resize(3 * Palette::MAX_COLORS);
+		struct fb_cmap colorMap = {0, Palette::MAX_COLORS, m_oldColorMap.data(), m_oldColorMap.data() + Palette::MAX_COLORS, m_oldColorMap.data() + 2 * Palette::MAX_COLORS, nullptr};
+		if (ioctl(m_frameBufferDevice, FBIOGETCMAP, &colorMap)) {
+			m_oldColorMap.clear();
+		}
+		if (keepMode) {
+			//use the palette someone else set, so pixels can be read back. do not restore it later
+			if (!m_oldColorMap.empty()) {
+				std::vector<uint32_t> colors(Palette::MAX_COLORS);
+				for (uint32_t index = 0; index < Palette::MAX_COLORS; ++index) {
+					colors[index] = (m_oldColorMap[index] >> 8) << 16 | (m_oldColorMap[Palette::MAX_COLORS + index] >> 8) << 8 | (m_oldColorMap[2 * Palette::MAX_COLORS + index] >> 8);
+				}
+				m_palette = Palette::fromColors(colors);
+				m_oldColorMap.clear();
+			}
+		}
+		else {
+			setPalette(m_palette);
+		}
+		//mapping pixels to the palette is the expensive part of drawing, so use all cores for it
+		m_threadPool.reset(new ThreadPool());
+	}
+
 	//dump some info
 	std::cout << "Opened a " << m_currentMode.xres << "x" << m_currentMode.yres << "@" << m_currentMode.bits_per_pixel << " display." << std::endl;
 	std::cout << "Pixel format is " << m_formatInfo.name << "." << std::endl;
@@ -113,155 +225,513 @@ void Framebuffer::create(uint32_t width, uint32_t height, uint32_t bitsPerPixel,
 	}*/
 }
 
-Framebuffer::PixelFormat Framebuffer::screenInfoToPixelFormat(const struct fb_var_screeninfo & screenInfo)
+Framebuffer::PixelFormat Framebuffer::pixelFormatFromString(const std::string & name)
 {
-	if (screenInfo.bits_per_pixel == 32) {
-		if (screenInfo.transp.offset >= 24) {
-			return R8G8B8X8;
-		}
-		else if (screenInfo.transp.offset <= 8) {
-			return X8R8G8B8;
+	for (size_t i = 1; i < pixelFormatCount; ++i) {
+		if (pixelFormatInfo[i].name == name) {
+			return pixelFormatInfo[i].format;
 		}
 	}
-	else if (screenInfo.bits_per_pixel == 24) {
-		return R8G8B8;
+	return BAD_PIXELFORMAT;
+}
+
+const Framebuffer::PixelFormatInfo & Framebuffer::getPixelFormatInfo(PixelFormat format)
+{
+	if (format < pixelFormatCount) {
+		return pixelFormatInfo[format];
 	}
-	else if (screenInfo.bits_per_pixel == 16) {
-		if (screenInfo.transp.length == 0) {
-			if (screenInfo.red.length == 6 || screenInfo.green.length == 6 || screenInfo.blue.length == 6) {
-				return R5G6B5;
-			}
-			else {
-				return X1R5G5B5;
-			}
+	std::lock_guard<std::mutex> lock(deviceFormatMutex);
+	const size_t index = format - pixelFormatCount;
+	return index < deviceFormatInfo.size() ? deviceFormatInfo[index] : pixelFormatInfo[BAD_PIXELFORMAT];
+}
+
+//describe a device layout like the named formats, e.g. X6R6G6B6 for RGB666 in 24bit. bits that are no color component are called X
+static std::string layoutName(const Framebuffer::PixelFormatInfo & info)
+{
+	const char names[3] = {'R', 'G', 'B'};
+	const uint32_t bits[3] = {info.bitsRed, info.bitsGreen, info.bitsBlue};
+	const uint32_t shifts[3] = {info.shiftRed, info.shiftGreen, info.shiftBlue};
+	std::ostringstream name;
+	int32_t position = info.bitsPerPixel;
+	while (position > 0) {
+		//find the component ending at this position
+		uint32_t channel = 0;
+		while (channel < 3 && shifts[channel] + bits[channel] != (uint32_t)position) {
+			++channel;
 		}
-		else if (screenInfo.transp.length == 1) {
-			return X1R5G5B5;
+		if (channel < 3) {
+			name << names[channel] << bits[channel];
+			position = shifts[channel];
+		}
+		else {
+			//padding reaches down to the next component
+			int32_t next = 0;
+			for (uint32_t other = 0; other < 3; ++other) {
+				if ((int32_t)(shifts[other] + bits[other]) < position) {
+					next = std::max(next, (int32_t)(shifts[other] + bits[other]));
+				}
+			}
+			name << "X" << position - next;
+			position = next;
 		}
 	}
-	else if (screenInfo.bits_per_pixel == 15) {
-		return X1R5G5B5;
-	}
-	return BAD_PIXELFORMAT;
+	return name.str();
 }
 
-uint8_t * Framebuffer::convertToPixelFormat(PixelFormat destFormat, const uint8_t * source, PixelFormat sourceFormat, size_t count)
+Framebuffer::PixelFormat Framebuffer::screenInfoToPixelFormat(const struct fb_var_screeninfo & screenInfo)
 {
-	//create destination buffer
-	const size_t destSize = count * pixelFormatInfo[destFormat].bytesPerPixel;
-	uint8_t * dest = new uint8_t[destSize];
-	//if source is destination format, just copy
-	if (sourceFormat == destFormat) {
-		memcpy(dest, source, destSize);
-		return dest;
+	if (screenInfo.bits_per_pixel == 8) {
+		return screenInfo.grayscale == 1 ? GREY8 : PALETTE8;
 	}
-	//create temporary 32bit R8G8B8X8 conversion buffer
-	const size_t tempSize = count * pixelFormatInfo[R8G8B8X8].bytesPerPixel;
-	uint32_t * temp = reinterpret_cast<uint32_t *>(new uint8_t[tempSize]);
-	//check source format and convert to 32bit temporary buffer
-	if (sourceFormat == GREY8) {
-		uint32_t * tempPixel = temp;
-		const uint8_t * srcPixel = source;
-		for (size_t pixel = 0; pixel < count; ++pixel, tempPixel++, srcPixel++) {
-			*tempPixel = *srcPixel << 24 | *srcPixel << 16 | *srcPixel << 8 | 0xff;
+	//15bit modes are stored in 16bit pixels
+	const uint32_t bitsPerPixel = screenInfo.bits_per_pixel == 15 ? 16 : screenInfo.bits_per_pixel;
+	//find a format with the same channel layout. padding and alpha bits are ignored
+	for (size_t i = 1; i < pixelFormatCount; ++i) {
+		const PixelFormatInfo & info = pixelFormatInfo[i];
+		if (info.format == GREY8 || info.format == A8R8G8B8 || info.format == PALETTE8) {
+			continue;
 		}
-	}
-	else if (sourceFormat == X1R5G5B5) {
-		uint32_t * tempPixel = temp;
-		const uint16_t * srcPixel = (const uint16_t *)source;
-		for (size_t pixel = 0; pixel < count; ++pixel, tempPixel++, srcPixel++) {
-			*tempPixel = (*srcPixel & 0x7c00) << 14 | (*srcPixel & 0x3e0) << 11 | (*srcPixel & 0x1f) << 8 | 0xff;
+		if (info.bitsPerPixel == bitsPerPixel
+			&& info.bitsRed == screenInfo.red.length && info.shiftRed == screenInfo.red.offset
+			&& info.bitsGreen == screenInfo.green.length && info.shiftGreen == screenInfo.green.offset
+			&& info.bitsBlue == screenInfo.blue.length && info.shiftBlue == screenInfo.blue.offset)
+		{
+			return info.format;
 		}
 	}
-	else if (sourceFormat == R5G6B5) {
-		uint32_t * tempPixel = temp;
-		const uint16_t * srcPixel = (const uint16_t *)source;
-		for (size_t pixel = 0; pixel < count; ++pixel, tempPixel++, srcPixel++) {
-			*tempPixel = (*srcPixel & 0xf800) << 14 | (*srcPixel & 0x7e0) << 11 | (*srcPixel & 0x1f) << 8 | 0xff;
+	//some drivers do not fill in the channel layout. guess the common formats then
+	if (screenInfo.red.offset == 0 && screenInfo.green.offset == 0 && screenInfo.blue.offset == 0) {
+		if (bitsPerPixel == 32) {
+			return X8R8G8B8;
+		}
+		else if (bitsPerPixel == 24) {
+			return R8G8B8;
 		}
+		else if (bitsPerPixel == 16) {
+			return (screenInfo.bits_per_pixel == 16 && screenInfo.green.length == 6) ? R5G6B5 : X1R5G5B5;
+		}
+		return BAD_PIXELFORMAT;
 	}
-	else if (sourceFormat == R8G8B8) {
-		uint32_t * tempPixel = temp;
-		const uint8_t * srcPixel = source;
-		for (size_t pixel = 0; pixel < count; ++pixel, tempPixel++, srcPixel++) {
-			*tempPixel = srcPixel[2] << 24 | srcPixel[1] << 16 | srcPixel[0] << 8 | 0xff;
+	//the generic kernels handle any layout of whole Bytes where the components do not overlap and have at most 16 bits
+	if (bitsPerPixel != 16 && bitsPerPixel != 24 && bitsPerPixel != 32) {
+		return BAD_PIXELFORMAT;
+	}
+	const struct fb_bitfield * channels[3] = {&screenInfo.red, &screenInfo.green, &screenInfo.blue};
+	uint32_t usedBits = 0;
+	for (uint32_t channel = 0; channel < 3; ++channel) {
+		const struct fb_bitfield & field = *channels[channel];
+		if (field.length == 0 || field.length > 16 || field.offset + field.length > bitsPerPixel || field.msb_right != 0) {
+			return BAD_PIXELFORMAT;
+		}
+		const uint32_t mask = ((1 << field.length) - 1) << field.offset;
+		if ((usedBits & mask) != 0) {
+			return BAD_PIXELFORMAT;
 		}
+		usedBits |= mask;
 	}
-	else if (sourceFormat == X8R8G8B8) {
-		uint32_t * tempPixel = temp;
-		const uint32_t * srcPixel = (const uint32_t *)source;
-		for (size_t pixel = 0; pixel < count; ++pixel, tempPixel++, srcPixel++) {
-			*tempPixel = *srcPixel << 8 | 0xff;
+	PixelFormatInfo info = {BAD_PIXELFORMAT, bitsPerPixel, bitsPerPixel / 8, screenInfo.red.length, screenInfo.green.length, screenInfo.blue.length, 0, screenInfo.red.offset, screenInfo.green.offset, screenInfo.blue.offset, 0, ""};
+	info.name = layoutName(info);
+	//devices with the same layout share a format, so the list stays short
+	std::lock_guard<std::mutex> lock(deviceFormatMutex);
+	for (auto existing = deviceFormatInfo.cbegin(); existing != deviceFormatInfo.cend(); ++existing) {
+		if (existing->bitsPerPixel == info.bitsPerPixel && existing->name == info.name) {
+			return existing->format;
 		}
 	}
-	else if (sourceFormat == R8G8B8X8) {
-		memcpy(temp, source, tempSize);
+	info.format = (PixelFormat)(pixelFormatCount + deviceFormatInfo.size());
+	deviceFormatInfo.push_back(info);
+	return info.format;
+}
+
+void Framebuffer::convert(uint8_t * dest, uint32_t destLineLength, PixelFormat destFormat, const uint8_t * source, uint32_t sourceLineLength, PixelFormat sourceFormat, uint32_t width, uint32_t height)
+{
+	//lines are tightly packed if no line length was passed
+	const uint32_t destBytesPerPixel = getPixelFormatInfo(destFormat).bytesPerPixel;
+	const uint32_t sourceBytesPerPixel = getPixelFormatInfo(sourceFormat).bytesPerPixel;
+	if (destLineLength == 0) {
+		destLineLength = width * destBytesPerPixel;
 	}
-	//now convert to destination format
-	if (destFormat == GREY8) {
-		const uint8_t * tempPixel = (const uint8_t *)temp;
-		uint8_t * destPixel = dest;
-		for (size_t pixel = 0; pixel < count; ++pixel, destPixel++, tempPixel+=4) {
-			*destPixel = ((tempPixel[2] + tempPixel[1] + tempPixel[0]) / 3) & 0xff;
-		}
+	if (sourceLineLength == 0) {
+		sourceLineLength = width * sourceBytesPerPixel;
+	}
+	//alpha is ignored when converting, so A8R8G8B8 is converted like X8R8G8B8
+	if (sourceFormat == A8R8G8B8 && destFormat != A8R8G8B8) {
+		sourceFormat = X8R8G8B8;
 	}
-	else if (destFormat == X1R5G5B5) {
-		const uint8_t * tempPixel = (const uint8_t *)temp;
-		uint16_t * destPixel = (uint16_t *)dest;
-		for (size_t pixel = 0; pixel < count; ++pixel, destPixel++, tempPixel+=4) {
-			*destPixel = 0x8000 | (tempPixel[3] & 0xf8) << 7 | (tempPixel[2] & 0xf8) << 2 | (tempPixel[1] & 0xf8) >> 3;
+	const bool destIs32Bit = (destFormat == X8R8G8B8 || destFormat == A8R8G8B8);
+	for (uint32_t line = 0; line < height; ++line, dest += destLineLength, source += sourceLineLength) {
+		if (sourceFormat == destFormat) {
+			//if source is destination format, just copy
+			memcpy(dest, source, width * destBytesPerPixel);
 		}
+		else if (destIs32Bit) {
+			//convert directly to destination
+			PixelOps::unpackLine(reinterpret_cast<uint32_t *>(dest), source, sourceFormat, width);
+		}
+		else if (sourceFormat == X8R8G8B8) {
+			//convert directly from source
+			PixelOps::packLine(dest, destFormat, reinterpret_cast<const uint32_t *>(source), width);
+		}
+		else {
+			//neither side is 32bit. go through a small 32bit buffer on the stack that stays in the cache
+			static const uint32_t CHUNK_SIZE = 64;
+			uint32_t chunk[CHUNK_SIZE];
+			for (uint32_t pixel = 0; pixel < width; pixel += CHUNK_SIZE) {
+				const uint32_t count = (width - pixel) < CHUNK_SIZE ? (width - pixel) : CHUNK_SIZE;
+				PixelOps::unpackLine(chunk, source + pixel * sourceBytesPerPixel, sourceFormat, count);
+				PixelOps::packLine(dest + pixel * destBytesPerPixel, destFormat, chunk, count);
+			}
+		}
+	}
+}
+
+void Framebuffer::convertColor(uint8_t * dest, uint32_t color) const
+{
+	if (m_format == PALETTE8) {
+		m_palette.mapLine(dest, &color, 1, 0, 0, false);
+	}
+	else {
+		convert(dest, 0, m_format, reinterpret_cast<const uint8_t *>(&color), 0, X8R8G8B8, 1);
+	}
+}
+
+bool Framebuffer::setPalette(const Palette & palette)
+{
+	if (m_format != PALETTE8) {
+		return false;
+	}
+	m_palette = palette;
+	if (isVirtual()) {
+		return true;
+	}
+	//the driver wants 16bit color components
+	const std::vector<uint32_t> & colors = palette.getColors();
+	std::vector<uint16_t> components(3 * colors.size());
+	for (size_t index = 0; index < colors.size(); ++index) {
+		components[index] = ((colors[index] >> 16) & 0xff) * 257;
+		components[colors.size() + index] = ((colors[index] >> 8) & 0xff) * 257;
+		components[2 * colors.size() + index] = (colors[index] & 0xff) * 257;
 	}
-	else if (destFormat == R5G6B5) {
-		const uint8_t * tempPixel = (const uint8_t *)temp;
-		uint16_t * destPixel = (uint16_t *)dest;
-		for (size_t pixel = 0; pixel < count; ++pixel, destPixel++, tempPixel+=4) {
-			*destPixel = (tempPixel[3] & 0xf8) << 8 | (tempPixel[2] & 0xfc) << 3 | (tempPixel[1] & 0xf8) >> 3;
+	struct fb_cmap colorMap = {0, (uint32_t)colors.size(), components.data(), components.data() + colors.size(), components.data() + 2 * colors.size(), nullptr};
+	if (ioctl(m_frameBufferDevice, FBIOPUTCMAP, &colorMap)) {
+		std::cout << "Failed to set palette!" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+const Palette & Framebuffer::getPalette() const
+{
+	return m_palette;
+}
+
+void Framebuffer::setDithering(bool enabled)
+{
+	m_dither = enabled;
+}
+
+bool Framebuffer::isDithering() const
+{
+	return m_dither;
+}
+
+void Framebuffer::unpackLine(uint32_t * dest, const uint8_t * source, PixelFormat sourceFormat, uint32_t count) const
+{
+	//palette indices always refer to the palette of the framebuffer
+	if (sourceFormat == PALETTE8) {
+		m_palette.unmapLine(dest, source, count);
+	}
+	else {
+		PixelOps::unpackLine(dest, source, sourceFormat, count);
+	}
+}
+
+void Framebuffer::packLine(uint8_t * dest, const uint32_t * source, uint32_t count, uint32_t deviceX, uint32_t deviceY) const
+{
+	if (m_format == PALETTE8) {
+		m_palette.mapLine(dest, source, count, deviceX, deviceY, m_dither);
+	}
+	else {
+		PixelOps::packLine(dest, m_format, source, count);
+	}
+}
+
+uint8_t * Framebuffer::pixelAddress(uint32_t x, uint32_t y) const
+{
+	return m_frameBuffer + (y + m_drawOffsetY) * m_fixedMode.line_length + (x + m_currentMode.xoffset) * m_formatInfo.bytesPerPixel;
+}
+
+bool Framebuffer::enablePageFlipping()
+{
+	if (!isAvailable() || isVirtual()) {
+		return false;
+	}
+	if (m_pageFlipping) {
+		return true;
+	}
+	//try to set up a virtual screen twice as high as the real one
+	struct fb_var_screeninfo mode = m_currentMode;
+	mode.yres_virtual = 2 * mode.yres;
+	mode.yoffset = 0;
+	if (ioctl(m_frameBufferDevice, FBIOPUT_VSCREENINFO, &mode) || ioctl(m_frameBufferDevice, FBIOGET_VSCREENINFO, &mode)) {
+		std::cout << "Failed to set virtual resolution for page flipping!" << std::endl;
+		return false;
+	}
+	struct fb_fix_screeninfo fixedMode;
+	if (mode.yres_virtual < 2 * mode.yres || ioctl(m_frameBufferDevice, FBIOGET_FSCREENINFO, &fixedMode) || fixedMode.smem_len < 2 * mode.yres * fixedMode.line_length) {
+		std::cout << "Framebuffer does not support page flipping." << std::endl;
+		//switch back to what we had
+		ioctl(m_frameBufferDevice, FBIOPUT_VSCREENINFO, &m_currentMode);
+		return false;
+	}
+	//map both pages
+	const uint32_t size = 2 * mode.yres * fixedMode.line_length;
+	uint8_t * frameBuffer = static_cast<uint8_t *>(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_frameBufferDevice, 0));
+	if (frameBuffer == MAP_FAILED) {
+		std::cout << "Failed to map framebuffer pages to user memory!" << std::endl;
+		ioctl(m_frameBufferDevice, FBIOPUT_VSCREENINFO, &m_currentMode);
+		return false;
+	}
+	munmap(m_frameBuffer, m_frameBufferSize);
+	m_frameBuffer = frameBuffer;
+	m_frameBufferSize = size;
+	m_currentMode = mode;
+	m_fixedMode = fixedMode;
+	m_pageFlipping = true;
+	//copy displayed page to back page and draw there from now on
+	memcpy(m_frameBuffer + m_currentMode.yres * m_fixedMode.line_length, m_frameBuffer, m_currentMode.yres * m_fixedMode.line_length);
+	m_drawOffsetY = m_currentMode.yres;
+	std::cout << "Page flipping enabled." << std::endl;
+	return true;
+}
+
+bool Framebuffer::isPageFlipping() const
+{
+	return m_pageFlipping;
+}
+
+bool Framebuffer::waitForVsync()
+{
+	uint32_t screen = 0;
+	return isAvailable() && !isVirtual() && ioctl(m_frameBufferDevice, FBIO_WAITFORVSYNC, &screen) == 0;
+}
+
+void Framebuffer::flip()
+{
+	if (m_pageFlipping) {
+		//display the page we've drawn to
+		m_currentMode.yoffset = m_drawOffsetY;
+		if (ioctl(m_frameBufferDevice, FBIOPAN_DISPLAY, &m_currentMode)) {
+			std::cout << "Failed to pan display!" << std::endl;
 		}
+		//make sure the old page isn't scanned out anymore before drawing to it
+		waitForVsync();
+		m_drawOffsetY = (m_drawOffsetY == 0) ? m_currentMode.yres : 0;
 	}
-	else if (destFormat == R8G8B8) {
-		const uint8_t * tempPixel = (const uint8_t *)temp;
-		uint8_t * destPixel = dest;
-		for (size_t pixel = 0; pixel < count; ++pixel, destPixel+=3, tempPixel+=4) {
-			destPixel[0] = tempPixel[1];
-			destPixel[1] = tempPixel[2];
-			destPixel[2] = tempPixel[3];
+	else {
+		waitForVsync();
+	}
+}
+
+bool Framebuffer::isAvailable() const
+{
+	return m_frameBuffer != nullptr;
+}
+
+bool Framebuffer::isVirtual() const
+{
+	return !m_memory.empty();
+}
+
+uint32_t Framebuffer::getLineLength() const
+{
+	return m_fixedMode.line_length;
+}
+
+const uint8_t * Framebuffer::getData() const
+{
+	return pixelAddress(0, 0);
+}
+
+bool Framebuffer::readback(uint8_t * dest, uint32_t destLineLength, PixelFormat destFormat, uint32_t x, uint32_t y, uint32_t width, uint32_t height) const
+{
+	if (!isAvailable() || x >= m_currentMode.xres || y >= m_currentMode.yres || width == 0 || height == 0) {
+		return false;
+	}
+	//clip rectangle to the panel
+	width = std::min(width, m_currentMode.xres - x);
+	height = std::min(height, m_currentMode.yres - y);
+	if (destLineLength == 0) {
+		destLineLength = width * getPixelFormatInfo(destFormat).bytesPerPixel;
+	}
+	//read the page that is displayed. another process may have panned the display, so ask the driver
+	uint32_t pageY = m_currentMode.yoffset;
+	uint32_t pageX = m_currentMode.xoffset;
+	struct fb_var_screeninfo mode;
+	if (!isVirtual() && ioctl(m_frameBufferDevice, FBIOGET_VSCREENINFO, &mode) == 0) {
+		pageY = mode.yoffset;
+		pageX = mode.xoffset;
+	}
+	if ((size_t)(pageY + y + height) * m_fixedMode.line_length > m_frameBufferSize) {
+		pageY = 0;
+	}
+	const uint32_t bytesPerPixel = m_formatInfo.bytesPerPixel;
+	const uint8_t * source = m_frameBuffer + (pageY + y) * m_fixedMode.line_length + (pageX + x) * bytesPerPixel;
+	if (destFormat == m_format) {
+		for (uint32_t line = 0; line < height; ++line, dest += destLineLength, source += m_fixedMode.line_length) {
+			memcpy(dest, source, width * bytesPerPixel);
 		}
+		return true;
 	}
-	else if (destFormat == X8R8G8B8) {
-		const uint32_t * tempPixel = (const uint32_t *)temp;
-		uint32_t * destPixel = (uint32_t *)dest;
-		for (size_t pixel = 0; pixel < count; ++pixel, destPixel++, tempPixel++) {
-			*destPixel = *tempPixel << 8 | 0xff;
+	//video memory is often uncached. read it with big sequential copies into a small buffer on the stack instead of pixel by pixel
+	static const uint32_t CHUNK_SIZE = 256;
+	alignas(16) uint8_t chunk[CHUNK_SIZE * 4];
+	uint32_t pixels[CHUNK_SIZE];
+	const uint32_t destBytesPerPixel = getPixelFormatInfo(destFormat).bytesPerPixel;
+	const bool destIs32Bit = (destFormat == X8R8G8B8 || destFormat == A8R8G8B8);
+	for (uint32_t line = 0; line < height; ++line, dest += destLineLength, source += m_fixedMode.line_length) {
+		for (uint32_t pixel = 0; pixel < width; pixel += CHUNK_SIZE) {
+			const uint32_t count = std::min(width - pixel, CHUNK_SIZE);
+			memcpy(chunk, source + pixel * bytesPerPixel, count * bytesPerPixel);
+			if (destIs32Bit) {
+				unpackLine(reinterpret_cast<uint32_t *>(dest + pixel * 4), chunk, m_format, count);
+			}
+			else if (m_format == X8R8G8B8) {
+				//the copy already is X8R8G8B8, so pack it directly
+				PixelOps::packLine(dest + pixel * destBytesPerPixel, destFormat, reinterpret_cast<const uint32_t *>(chunk), count);
+			}
+			else {
+				unpackLine(pixels, chunk, m_format, count);
+				PixelOps::packLine(dest + pixel * destBytesPerPixel, destFormat, pixels, count);
+			}
 		}
 	}
-	else if (destFormat == R8G8B8X8) {
-		memcpy(dest, temp, tempSize);
+	return true;
+}
+
+ImageBuffer Framebuffer::readback(uint32_t x, uint32_t y, uint32_t & width, uint32_t & height, PixelFormat format) const
+{
+	ImageBuffer data;
+	if (!isAvailable() || x >= m_currentMode.xres || y >= m_currentMode.yres) {
+		width = 0;
+		height = 0;
+		return data;
 	}
-	//free temporary buffer
-	delete [] temp;
-	//return destination buffer
-	return dest;
+	width = std::min(width, m_currentMode.xres - x);
+	height = std::min(height, m_currentMode.yres - y);
+	data.resize(width * height * getPixelFormatInfo(format).bytesPerPixel);
+	readback(data.data(), 0, format, x, y, width, height);
+	return data;
 }
 
-uint8_t * Framebuffer::convertToFramebufferFormat(const uint8_t * source, PixelFormat sourceFormat, size_t count)
+bool Framebuffer::readRect(uint32_t * dest, uint32_t x, uint32_t y, uint32_t width, uint32_t height) const
 {
-	return convertToPixelFormat(m_format, source, sourceFormat, count);
+	if (!isAvailable() || width == 0 || height == 0 || x >= getWidth() || y >= getHeight() || width > getWidth() - x || height > getHeight() - y) {
+		return false;
+	}
+	int32_t t[6];
+	getTransform(t);
+	uint32_t deviceX = x;
+	uint32_t deviceY = y;
+	uint32_t deviceWidth = width;
+	uint32_t deviceHeight = height;
+	toDeviceRect(deviceX, deviceY, deviceWidth, deviceHeight);
+	//copy device scanlines in chunks like readback() does, then scatter the pixels to where they are in drawing coordinates
+	static const uint32_t CHUNK_SIZE = 256;
+	uint8_t chunk[CHUNK_SIZE * 4];
+	uint32_t pixels[CHUNK_SIZE];
+	const uint32_t bytesPerPixel = m_formatInfo.bytesPerPixel;
+	for (uint32_t row = deviceY; row < deviceY + deviceHeight; ++row) {
+		const uint8_t * source = pixelAddress(deviceX, row);
+		for (uint32_t column = 0; column < deviceWidth; column += CHUNK_SIZE) {
+			const uint32_t count = std::min(deviceWidth - column, CHUNK_SIZE);
+			memcpy(chunk, source + column * bytesPerPixel, count * bytesPerPixel);
+			unpackLine(pixels, chunk, m_format, count);
+			for (uint32_t i = 0; i < count; ++i) {
+				const int32_t pixelX = t[0] * (int32_t)(deviceX + column + i) + t[1] * (int32_t)row + t[2] - (int32_t)x;
+				const int32_t pixelY = t[3] * (int32_t)(deviceX + column + i) + t[4] * (int32_t)row + t[5] - (int32_t)y;
+				dest[pixelY * width + pixelX] = pixels[i];
+			}
+		}
+	}
+	return true;
 }
 
-bool Framebuffer::isAvailable() const
+void Framebuffer::setOrientation(Orientation orientation, bool mirror)
 {
-	return (m_frameBuffer != nullptr && m_frameBufferDevice != 0);
+	m_orientation = orientation;
+	m_mirror = mirror;
+}
+
+Framebuffer::Orientation Framebuffer::getOrientation() const
+{
+	return m_orientation;
+}
+
+bool Framebuffer::isMirrored() const
+{
+	return m_mirror;
 }
 
 uint32_t Framebuffer::getWidth() const
 {
-	return m_currentMode.xres;
+	return (m_orientation == ROTATE_90 || m_orientation == ROTATE_270) ? m_currentMode.yres : m_currentMode.xres;
 }
 
 uint32_t Framebuffer::getHeight() const
 {
-	return m_currentMode.yres;
+	return (m_orientation == ROTATE_90 || m_orientation == ROTATE_270) ? m_currentMode.xres : m_currentMode.yres;
+}
+
+void Framebuffer::addOrientation(Orientation orientation, bool mirror)
+{
+	//mirroring reverses the direction of rotations applied before it
+	const uint32_t rotation = m_mirror ? (4 + m_orientation - orientation) : (m_orientation + orientation);
+	m_orientation = (Orientation)(rotation % 4);
+	m_mirror = (m_mirror != mirror);
+}
+
+void Framebuffer::getTransform(Orientation orientation, bool mirror, uint32_t deviceWidth, uint32_t deviceHeight, int32_t transform[6])
+{
+	const int32_t w = deviceWidth;
+	const int32_t h = deviceHeight;
+	const int32_t transforms[4][6] = {
+		{ 1,  0, 0,      0,  1, 0},
+		{ 0,  1, 0,     -1,  0, w - 1},
+		{-1,  0, w - 1,  0, -1, h - 1},
+		{ 0, -1, h - 1,  1,  0, 0}
+	};
+	memcpy(transform, transforms[orientation], sizeof(transforms[0]));
+	if (mirror) {
+		const int32_t width = (orientation == ROTATE_90 || orientation == ROTATE_270) ? h : w;
+		transform[0] = -transform[0];
+		transform[1] = -transform[1];
+		transform[2] = width - 1 - transform[2];
+	}
+}
+
+void Framebuffer::getTransform(int32_t transform[6]) const
+{
+	getTransform(m_orientation, m_mirror, m_currentMode.xres, m_currentMode.yres, transform);
+}
+
+void Framebuffer::toDeviceRect(uint32_t & x, uint32_t & y, uint32_t & width, uint32_t & height) const
+{
+	int32_t t[6];
+	getTransform(t);
+	//the transformation only swaps and flips axes, so its inverse is its transpose
+	const int32_t x0 = x - t[2];
+	const int32_t y0 = y - t[5];
+	const int32_t x1 = x + width - 1 - t[2];
+	const int32_t y1 = y + height - 1 - t[5];
+	const int32_t deviceX0 = t[0] * x0 + t[3] * y0;
+	const int32_t deviceY0 = t[1] * x0 + t[4] * y0;
+	const int32_t deviceX1 = t[0] * x1 + t[3] * y1;
+	const int32_t deviceY1 = t[1] * x1 + t[4] * y1;
+	x = std::min(deviceX0, deviceX1);
+	y = std::min(deviceY0, deviceY1);
+	width = std::abs(deviceX1 - deviceX0) + 1;
+	height = std::abs(deviceY1 - deviceY0) + 1;
 }
 
 Framebuffer::PixelFormat Framebuffer::getFormat() const
@@ -277,22 +747,41 @@ Framebuffer::PixelFormatInfo Framebuffer::getFormatInfo() const
 void Framebuffer::clear(const uint8_t * color)
 {
 	//fill screen with color
+	fillRect(0, 0, getWidth(), getHeight(), color);
+}
+
+void Framebuffer::fillRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const uint8_t * color)
+{
+	if (!isAvailable() || x >= getWidth() || y >= getHeight() || width == 0 || height == 0) {
+		return;
+	}
+	//clip rectangle to framebuffer dimensions
+	if (x + width > getWidth()) {
+		width = getWidth() - x;
+	}
+	if (y + height > getHeight()) {
+		height = getHeight() - y;
+	}
+	//filling does not care about the orientation, just where the rectangle is
+	toDeviceRect(x, y, width, height);
+	uint8_t * start = pixelAddress(x, y);
+	//fill rectangle with color
 	if (m_formatInfo.bytesPerPixel == 4) {
-		uint32_t * dest = (uint32_t *)m_frameBuffer;
+		uint32_t * dest = (uint32_t *)start;
 		const uint32_t destColor = *((uint32_t *)color);
-		for (uint32_t line = 0; line < m_currentMode.yres; ++line) {
+		for (uint32_t line = 0; line < height; ++line) {
 			uint32_t * destLine = dest;
-			for (uint32_t pixel = 0; pixel < m_currentMode.xres; ++pixel, destLine++) {
+			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine++) {
 				*destLine = destColor;
 			}
 			dest += m_fixedMode.line_length / 4;
 		}
 	}
 	else if (m_formatInfo.bytesPerPixel == 3) {
-		uint8_t * dest = m_frameBuffer;
-		for (uint32_t line = 0; line < m_currentMode.yres; ++line) {
+		uint8_t * dest = start;
+		for (uint32_t line = 0; line < height; ++line) {
 			uint8_t * destLine = dest;
-			for (uint32_t pixel = 0; pixel < m_currentMode.xres; ++pixel, destLine+=3) {
+			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine+=3) {
 				destLine[0] = color[0];
 				destLine[1] = color[1];
 				destLine[2] = color[2];
@@ -301,22 +790,22 @@ void Framebuffer::clear(const uint8_t * color)
 		}
 	}
 	else if (m_formatInfo.bytesPerPixel == 2) {
-		uint16_t * dest = (uint16_t *)m_frameBuffer;
+		uint16_t * dest = (uint16_t *)start;
 		const uint16_t destColor = *((uint16_t *)color);
-		for (uint32_t line = 0; line < m_currentMode.yres; ++line) {
+		for (uint32_t line = 0; line < height; ++line) {
 			uint16_t * destLine = dest;
-			for (uint32_t pixel = 0; pixel < m_currentMode.xres; ++pixel, destLine++) {
+			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine++) {
 				*destLine = destColor;
 			}
 			dest += m_fixedMode.line_length / 2;
 		}
 	}
 	else if (m_formatInfo.bytesPerPixel == 1) {
-		uint8_t * dest = m_frameBuffer;
+		uint8_t * dest = start;
 		const uint8_t destColor = *color;
-		for (uint32_t line = 0; line < m_currentMode.yres; ++line) {
+		for (uint32_t line = 0; line < height; ++line) {
 			uint8_t * destLine = dest;
-			for (uint32_t pixel = 0; pixel < m_currentMode.xres; ++pixel, destLine++) {
+			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine++) {
 				*destLine = destColor;
 			}
 			dest += m_fixedMode.line_length;
@@ -324,63 +813,209 @@ void Framebuffer::clear(const uint8_t * color)
 	}
 }
 
-void Framebuffer::blit(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat)
+//check if one of the hand-written blit_XXX functions handles a conversion
+static bool hasBlitter(Framebuffer::PixelFormat destFormat, Framebuffer::PixelFormat sourceFormat)
+{
+	const bool destHandled = (destFormat == Framebuffer::R8G8B8X8 || destFormat == Framebuffer::X8R8G8B8 || destFormat == Framebuffer::R8G8B8
+		|| destFormat == Framebuffer::X1R5G5B5 || destFormat == Framebuffer::R5G6B5);
+	const bool sourceHandled = (sourceFormat == Framebuffer::R8G8B8X8 || sourceFormat == Framebuffer::X8R8G8B8 || sourceFormat == Framebuffer::R8G8B8
+		|| sourceFormat == Framebuffer::X1R5G5B5 || sourceFormat == Framebuffer::R5G6B5 || sourceFormat == Framebuffer::GREY8);
+	return destHandled && sourceHandled;
+}
+
+void Framebuffer::blit(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat, uint32_t sourceLineLength)
 {
 	if (isAvailable()) {
 		//std::cout << "Blitting " << width << "x" << height << "@" << bpp << " image to [" << x "," << y << "]." << std::endl;
 		//sanity checks for start position and source dimensions
-		if (x >= m_currentMode.xres || width == 0) {
+		if (x >= getWidth() || width == 0) {
 			return;
 		}
-		else if (y >= m_currentMode.yres || height == 0) {
+		else if (y >= getHeight() || height == 0) {
 			return;
 		}
+		//source lines are tightly packed if no line length was passed. do this before clipping
+		if (sourceLineLength == 0) {
+			sourceLineLength = width * getPixelFormatInfo(sourceFormat).bytesPerPixel;
+		}
 		//clip source rectangle to framebuffer dimensions
-		if (x + width > m_currentMode.xres) {
-			width = m_currentMode.xres - x;
+		if (x + width > getWidth()) {
+			width = getWidth() - x;
 		}
-		if (y + height > m_currentMode.yres) {
-			height = m_currentMode.yres - y;
+		if (y + height > getHeight()) {
+			height = getHeight() - y;
+		}
+		//blit() does not blend, so alpha is just ignored
+		if (sourceFormat == A8R8G8B8) {
+			sourceFormat = X8R8G8B8;
 		}
 		//check what framebuffer format we're blitting to
-		if (m_format == sourceFormat) {
-			blit_copy(x, y, data, width, height);
+		if (m_orientation != ROTATE_0 || m_mirror) {
+			blit_oriented(x, y, data, width, height, sourceFormat, sourceLineLength, false, 255);
+		}
+		else if (m_format == sourceFormat) {
+			blit_copy(x, y, data, width, height, sourceLineLength);
+		}
+		else if (m_format == PALETTE8) {
+			blit_PALETTE8(x, y, data, width, height, sourceFormat, sourceLineLength);
+		}
+		else if (sourceFormat == PALETTE8) {
+			//the generic path looks indices up in the palette of the framebuffer
+			blit_oriented(x, y, data, width, height, sourceFormat, sourceLineLength, false, 255);
+		}
+		else if (!hasBlitter(m_format, sourceFormat)) {
+			//the generic kernels convert any other combination of formats
+			convert(pixelAddress(x, y), m_fixedMode.line_length, m_format, data, sourceLineLength, sourceFormat, width, height);
 		}
 		else if (m_format == R8G8B8X8) {
-			blit_R8G8B8X8(x, y, data, width, height, sourceFormat);
+			blit_R8G8B8X8(x, y, data, width, height, sourceFormat, sourceLineLength);
 		}
 		else if (m_format == X8R8G8B8) {
-			blit_X8R8G8B8(x, y, data, width, height, sourceFormat);
+			blit_X8R8G8B8(x, y, data, width, height, sourceFormat, sourceLineLength);
 		}
 		else if (m_format == R8G8B8) {
-			blit_R8G8B8(x, y, data, width, height, sourceFormat);
+			blit_R8G8B8(x, y, data, width, height, sourceFormat, sourceLineLength);
 		}
 		else if (m_format == X1R5G5B5) {
-			blit_X1R5G5B5(x, y, data, width, height, sourceFormat);
+			blit_X1R5G5B5(x, y, data, width, height, sourceFormat, sourceLineLength);
 		}
 		else if (m_format == R5G6B5) {
-			blit_R5G6B5(x, y, data, width, height, sourceFormat);
+			blit_R5G6B5(x, y, data, width, height, sourceFormat, sourceLineLength);
 		}
 	}
 }
 
-void Framebuffer::blit_copy(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height)
+void Framebuffer::blitBlend(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, uint8_t opacity, uint32_t sourceLineLength)
 {
-	//blitting to the same format. simple memcopy    
-	const uint32_t srcLineLength = width * m_formatInfo.bytesPerPixel;
-	uint8_t * dest = m_frameBuffer + (y + m_currentMode.yoffset) * m_fixedMode.line_length + (x + m_currentMode.xoffset) * m_formatInfo.bytesPerPixel;
+	if (isAvailable()) {
+		//sanity checks for start position, source dimensions and opacity
+		if (x >= getWidth() || width == 0) {
+			return;
+		}
+		else if (y >= getHeight() || height == 0) {
+			return;
+		}
+		else if (opacity == 0) {
+			return;
+		}
+		//source lines are tightly packed if no line length was passed. do this before clipping
+		if (sourceLineLength == 0) {
+			sourceLineLength = width * 4;
+		}
+		//clip source rectangle to framebuffer dimensions
+		if (x + width > getWidth()) {
+			width = getWidth() - x;
+		}
+		if (y + height > getHeight()) {
+			height = getHeight() - y;
+		}
+		if (m_orientation != ROTATE_0 || m_mirror) {
+			blit_oriented(x, y, data, width, height, A8R8G8B8, sourceLineLength, true, opacity);
+			return;
+		}
+		uint8_t * dest = pixelAddress(x, y);
+		if (m_format == X8R8G8B8) {
+			//blend directly into framebuffer
+			for (uint32_t line = 0; line < height; ++line) {
+				PixelOps::blendLine(reinterpret_cast<uint32_t *>(dest), reinterpret_cast<const uint32_t *>(data), width, opacity);
+				dest += m_fixedMode.line_length;
+				data += sourceLineLength;
+			}
+		}
+		else {
+			//unpack framebuffer scanline to 32bit, blend and pack it again
+			uint32_t * lineBuffer = m_scratch.allocate<uint32_t>(width);
+			for (uint32_t line = 0; line < height; ++line) {
+				unpackLine(lineBuffer, dest, m_format, width);
+				PixelOps::blendLine(lineBuffer, reinterpret_cast<const uint32_t *>(data), width, opacity);
+				packLine(dest, lineBuffer, width, x, y + line);
+				dest += m_fixedMode.line_length;
+				data += sourceLineLength;
+			}
+			m_scratch.reset();
+		}
+	}
+}
+
+void Framebuffer::blit_oriented(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat, uint32_t srcLineLength, bool blend, uint8_t opacity)
+{
+	//32x32 pixels of 32bit fit into the L1 cache easily
+	static const uint32_t TILE_SIZE = 32;
+	//transitions blit from multiple threads, so use per-thread buffers
+	static thread_local std::vector<uint32_t> tile(TILE_SIZE * TILE_SIZE);
+	static thread_local std::vector<uint32_t> line(TILE_SIZE);
+	static thread_local std::vector<uint32_t> destLine(TILE_SIZE);
+	const uint32_t srcBytesPerPixel = getPixelFormatInfo(sourceFormat).bytesPerPixel;
+	int32_t t[6];
+	getTransform(t);
+	//walk the destination rectangle tile by tile, so scanlines are written contiguously
+	uint32_t deviceX = x;
+	uint32_t deviceY = y;
+	uint32_t deviceWidth = width;
+	uint32_t deviceHeight = height;
+	toDeviceRect(deviceX, deviceY, deviceWidth, deviceHeight);
+	for (uint32_t tileY = deviceY; tileY < deviceY + deviceHeight; tileY += TILE_SIZE) {
+		const uint32_t tileHeight = std::min(TILE_SIZE, deviceY + deviceHeight - tileY);
+		for (uint32_t tileX = deviceX; tileX < deviceX + deviceWidth; tileX += TILE_SIZE) {
+			const uint32_t tileWidth = std::min(TILE_SIZE, deviceX + deviceWidth - tileX);
+			//find the source rectangle the tile shows. it is the tile transposed for 90 and 270 degrees
+			const int32_t corner0X = t[0] * tileX + t[1] * tileY + t[2];
+			const int32_t corner0Y = t[3] * tileX + t[4] * tileY + t[5];
+			const int32_t corner1X = t[0] * (tileX + tileWidth - 1) + t[1] * (tileY + tileHeight - 1) + t[2];
+			const int32_t corner1Y = t[3] * (tileX + tileWidth - 1) + t[4] * (tileY + tileHeight - 1) + t[5];
+			const int32_t sourceX = std::min(corner0X, corner1X);
+			const int32_t sourceY = std::min(corner0Y, corner1Y);
+			const uint32_t sourceWidth = std::abs(corner1X - corner0X) + 1;
+			const uint32_t sourceHeight = std::abs(corner1Y - corner0Y) + 1;
+			//read source rectangle scanline by scanline into the tile as 32bit pixels
+			const uint8_t * src = data + (sourceY - y) * srcLineLength + (sourceX - x) * srcBytesPerPixel;
+			for (uint32_t row = 0; row < sourceHeight; ++row, src += srcLineLength) {
+				if (blend) {
+					memcpy(tile.data() + row * sourceWidth, src, sourceWidth * 4);
+				}
+				else {
+					unpackLine(tile.data() + row * sourceWidth, src, sourceFormat, sourceWidth);
+				}
+			}
+			//gather device scanlines from the tile and write them
+			const int32_t stepX = t[0] + t[3] * (int32_t)sourceWidth;
+			for (uint32_t row = 0; row < tileHeight; ++row) {
+				const int32_t startX = t[0] * tileX + t[1] * (tileY + row) + t[2] - sourceX;
+				const int32_t startY = t[3] * tileX + t[4] * (tileY + row) + t[5] - sourceY;
+				const uint32_t * tilePixel = tile.data() + startY * (int32_t)sourceWidth + startX;
+				for (uint32_t column = 0; column < tileWidth; ++column, tilePixel += stepX) {
+					line[column] = *tilePixel;
+				}
+				uint8_t * dest = pixelAddress(tileX, tileY + row);
+				if (blend) {
+					unpackLine(destLine.data(), dest, m_format, tileWidth);
+					PixelOps::blendLine(destLine.data(), line.data(), tileWidth, opacity);
+					packLine(dest, destLine.data(), tileWidth, tileX, tileY + row);
+				}
+				else {
+					packLine(dest, line.data(), tileWidth, tileX, tileY + row);
+				}
+			}
+		}
+	}
+}
+
+void Framebuffer::blit_copy(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, uint32_t srcLineLength)
+{
+	//blitting to the same format. simple memcopy
+	const uint32_t copyLength = width * m_formatInfo.bytesPerPixel;
+	uint8_t * dest = pixelAddress(x, y);
 	const uint32_t destLineLength = m_fixedMode.line_length;
 	for (uint32_t line = 0; line < height; ++line) {
-		memcpy(dest, data, srcLineLength);
+		memcpy(dest, data, copyLength);
 		dest += destLineLength;
 		data += srcLineLength;
 	}
 }
 
-void Framebuffer::blit_R8G8B8X8(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat)
+void Framebuffer::blit_R8G8B8X8(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat, uint32_t srcLineLength)
 {
-	const uint32_t srcLineLength = width * pixelFormatInfo[sourceFormat].bytesPerPixel;
-	uint32_t * dest = reinterpret_cast<uint32_t *>(m_frameBuffer + (y + m_currentMode.yoffset) * m_fixedMode.line_length + (x + m_currentMode.xoffset) * m_formatInfo.bytesPerPixel);
+	uint32_t * dest = reinterpret_cast<uint32_t *>(pixelAddress(x, y));
 	const uint32_t destLineLength = m_fixedMode.line_length / 4;
 	//check source format
 	if (sourceFormat == GREY8) {
@@ -399,7 +1034,11 @@ void Framebuffer::blit_R8G8B8X8(uint32_t x, uint32_t y, const uint8_t * data, ui
 			uint32_t * destLine = dest;
 			const uint16_t * srcLine = (const uint16_t *)data;
 			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine++, srcLine++) {
-				*destLine = (*srcLine & 0x7c00) << 14 | (*srcLine & 0x3e0) << 11 | (*srcLine & 0x1f) << 8 | 0xff;
+				//replicate upper bits into lower bits like PixelOps::unpackLine, so white stays white
+				const uint32_t red = (*srcLine >> 10) & 0x1f;
+				const uint32_t green = (*srcLine >> 5) & 0x1f;
+				const uint32_t blue = *srcLine & 0x1f;
+				*destLine = (red << 3 | red >> 2) << 24 | (green << 3 | green >> 2) << 16 | (blue << 3 | blue >> 2) << 8 | 0xff;
 			}
 			dest += destLineLength;
 			data += srcLineLength;
@@ -410,7 +1049,10 @@ void Framebuffer::blit_R8G8B8X8(uint32_t x, uint32_t y, const uint8_t * data, ui
 			uint32_t * destLine = dest;
 			const uint16_t * srcLine = (const uint16_t *)data;
 			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine++, srcLine++) {
-				*destLine = (*srcLine & 0xf800) << 14 | (*srcLine & 0x7e0) << 11 | (*srcLine & 0x1f) << 8 | 0xff;
+				const uint32_t red = (*srcLine >> 11) & 0x1f;
+				const uint32_t green = (*srcLine >> 5) & 0x3f;
+				const uint32_t blue = *srcLine & 0x1f;
+				*destLine = (red << 3 | red >> 2) << 24 | (green << 2 | green >> 4) << 16 | (blue << 3 | blue >> 2) << 8 | 0xff;
 			}
 			dest += destLineLength;
 			data += srcLineLength;
@@ -440,10 +1082,9 @@ void Framebuffer::blit_R8G8B8X8(uint32_t x, uint32_t y, const uint8_t * data, ui
 	}
 }
 
-void Framebuffer::blit_X8R8G8B8(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat)
+void Framebuffer::blit_X8R8G8B8(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat, uint32_t srcLineLength)
 {
-	const uint32_t srcLineLength = width * pixelFormatInfo[sourceFormat].bytesPerPixel;
-	uint32_t * dest = reinterpret_cast<uint32_t *>(m_frameBuffer + (y + m_currentMode.yoffset) * m_fixedMode.line_length + (x + m_currentMode.xoffset) * m_formatInfo.bytesPerPixel);
+	uint32_t * dest = reinterpret_cast<uint32_t *>(pixelAddress(x, y));
 	const uint32_t destLineLength = m_fixedMode.line_length / 4;
 	//check source format
 	if (sourceFormat == GREY8) {
@@ -461,8 +1102,11 @@ void Framebuffer::blit_X8R8G8B8(uint32_t x, uint32_t y, const uint8_t * data, ui
 		for (uint32_t line = 0; line < height; ++line) {
 			uint32_t * destLine = dest;
 			const uint16_t * srcLine = (const uint16_t *)data;
-			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine++, srcLine += 2) {
-				*destLine = 0xff000000 | (*srcLine & 0x7c00) << 6 | (*srcLine & 0x3e0) << 3 | (*srcLine & 0x1f);
+			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine++, srcLine++) {
+				const uint32_t red = (*srcLine >> 10) & 0x1f;
+				const uint32_t green = (*srcLine >> 5) & 0x1f;
+				const uint32_t blue = *srcLine & 0x1f;
+				*destLine = 0xff000000 | (red << 3 | red >> 2) << 16 | (green << 3 | green >> 2) << 8 | (blue << 3 | blue >> 2);
 			}
 			dest += destLineLength;
 			data += srcLineLength;
@@ -472,8 +1116,11 @@ void Framebuffer::blit_X8R8G8B8(uint32_t x, uint32_t y, const uint8_t * data, ui
 		for (uint32_t line = 0; line < height; ++line) {
 			uint32_t * destLine = dest;
 			const uint16_t * srcLine = (const uint16_t *)data;
-			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine++, srcLine += 2) {
-				*destLine = 0xff000000 | (*srcLine & 0xf800) << 5 | (*srcLine & 0x7e0) << 3 | (*srcLine & 0x1f);
+			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine++, srcLine++) {
+				const uint32_t red = (*srcLine >> 11) & 0x1f;
+				const uint32_t green = (*srcLine >> 5) & 0x3f;
+				const uint32_t blue = *srcLine & 0x1f;
+				*destLine = 0xff000000 | (red << 3 | red >> 2) << 16 | (green << 2 | green >> 4) << 8 | (blue << 3 | blue >> 2);
 			}
 			dest += destLineLength;
 			data += srcLineLength;
@@ -503,10 +1150,9 @@ void Framebuffer::blit_X8R8G8B8(uint32_t x, uint32_t y, const uint8_t * data, ui
 	}
 }
 
-void Framebuffer::blit_R8G8B8(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat)
+void Framebuffer::blit_R8G8B8(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat, uint32_t srcLineLength)
 {
-	const uint32_t srcLineLength = width * pixelFormatInfo[sourceFormat].bytesPerPixel;
-	uint8_t * dest = m_frameBuffer + (y + m_currentMode.yoffset) * m_fixedMode.line_length + (x + m_currentMode.xoffset) * m_formatInfo.bytesPerPixel;
+	uint8_t * dest = pixelAddress(x, y);
 	const uint32_t destLineLength = m_fixedMode.line_length;
 	//check source format
 	if (sourceFormat == GREY8) {
@@ -522,27 +1168,33 @@ void Framebuffer::blit_R8G8B8(uint32_t x, uint32_t y, const uint8_t * data, uint
 			data += srcLineLength;
 		}
 	}
-	if (sourceFormat == X1R5G5B5) {
+	else if (sourceFormat == X1R5G5B5) {
 		for (uint32_t line = 0; line < height; ++line) {
 			uint8_t * destLine = dest;
 			const uint16_t * srcLine = (const uint16_t *)data;
-			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine++, srcLine += 2) {
-				destLine[0] = (*srcLine & 0x7c00) >> 10;
-				destLine[1] = (*srcLine & 0x03e0) >> 5;
-				destLine[2] = (*srcLine & 0x001f);
+			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine+=3, srcLine++) {
+				const uint8_t red = (*srcLine >> 10) & 0x1f;
+				const uint8_t green = (*srcLine >> 5) & 0x1f;
+				const uint8_t blue = *srcLine & 0x1f;
+				destLine[0] = blue << 3 | blue >> 2;
+				destLine[1] = green << 3 | green >> 2;
+				destLine[2] = red << 3 | red >> 2;
 			}
 			dest += destLineLength;
 			data += srcLineLength;
 		}
 	}
-	if (sourceFormat == R5G6B5) {
+	else if (sourceFormat == R5G6B5) {
 		for (uint32_t line = 0; line < height; ++line) {
 			uint8_t * destLine = dest;
 			const uint16_t * srcLine = (const uint16_t *)data;
-			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine++, srcLine += 2) {
-				destLine[0] = (*srcLine & 0xf800) >> 11;
-				destLine[1] = (*srcLine & 0x07e0) >> 5;
-				destLine[2] = (*srcLine & 0x001f);
+			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine+=3, srcLine++) {
+				const uint8_t red = (*srcLine >> 11) & 0x1f;
+				const uint8_t green = (*srcLine >> 5) & 0x3f;
+				const uint8_t blue = *srcLine & 0x1f;
+				destLine[0] = blue << 3 | blue >> 2;
+				destLine[1] = green << 2 | green >> 4;
+				destLine[2] = red << 3 | red >> 2;
 			}
 			dest += destLineLength;
 			data += srcLineLength;
@@ -553,9 +1205,9 @@ void Framebuffer::blit_R8G8B8(uint32_t x, uint32_t y, const uint8_t * data, uint
 			uint8_t * destLine = dest;
 			const uint32_t * srcLine = (uint32_t *)data;
 			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine+=3, srcLine++) {
-				destLine[0] = srcLine[3];
-				destLine[1] = srcLine[2];
-				destLine[2] = srcLine[1];
+				destLine[0] = *srcLine >> 8;
+				destLine[1] = *srcLine >> 16;
+				destLine[2] = *srcLine >> 24;
 			}
 			dest += destLineLength;
 			data += srcLineLength;
@@ -566,9 +1218,9 @@ void Framebuffer::blit_R8G8B8(uint32_t x, uint32_t y, const uint8_t * data, uint
 			uint8_t * destLine = dest;
 			const uint32_t * srcLine = (uint32_t *)data;
 			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine+=3, srcLine++) {
-				destLine[0] = srcLine[2];
-				destLine[1] = srcLine[1];
-				destLine[2] = srcLine[0];
+				destLine[0] = *srcLine;
+				destLine[1] = *srcLine >> 8;
+				destLine[2] = *srcLine >> 16;
 			}
 			dest += destLineLength;
 			data += srcLineLength;
@@ -576,10 +1228,9 @@ void Framebuffer::blit_R8G8B8(uint32_t x, uint32_t y, const uint8_t * data, uint
 	}
 }
 
-void Framebuffer::blit_X1R5G5B5(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat)
+void Framebuffer::blit_X1R5G5B5(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat, uint32_t srcLineLength)
 {
-	const uint32_t srcLineLength = width * pixelFormatInfo[sourceFormat].bytesPerPixel;
-	uint16_t * dest = reinterpret_cast<uint16_t *>(m_frameBuffer + (y + m_currentMode.yoffset) * m_fixedMode.line_length + (x + m_currentMode.xoffset) * m_formatInfo.bytesPerPixel);
+	uint16_t * dest = reinterpret_cast<uint16_t *>(pixelAddress(x, y));
 	const uint32_t destLineLength = m_fixedMode.line_length / 2;
 	//check source format
 	if (sourceFormat == GREY8) {
@@ -593,7 +1244,7 @@ void Framebuffer::blit_X1R5G5B5(uint32_t x, uint32_t y, const uint8_t * data, ui
 			data += srcLineLength;
 		}
 	}
-	if (sourceFormat == R5G6B5) {
+	else if (sourceFormat == R5G6B5) {
 		for (uint32_t line = 0; line < height; ++line) {
 			uint16_t * destLine = dest;
 			const uint16_t * srcLine = (const uint16_t *)data;
@@ -639,10 +1290,9 @@ void Framebuffer::blit_X1R5G5B5(uint32_t x, uint32_t y, const uint8_t * data, ui
 	}
 }
 
-void Framebuffer::blit_R5G6B5(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat)
+void Framebuffer::blit_R5G6B5(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat, uint32_t srcLineLength)
 {
-	const uint32_t srcLineLength = width * pixelFormatInfo[sourceFormat].bytesPerPixel;
-	uint16_t * dest = reinterpret_cast<uint16_t *>(m_frameBuffer + (y + m_currentMode.yoffset) * m_fixedMode.line_length + (x + m_currentMode.xoffset) * m_formatInfo.bytesPerPixel);
+	uint16_t * dest = reinterpret_cast<uint16_t *>(pixelAddress(x, y));
 	const uint32_t destLineLength = m_fixedMode.line_length / 2;
 	//check source format
 	if (sourceFormat == GREY8) {
@@ -656,12 +1306,13 @@ void Framebuffer::blit_R5G6B5(uint32_t x, uint32_t y, const uint8_t * data, uint
 			data += srcLineLength;
 		}
 	}
-	if (sourceFormat == X1R5G5B5) {
+	else if (sourceFormat == X1R5G5B5) {
 		for (uint32_t line = 0; line < height; ++line) {
 			uint16_t * destLine = dest;
 			const uint16_t * srcLine = (const uint16_t *)data;
 			for (uint32_t pixel = 0; pixel < width; ++pixel, destLine++, srcLine++) {
-				*destLine = (*srcLine & 0x7ff0) << 1 | (*srcLine & 0x001f);
+				//the lowest green bit is the highest one, like when expanding to 8 bit and back
+				*destLine = (*srcLine & 0x7fe0) << 1 | (*srcLine >> 4 & 0x0020) | (*srcLine & 0x001f);
 			}
 			dest += destLineLength;
 			data += srcLineLength;
@@ -702,8 +1353,40 @@ void Framebuffer::blit_R5G6B5(uint32_t x, uint32_t y, const uint8_t * data, uint
 	}
 }
 
+void Framebuffer::blit_PALETTE8(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, Framebuffer::PixelFormat sourceFormat, uint32_t srcLineLength)
+{
+	//scanlines can be mapped independently, so spread them over all cores
+	auto mapLines = [&](size_t begin, size_t end) {
+		static thread_local std::vector<uint32_t> line;
+		line.resize(width);
+		for (size_t row = begin; row < end; ++row) {
+			const uint8_t * src = data + row * srcLineLength;
+			const uint32_t * pixels = reinterpret_cast<const uint32_t *>(src);
+			if (sourceFormat != X8R8G8B8) {
+				PixelOps::unpackLine(line.data(), src, sourceFormat, width);
+				pixels = line.data();
+			}
+			m_palette.mapLine(pixelAddress(x, y + row), pixels, width, x, y + row, m_dither);
+		}
+	};
+	if (m_threadPool) {
+		m_threadPool->parallelFor(height, mapLines);
+	}
+	else {
+		mapLines(0, height);
+	}
+}
+
 void Framebuffer::destroy()
 {
+	if (isVirtual()) {
+		//nothing to restore
+		m_frameBuffer = nullptr;
+		m_frameBufferSize = 0;
+		ImageBuffer().swap(m_memory);
+		return;
+	}
+
 	std::cout << "Closing framebuffer..." << std::endl;
 	
 	if (m_frameBuffer != nullptr && m_frameBuffer != MAP_FAILED) {
@@ -713,11 +1396,18 @@ void Framebuffer::destroy()
 	m_frameBufferSize = 0;
 
 	if (m_frameBufferDevice != 0) {
-		//reset old screen mode
-		ioctl(m_frameBufferDevice, FBIOPUT_VSCREENINFO, &m_oldMode);
-		m_frameBufferDevice = 0;
+		//reset old screen mode and palette
+		if (memcmp(&m_currentMode, &m_oldMode, sizeof(fb_var_screeninfo)) != 0) {
+			ioctl(m_frameBufferDevice, FBIOPUT_VSCREENINFO, &m_oldMode);
+		}
+		if (!m_oldColorMap.empty()) {
+			struct fb_cmap colorMap = {0, Palette::MAX_COLORS, m_oldColorMap.data(), m_oldColorMap.data() + Palette::MAX_COLORS, m_oldColorMap.data() + 2 * Palette::MAX_COLORS, nullptr};
+			ioctl(m_frameBufferDevice, FBIOPUTCMAP, &colorMap);
+			m_oldColorMap.clear();
+		}
 		//close device
 		close(m_frameBufferDevice);
+		m_frameBufferDevice = 0;
 	}
 }
 
@@ -1,14 +1,22 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <memory>
 #include <inttypes.h>
 #include <linux/fb.h>
 
+#include "scratchArena.h"
+#include "palette.h"
+#include "threadPool.h"
+#include "imageMemory.h"
+
 
 class Framebuffer
 {
 public:
-	enum PixelFormat { BAD_PIXELFORMAT, R8G8B8X8, X8R8G8B8, R8G8B8, X1R5G5B5, R5G6B5, GREY8 }; //!<The truecolor pixel formats we support.
+	enum PixelFormat { BAD_PIXELFORMAT, R8G8B8X8, X8R8G8B8, R8G8B8, X1R5G5B5, R5G6B5, GREY8, A8R8G8B8, PALETTE8, B8G8R8, X8B8G8R8, B8G8R8X8, B5G6R5, X1B5G5R5 }; //!<The pixel formats we support. A8R8G8B8 has premultiplied alpha and is only used as a source format. PALETTE8 pixels are indices into the palette of a pseudocolor framebuffer. Formats after PALETTE8 are converted by the generic kernels in \sa PixelOps. Devices with other channel layouts get formats after the named ones from \sa screenInfoToPixelFormat().
+	enum Orientation { ROTATE_0, ROTATE_90, ROTATE_180, ROTATE_270 }; //!<Clockwise rotation of the displayed image on the panel.
 	
 	/*! Structure holding some info about a pixel format. */
 	struct PixelFormatInfo
@@ -29,6 +37,15 @@ public:
 	
 	/*! List holding information about the different pixel formats in \sa PixelFormat. */
 	static const PixelFormatInfo pixelFormatInfo[];
+	/*! Number of entries in \sa pixelFormatInfo. */
+	static const size_t pixelFormatCount;
+
+	/*!
+	Get information about a pixel format. Unlike \sa pixelFormatInfo this also knows the formats added for the channel layouts of devices.
+	\param[in] format Pixel format.
+	\return Returns the info of the format or of BAD_PIXELFORMAT if the format is unknown.
+	*/
+	static const PixelFormatInfo & getPixelFormatInfo(PixelFormat format);
 
 	/*!
 	Construct framebuffer interface and switch to new mode.
@@ -42,54 +59,178 @@ public:
 	/*!
 	Construct framebuffer interface and open it with the current dimensions and bit depth.
 	\param[in] device Optional. Name of device to open.
+	\param[in] keepMode Optional. Pass true to use the framebuffer exactly as it is, e.g. to capture what another process displays.
+	The virtual resolution and the palette are not changed then.
+	*/
+	Framebuffer(const std::string & device = "/dev/fb0", bool keepMode = false);
+
+	/*!
+	Construct virtual framebuffer in memory. Useful for rendering frames for another device or for testing.
+	\param[in] width Width of framebuffer.
+	\param[in] height Height of framebuffer.
+	\param[in] format Pixel format of framebuffer. Must not be BAD_PIXELFORMAT.
+	\param[in] lineLength Optional. Length of a scanline in Bytes. Pass 0 for tightly packed scanlines.
 	*/
-	Framebuffer(const std::string & device = "/dev/fb0");
+	Framebuffer(uint32_t width, uint32_t height, PixelFormat format, uint32_t lineLength = 0);
 	
+	/*!
+	Find pixel format by its name.
+	\param[in] name Name of pixel format as in \sa PixelFormatInfo, e.g. "R5G6B5".
+	\return Returns the pixel format or BAD_PIXELFORMAT if the name is unknown.
+	*/
+	static PixelFormat pixelFormatFromString(const std::string & name);
+
 	/*!
 	Try to find out internal pixel format from framerbuffer var screen info.
+	If no named format has the channel layout, a format is added for it, e.g. for RGB666 in 24bit, RGB444 or 2-10-10-10 pixels. These formats are converted by the generic kernels.
 	\param[in] screenInfo Screen info to match.
-	\return Returns a matching PixelFormat or BAD_PIXELFORMAT.
+	\return Returns a matching PixelFormat or BAD_PIXELFORMAT if the layout can not be handled, e.g. because channels overlap.
 	*/
 	static PixelFormat screenInfoToPixelFormat(const struct fb_var_screeninfo & screenInfo);
 
 	/*!
-	Convert colors from one pixel format to another.
-	\param[in] destFormat Output color pixel format.
-	\param[in] source Input color source pointer.
-	\param[in] sourceFormat Input color pixel format.
-	\param[in] count Number of consecutive pixels to convert.
-	\return Returns a new buffer with the converted data. YOU have to delete [] it when you're done with it.
-	\note This is slow. Usage scenario is to convert a single color for clear() or convert a whole image once before blit()ting it multiple times.
+	Convert pixels from one pixel format to another into memory you provide. Does not allocate any memory.
+	\param[out] dest Output pixel data.
+	\param[in] destLineLength Length of an output scanline in Bytes. Pass 0 for tightly packed scanlines.
+	\param[in] destFormat Output pixel format.
+	\param[in] source Input pixel data.
+	\param[in] sourceLineLength Length of an input scanline in Bytes. Pass 0 for tightly packed scanlines.
+	\param[in] sourceFormat Input pixel format.
+	\param[in] width Number of pixels per scanline.
+	\param[in] height Optional. Number of scanlines.
+	\note Conversions from or to X8R8G8B8 are done in one pass. Other conversions go through 32bit in small chunks.
+	\note To convert a single color for clear(), pass a small array on the stack as \sa dest.
 	*/
-	static uint8_t * convertToPixelFormat(PixelFormat destFormat, const uint8_t * source, PixelFormat sourceFormat, size_t count = 1);
-	
+	static void convert(uint8_t * dest, uint32_t destLineLength, PixelFormat destFormat, const uint8_t * source, uint32_t sourceLineLength, PixelFormat sourceFormat, uint32_t width, uint32_t height = 1);
+
 	/*!
-	Convert colors from one pixel format to framebuffer format.
-	\param[in] source Input color source pointer.
-	\param[in] sourceFormat Input color pixel format.
-	\param[in] count Number of consecutive pixels to convert.
-	\return Returns a new buffer with the converted data. YOU have to delete [] it when you're done with it.
-	\note This is slow. Usage scenario is to convert a single color for clear() or convert a whole image once before blit()ting it multiple times.
+	Convert a color to framebuffer format, e.g. for \sa clear(). Uses the current palette of PALETTE8 framebuffers.
+	\param[out] dest Color in framebuffer format. Must have room for 4 Bytes.
+	\param[in] color X8R8G8B8 color.
 	*/
-	uint8_t * convertToFramebufferFormat(const uint8_t * source, PixelFormat sourceFormat, size_t count = 1);
-	
+	void convertColor(uint8_t * dest, uint32_t color) const;
+
+	/*!
+	Set the palette of a PALETTE8 framebuffer. Images drawn afterwards are mapped to it. A new framebuffer uses the fixed R3G3B2 palette.
+	\param[in] palette Palette to load, usually \sa Palette::fromImage() for the image to display.
+	\return Returns false if the framebuffer is not palettized or the driver did not accept the palette.
+	\note Pixels already drawn are not converted, so clear the framebuffer or redraw them.
+	*/
+	bool setPalette(const Palette & palette);
+
+	const Palette & getPalette() const;
+
+	/*!
+	Enable or disable ordered dithering when mapping pixels to the palette of a PALETTE8 framebuffer. Enabled by default.
+	*/
+	void setDithering(bool enabled);
+
+	bool isDithering() const;
+
 	/*!
 	Check if framebuffer interface is available.
 	\return Returns true if the framebuffer interface can be used.
 	*/
 	bool isAvailable() const;
 	
-	uint32_t getWidth() const;
-	uint32_t getHeight() const;
+	/*!
+	Set how images are oriented on the panel, e.g. for panels mounted in portrait.
+	All drawing functions and \sa getWidth() / \sa getHeight() use the rotated coordinate system from then on.
+	\param[in] orientation Clockwise rotation of the image.
+	\param[in] mirror Optional. Pass true to mirror the image horizontally before rotating it.
+	\note \sa getData() and \sa getLineLength() still describe the unrotated pixel data of the device.
+	*/
+	void setOrientation(Orientation orientation, bool mirror = false);
+
+	/*!
+	Rotate and mirror the current orientation further, e.g. to display an image upright that is stored sideways.
+	\param[in] orientation Clockwise rotation to add.
+	\param[in] mirror Optional. Pass true to mirror horizontally before rotating.
+	*/
+	void addOrientation(Orientation orientation, bool mirror = false);
+
+	Orientation getOrientation() const;
+	bool isMirrored() const;
+
+	/*!
+	Get transformation from device to drawing coordinates for an orientation. x = t[0] * deviceX + t[1] * deviceY + t[2], y = t[3] * deviceX + t[4] * deviceY + t[5].
+	\param[in] orientation Clockwise rotation of the image on the device.
+	\param[in] mirror Pass true if the image is mirrored horizontally before rotating.
+	\param[in] deviceWidth Width of the device.
+	\param[in] deviceHeight Height of the device.
+	\param[out] transform Upon return contains the transformation.
+	*/
+	static void getTransform(Orientation orientation, bool mirror, uint32_t deviceWidth, uint32_t deviceHeight, int32_t transform[6]);
+
+	uint32_t getWidth() const; //!<Width as seen by drawing functions. This is the panel height when rotated by 90 or 270 degrees.
+	uint32_t getHeight() const; //!<Height as seen by drawing functions. This is the panel width when rotated by 90 or 270 degrees.
 	PixelFormat getFormat() const;
 	PixelFormatInfo getFormatInfo() const;
+	uint32_t getLineLength() const;
 
 	/*!
-	Fill rect in framebuffer at position.
+	Check if this is a virtual framebuffer in memory.
+	*/
+	bool isVirtual() const;
+
+	/*!
+	Get raw pixel data of the page being drawn to. Scanlines are \sa getLineLength() Bytes apart.
+	\note Reading from a real framebuffer device can be very slow, because its memory is usually not cached.
+	*/
+	const uint8_t * getData() const;
+
+	/*!
+	Read back what the panel displays and convert it to another pixel format, e.g. for screenshots or to compare against a reference image.
+	\param[out] dest Converted pixels.
+	\param[in] destLineLength Length of a scanline of dest in Bytes. Pass 0 for tightly packed scanlines.
+	\param[in] destFormat Pixel format to convert to. PALETTE8 framebuffers are read back through their palette.
+	\param[in] x Horizontal position of the rectangle on the panel.
+	\param[in] y Vertical position of the rectangle on the panel.
+	\param[in] width Width of the rectangle. Clipped to the panel.
+	\param[in] height Height of the rectangle. Clipped to the panel.
+	\return Returns false if the framebuffer is not available or the rectangle is outside of the panel.
+	\note Coordinates are as the panel is scanned out, not rotated by \sa setOrientation(). The page that is displayed is read, not the one being drawn to.
+	Video memory is read in big sequential copies, which is a lot faster than reading it pixel by pixel if it is not cached.
+	*/
+	bool readback(uint8_t * dest, uint32_t destLineLength, PixelFormat destFormat, uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+
+	/*!
+	Read back what the panel displays. See \sa readback() above.
+	\param[in, out] width Width of the rectangle. Upon return contains the clipped width.
+	\param[in, out] height Height of the rectangle. Upon return contains the clipped height.
+	\param[in] format Optional. Pixel format to convert to.
+	\return Returns the tightly packed pixels or an empty vector on failure.
+	*/
+	ImageBuffer readback(uint32_t x, uint32_t y, uint32_t & width, uint32_t & height, PixelFormat format = X8R8G8B8) const;
+
+	/*!
+	Read pixels of the page being drawn to, e.g. to save what is under something that is drawn only temporarily.
+	\param[out] dest X8R8G8B8 pixels, tightly packed.
+	\param[in] x Horizontal position of the rectangle.
+	\param[in] y Vertical position of the rectangle.
+	\param[in] width Width of the rectangle.
+	\param[in] height Height of the rectangle.
+	\return Returns false if the rectangle is not completely inside the framebuffer.
+	\note Unlike \sa readback() this uses drawing coordinates, so the pixels can be drawn back with \sa blit(). Video memory can be slow to read, so only read small areas.
+	*/
+	bool readRect(uint32_t * dest, uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+
+	/*!
+	Fill whole framebuffer with color.
 	\param[in] color Pointer to raw color data. MUST BE IN FRAMEBUFFER PIXEL FORMAT!
 	*/
 	void clear(const uint8_t * color);
 
+	/*!
+	Fill rect in framebuffer at position.
+	\param[in] x Horizontal position of rectangle in framebuffer.
+	\param[in] y Vertical position of rectangle in framebuffer.
+	\param[in] width Width of rectangle in pixels.
+	\param[in] height Height of rectangle in pixels.
+	\param[in] color Pointer to raw color data. MUST BE IN FRAMEBUFFER PIXEL FORMAT!
+	*/
+	void fillRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const uint8_t * color);
+
 	/*!
 	Draw raw image to framebuffer at position.
 	\param[in] x Horizontal position where to draw image in framebuffer.
@@ -98,19 +239,88 @@ public:
 	\param[in] width Width of source image in pixels.
 	\param[in] height Height of source image in pixels.
 	\param[in] sourceFormat Source \sa data pixel format.
+	\param[in] sourceLineLength Optional. Length of a source scanline in Bytes. Pass 0 for tightly packed data.
 	\note Should work for 32/24/16/15 bit pixel formats.
+	\note To blit a sub-rectangle of a bigger image, point \sa data to its top-left pixel and pass the line length of the whole image.
 	*/
-	void blit(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, PixelFormat sourceFormat);
+	void blit(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, PixelFormat sourceFormat, uint32_t sourceLineLength = 0);
+
+	/*!
+	Blend raw image with alpha channel over framebuffer at position.
+	\param[in] x Horizontal position where to draw image in framebuffer.
+	\param[in] y Vertical position where to draw image in framebuffer.
+	\param[in] data Pointer to raw source image data. MUST BE PREMULTIPLIED A8R8G8B8! See \sa PixelOps::premultiplyAlpha.
+	\param[in] width Width of source image in pixels.
+	\param[in] height Height of source image in pixels.
+	\param[in] opacity Optional. Global opacity applied to the whole image. 255 is opaque.
+	\param[in] sourceLineLength Optional. Length of a source scanline in Bytes. Pass 0 for tightly packed data.
+	\note Blending needs to read back framebuffer memory, which can be slow. Compose in memory with \sa LayerStack if you have multiple layers.
+	*/
+	void blitBlend(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, uint8_t opacity = 255, uint32_t sourceLineLength = 0);
 	
+	/*!
+	Try to switch to double buffering. All drawing goes to a hidden back page from then on and \sa flip() displays it.
+	\return Returns true if the driver supports a virtual screen twice the screen height and panning.
+	*/
+	bool enablePageFlipping();
+
+	bool isPageFlipping() const;
+
+	/*!
+	Wait for the next vertical blank.
+	\return Returns false if the driver does not support waiting for vertical blank.
+	*/
+	bool waitForVsync();
+
+	/*!
+	Display what has been drawn. With page flipping the back page is displayed and the pages are swapped, else this just waits for vertical blank.
+	\note Drawing after a flip goes to the other page, which still contains the frame before the last one.
+	*/
+	void flip();
+
 	~Framebuffer();
 	
 private:
-	void blit_copy(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height);
-	void blit_R8G8B8X8(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height, PixelFormat sourceFormat);
-	void blit_X8R8G8B8(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height, PixelFormat sourceFormat);
-	void blit_R8G8B8(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height, PixelFormat sourceFormat);
-	void blit_X1R5G5B5(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height, PixelFormat sourceFormat);
-	void blit_R5G6B5(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height, PixelFormat sourceFormat);
+	/*!
+	Get address of pixel in the page being drawn to.
+	*/
+	uint8_t * pixelAddress(uint32_t x, uint32_t y) const;
+
+	/*!
+	Convert a scanline of the framebuffer to X8R8G8B8. PALETTE8 pixels are looked up in the palette of the framebuffer.
+	*/
+	void unpackLine(uint32_t * dest, const uint8_t * source, PixelFormat sourceFormat, uint32_t count) const;
+
+	/*!
+	Convert a X8R8G8B8 scanline to framebuffer format. PALETTE8 framebuffers map it to their palette.
+	\param[in] deviceX Horizontal position of the scanline in device coordinates. Selects the dither pattern.
+	\param[in] deviceY Vertical position of the scanline in device coordinates. Selects the dither pattern.
+	*/
+	void packLine(uint8_t * dest, const uint32_t * source, uint32_t count, uint32_t deviceX, uint32_t deviceY) const;
+
+	/*!
+	Get transformation from device to drawing coordinates for the current orientation.
+	*/
+	void getTransform(int32_t transform[6]) const;
+
+	/*!
+	Convert rectangle in drawing coordinates to device coordinates.
+	*/
+	void toDeviceRect(uint32_t & x, uint32_t & y, uint32_t & width, uint32_t & height) const;
+
+	/*!
+	Blit or blend rotated and/or mirrored image. Works on square tiles, so reading the source and writing scanlines of the device stay in the cache.
+	\note Parameters must already be clipped to the framebuffer dimensions. Blended sources must be premultiplied A8R8G8B8.
+	*/
+	void blit_oriented(uint32_t x, uint32_t y, const uint8_t * data, uint32_t width, uint32_t height, PixelFormat sourceFormat, uint32_t srcLineLength, bool blend, uint8_t opacity);
+
+	void blit_copy(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height, uint32_t srcLineLength);
+	void blit_R8G8B8X8(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height, PixelFormat sourceFormat, uint32_t srcLineLength);
+	void blit_X8R8G8B8(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height, PixelFormat sourceFormat, uint32_t srcLineLength);
+	void blit_R8G8B8(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height, PixelFormat sourceFormat, uint32_t srcLineLength);
+	void blit_X1R5G5B5(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height, PixelFormat sourceFormat, uint32_t srcLineLength);
+	void blit_R5G6B5(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height, PixelFormat sourceFormat, uint32_t srcLineLength);
+	void blit_PALETTE8(uint32_t x, uint32_t y, const unsigned char * data, uint32_t width, uint32_t height, PixelFormat sourceFormat, uint32_t srcLineLength);
 
 	/*!
 	Construct framebuffer interface and switch to new mode.
@@ -118,8 +328,9 @@ private:
 	\param[in] height Height of new framebuffer mode. If 0 uses current height.
 	\param[in] bitsPerPixel Bit depth of new framebuffer mode. If 0 uses current bit depth.
 	\param[in] device Name of device to open.
+	\param[in] keepMode Pass true to leave mode and palette as they are.
 	*/	
-	void create(uint32_t width, uint32_t height, uint32_t bitsPerPixel, const std::string & device);
+	void create(uint32_t width, uint32_t height, uint32_t bitsPerPixel, const std::string & device, bool keepMode);
 	
 	void destroy();
 
@@ -132,4 +343,16 @@ private:
 	struct fb_var_screeninfo m_oldMode; //!<Original framebuffer mode before mode switch.
 	struct fb_var_screeninfo m_currentMode; //!<New framebuffer mode while application is running.
 	struct fb_fix_screeninfo m_fixedMode; //!<Fixed mode information for various needs.
+	bool m_pageFlipping; //!<True if double buffering is enabled.
+	uint32_t m_drawOffsetY; //!<Vertical offset of the page being drawn to in the virtual screen.
+	Orientation m_orientation; //!<Rotation of drawing coordinates relative to the device.
+	bool m_mirror; //!<True if drawing coordinates are mirrored horizontally.
+
+	ImageBuffer m_memory; //!<Pixel data of a virtual framebuffer.
+	ScratchArena m_scratch; //!<Memory for temporary buffers, e.g. for unpacking framebuffer pixels when blending.
+
+	Palette m_palette; //!<Palette of a PALETTE8 framebuffer.
+	bool m_dither; //!<True if pixels are dithered when mapping them to the palette.
+	std::vector<uint16_t> m_oldColorMap; //!<Red, green and blue components of the original palette of the device for restoring it.
+	std::unique_ptr<ThreadPool> m_threadPool; //!<Threads mapping pixels to the palette of a PALETTE8 device.
 };
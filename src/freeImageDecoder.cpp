@@ -0,0 +1,146 @@
+#include "freeImageDecoder.h"
+
+#include <cstring>
+#include <algorithm>
+
+
+const char * FreeImageDecoder::getName() const
+{
+	return "FreeImage";
+}
+
+FREE_IMAGE_FORMAT FreeImageDecoder::getFormat(const MappedFile & file, FIMEMORY * fiMemory)
+{
+	FREE_IMAGE_FORMAT fif = FreeImage_GetFileTypeFromMemory(fiMemory, 0);
+	if (fif == FIF_UNKNOWN)
+	{
+		fif = FreeImage_GetFIFFromFilename(file.getFileName().c_str());
+	}
+	if (fif != FIF_UNKNOWN && !FreeImage_FIFSupportsReading(fif))
+	{
+		fif = FIF_UNKNOWN;
+	}
+	FreeImage_SeekMemory(fiMemory, 0, SEEK_SET);
+	return fif;
+}
+
+bool FreeImageDecoder::canDecode(const MappedFile & file) const
+{
+	//FreeImage only reads from the memory, but wants a non-const pointer
+	FIMEMORY * fiMemory = FreeImage_OpenMemory(const_cast<BYTE *>(file.getData()), file.getSize());
+	if (fiMemory == nullptr)
+	{
+		return false;
+	}
+	const bool readable = getFormat(file, fiMemory) != FIF_UNKNOWN;
+	FreeImage_CloseMemory(fiMemory);
+	return readable;
+}
+
+bool FreeImageDecoder::readInfo(const MappedFile & file, Info & info) const
+{
+	FIMEMORY * fiMemory = FreeImage_OpenMemory(const_cast<BYTE *>(file.getData()), file.getSize());
+	if (fiMemory == nullptr)
+	{
+		return false;
+	}
+	FIBITMAP * fiBitmap = nullptr;
+	const FREE_IMAGE_FORMAT fif = getFormat(file, fiMemory);
+	if (fif != FIF_UNKNOWN)
+	{
+		//formats that can not read only the header have to be decoded completely
+		fiBitmap = FreeImage_LoadFromMemory(fif, fiMemory, FreeImage_FIFSupportsNoPixels(fif) ? FIF_LOAD_NOPIXELS : 0);
+	}
+	if (fiBitmap != nullptr)
+	{
+		info.width = FreeImage_GetWidth(fiBitmap);
+		info.height = FreeImage_GetHeight(fiBitmap);
+		info.orientation = ImageIO::readOrientation(fiBitmap);
+		FreeImage_Unload(fiBitmap);
+	}
+	FreeImage_CloseMemory(fiMemory);
+	return fiBitmap != nullptr;
+}
+
+bool FreeImageDecoder::copyBitmap(FIBITMAP * fiBitmap, uint8_t * dest, uint32_t destLineLength)
+{
+	if (FreeImage_GetBPP(fiBitmap) != 32)
+	{
+		FIBITMAP * fiConverted = FreeImage_ConvertTo32Bits(fiBitmap);
+		FreeImage_Unload(fiBitmap);
+		fiBitmap = fiConverted;
+	}
+	if (fiBitmap == nullptr)
+	{
+		return false;
+	}
+	//FreeImage stores scanlines bottom-up
+	const uint32_t width = FreeImage_GetWidth(fiBitmap);
+	const uint32_t height = FreeImage_GetHeight(fiBitmap);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		memcpy(dest + (size_t)y * destLineLength, FreeImage_GetScanLine(fiBitmap, height - 1 - y), (size_t)width * 4);
+	}
+	FreeImage_Unload(fiBitmap);
+	return true;
+}
+
+bool FreeImageDecoder::decode(const MappedFile & file, uint8_t * dest, uint32_t destLineLength, uint32_t scaleDenominator) const
+{
+	if (scaleDenominator != 1)
+	{
+		return false;
+	}
+	FIMEMORY * fiMemory = FreeImage_OpenMemory(const_cast<BYTE *>(file.getData()), file.getSize());
+	if (fiMemory == nullptr)
+	{
+		return false;
+	}
+	FIBITMAP * fiBitmap = nullptr;
+	const FREE_IMAGE_FORMAT fif = getFormat(file, fiMemory);
+	if (fif != FIF_UNKNOWN)
+	{
+		fiBitmap = FreeImage_LoadFromMemory(fif, fiMemory);
+	}
+	FreeImage_CloseMemory(fiMemory);
+	return fiBitmap != nullptr && copyBitmap(fiBitmap, dest, destLineLength);
+}
+
+ImageBuffer FreeImageDecoder::decodePreview(const MappedFile & file, uint32_t minWidth, uint32_t minHeight, uint32_t & width, uint32_t & height) const
+{
+	ImageBuffer data;
+	FIMEMORY * fiMemory = FreeImage_OpenMemory(const_cast<BYTE *>(file.getData()), file.getSize());
+	if (fiMemory == nullptr)
+	{
+		return data;
+	}
+	//only formats that can read the header without the pixels have a fast preview
+	const FREE_IMAGE_FORMAT fif = getFormat(file, fiMemory);
+	FIBITMAP * fiHeader = (fif != FIF_UNKNOWN && FreeImage_FIFSupportsNoPixels(fif)) ? FreeImage_LoadFromMemory(fif, fiMemory, FIF_LOAD_NOPIXELS) : nullptr;
+	FIBITMAP * fiThumbnail = fiHeader != nullptr ? FreeImage_GetThumbnail(fiHeader) : nullptr;
+	if (fiThumbnail != nullptr)
+	{
+		width = FreeImage_GetWidth(fiThumbnail);
+		height = FreeImage_GetHeight(fiThumbnail);
+		//the preview must show the whole image, not a letterboxed or cropped version of it. allow 1% difference in aspect ratio
+		const uint64_t previewAspect = (uint64_t)width * FreeImage_GetHeight(fiHeader);
+		const uint64_t originalAspect = (uint64_t)FreeImage_GetWidth(fiHeader) * height;
+		const bool showsWholeImage = std::max(previewAspect, originalAspect) - std::min(previewAspect, originalAspect) <= originalAspect / 100;
+		if (showsWholeImage && width >= minWidth && height >= minHeight)
+		{
+			data.resize((size_t)width * height * 4);
+			//the thumbnail belongs to the header, so convert a copy of it
+			FIBITMAP * fiPreview = FreeImage_Clone(fiThumbnail);
+			if (fiPreview == nullptr || !copyBitmap(fiPreview, data.data(), width * 4))
+			{
+				data.clear();
+			}
+		}
+	}
+	if (fiHeader != nullptr)
+	{
+		FreeImage_Unload(fiHeader);
+	}
+	FreeImage_CloseMemory(fiMemory);
+	return data;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "decoder.h"
+
+
+/*!
+Decodes everything FreeImage can read. Used for the formats there is no direct decoder for.
+Formats that store a preview, e.g. camera raw files, return it from \sa decodePreview() without decoding the image.
+*/
+class FreeImageDecoder : public Decoder
+{
+public:
+	const char * getName() const override;
+	bool canDecode(const MappedFile & file) const override;
+	bool readInfo(const MappedFile & file, Info & info) const override;
+	bool decode(const MappedFile & file, uint8_t * dest, uint32_t destLineLength, uint32_t scaleDenominator = 1) const override;
+	ImageBuffer decodePreview(const MappedFile & file, uint32_t minWidth, uint32_t minHeight, uint32_t & width, uint32_t & height) const override;
+
+private:
+	/*!
+	Deduce the format of a file from its signature or, if that fails, its extension.
+	*/
+	static FREE_IMAGE_FORMAT getFormat(const MappedFile & file, FIMEMORY * fiMemory);
+
+	/*!
+	Convert a bitmap to 32bit and copy it to a buffer top-down.
+	\param[in] fiBitmap Decoded bitmap. It is unloaded by this function.
+	\param[out] dest Destination buffer. Must hold all scanlines of the bitmap.
+	\param[in] destLineLength Length of a destination scanline in Bytes.
+	\return Returns false if the bitmap could not be converted.
+	*/
+	static bool copyBitmap(FIBITMAP * fiBitmap, uint8_t * dest, uint32_t destLineLength);
+};
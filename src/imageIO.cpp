@@ -1,108 +1,321 @@
 #include "imageIO.h"
+#include "decoder.h"
 
 #include <iostream>
 #include <memory.h>
+#include <algorithm>
+#include <cstdio>
+#include <dirent.h>
+#include <sys/stat.h>
 
 
-std::vector<uint8_t> ImageIO::loadFile_RGBA32(const std::string & fileName, uint32_t & width, uint32_t & height, bool keepAspectRatio)
+ImageBuffer ImageIO::loadFile_RGBA32(const std::string & fileName, uint32_t & width, uint32_t & height, bool keepAspectRatio, Orientation * orientation)
 {
-	std::vector<uint8_t> rawData;
-	//check the file signature and deduce its format
-	FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(fileName.c_str(), 0);
-	if (fif == FIF_UNKNOWN) {
-		//try to guess the file format from the file extension
-		fif = FreeImage_GetFIFFromFilename(fileName.c_str());
-	}
-	//format ok? check that the plugin has reading capabilities ...
-	if ((fif != FIF_UNKNOWN) && FreeImage_FIFSupportsReading(fif)) {
-		//ok, let's load the file
-		FIBITMAP * fiBitmap = FreeImage_Load(fif, fileName.c_str());
-		if (fiBitmap != nullptr)
+	//map file, so the decoder reads from memory instead of doing lots of small blocking reads
+	const MappedFile file(fileName);
+	if (!file.isValid()) {
+		std::cout << "Error - Failed to open " << fileName << "!" << std::endl;
+		return ImageBuffer();
+	}
+	return loadFile_RGBA32(file, width, height, keepAspectRatio, orientation);
+}
+
+ImageBuffer ImageIO::loadFile_RGBA32(const MappedFile & file, uint32_t & width, uint32_t & height, bool keepAspectRatio, Orientation * orientation)
+{
+	//JPEG and PNG are decoded without FreeImage, straight into our buffer. if a decoder fails, e.g. on CMYK JPEGs, the next one that recognizes the file is tried
+	const Decoder * decoder = Decoder::find(file);
+	if (decoder == nullptr)
+	{
+		std::cout << "Error - File type unknown/unsupported!" << std::endl;
+		return ImageBuffer();
+	}
+	for (; decoder != nullptr; decoder = Decoder::find(file, decoder))
+	{
+		uint32_t decodedWidth = width;
+		uint32_t decodedHeight = height;
+		ImageBuffer rawData = loadDirect(*decoder, file, decodedWidth, decodedHeight, keepAspectRatio, orientation);
+		if (!rawData.empty())
 		{
-			//loaded. convert to 32bit if necessary
-			FIBITMAP * fiConverted = nullptr;
-			if (FreeImage_GetBPP(fiBitmap) != 32)
+			width = decodedWidth;
+			height = decodedHeight;
+			return rawData;
+		}
+	}
+	std::cout << "Error - Failed to load image!" << std::endl;
+	return ImageBuffer();
+}
+
+void ImageIO::fitToTarget(uint32_t imageWidth, uint32_t imageHeight, const Orientation & imageOrientation, uint32_t & width, uint32_t & height, bool keepAspectRatio)
+{
+	//no target size given. keep original image dimensions
+	if (width == 0 || height == 0)
+	{
+		width = imageWidth;
+		height = imageHeight;
+		return;
+	}
+	//the image is rotated when displayed. fit it to the rotated target size
+	if (swapsAxes(imageOrientation))
+	{
+		std::swap(width, height);
+	}
+	fitDimensions(imageWidth, imageHeight, width, height, keepAspectRatio);
+}
+
+void ImageIO::applyOrientation(ImageBuffer & data, uint32_t & width, uint32_t & height, const Orientation & imageOrientation, Orientation * orientation)
+{
+	//let caller display image rotated or rotate it ourselves
+	if (orientation != nullptr)
+	{
+		*orientation = imageOrientation;
+	}
+	else if (!data.empty() && (imageOrientation.rotation != Framebuffer::ROTATE_0 || imageOrientation.mirror))
+	{
+		data = orient_RGBA32(data, width, height, imageOrientation);
+	}
+}
+
+ImageBuffer ImageIO::loadDirect(const Decoder & decoder, const MappedFile & file, uint32_t & width, uint32_t & height, bool keepAspectRatio, Orientation * orientation)
+{
+	ImageBuffer rawData;
+	Decoder::Info info;
+	if (!decoder.readInfo(file, info))
+	{
+		return rawData;
+	}
+	fitToTarget(info.width, info.height, info.orientation, width, height, keepAspectRatio);
+	uint32_t decodedWidth = info.width;
+	uint32_t decodedHeight = info.height;
+	if (decoder.getMaxScaleDenominator() > 1)
+	{
+		//shrink as much as possible while decoding, but never so much that the image has to be scaled up again
+		uint32_t scaleDenominator = decoder.getMaxScaleDenominator();
+		while (scaleDenominator > 1 && (Decoder::scaledSize(info.width, scaleDenominator) < width || Decoder::scaledSize(info.height, scaleDenominator) < height))
+		{
+			scaleDenominator /= 2;
+		}
+		decodedWidth = Decoder::scaledSize(info.width, scaleDenominator);
+		decodedHeight = Decoder::scaledSize(info.height, scaleDenominator);
+		rawData.resize((size_t)decodedWidth * decodedHeight * 4);
+		if (!decoder.decode(file, rawData.data(), decodedWidth * 4, scaleDenominator))
+		{
+			return ImageBuffer();
+		}
+	}
+	else
+	{
+		//decoders that can not shrink while decoding may find an embedded preview that is big enough, which is much less work
+		if (width != info.width || height != info.height)
+		{
+			rawData = decoder.decodePreview(file, width, height, decodedWidth, decodedHeight);
+		}
+		if (rawData.empty())
+		{
+			decodedWidth = info.width;
+			decodedHeight = info.height;
+			rawData.resize((size_t)decodedWidth * decodedHeight * 4);
+			if (!decoder.decode(file, rawData.data(), decodedWidth * 4))
 			{
-				fiConverted = FreeImage_ConvertTo32Bits(fiBitmap);
-				if (fiConverted != nullptr)
-				{
-					//free original bitmap data
-					FreeImage_Unload(fiBitmap);
-					fiBitmap = fiConverted;
-				}
+				return ImageBuffer();
 			}
-			//convert image to raw RGBA data stream
-			if (fiBitmap != nullptr)
+		}
+	}
+	if (decodedWidth != width || decodedHeight != height)
+	{
+		rawData = resize_RGBA32(rawData, decodedWidth, decodedHeight, width, height, false);
+	}
+	applyOrientation(rawData, width, height, info.orientation, orientation);
+	return rawData;
+}
+
+bool ImageIO::saveFile_RGBA32(const std::string & fileName, const ImageBuffer & data, uint32_t width, uint32_t height)
+{
+	const FREE_IMAGE_FORMAT fif = FreeImage_GetFIFFromFilename(fileName.c_str());
+	if (fif == FIF_UNKNOWN || !FreeImage_FIFSupportsWriting(fif))
+	{
+		std::cout << "Error - Can not write " << fileName << ". File type unknown/unsupported!" << std::endl;
+		return false;
+	}
+	if (data.size() < (size_t)width * height * 4)
+	{
+		return false;
+	}
+	//our data is top-down, FreeImage bitmaps are bottom-up
+	FIBITMAP * fiBitmap = FreeImage_ConvertFromRawBits(const_cast<BYTE *>(data.data()), width, height, width * 4, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, TRUE);
+	if (fiBitmap == nullptr)
+	{
+		return false;
+	}
+	//e.g. JPEG can not store an alpha channel
+	if (!FreeImage_FIFSupportsExportBPP(fif, 32))
+	{
+		FIBITMAP * fiConverted = FreeImage_ConvertTo24Bits(fiBitmap);
+		FreeImage_Unload(fiBitmap);
+		fiBitmap = fiConverted;
+		if (fiBitmap == nullptr)
+		{
+			return false;
+		}
+	}
+	const bool saved = FreeImage_Save(fif, fiBitmap, fileName.c_str(), fif == FIF_PNG ? PNG_Z_BEST_SPEED : 0) == TRUE;
+	FreeImage_Unload(fiBitmap);
+	if (!saved)
+	{
+		std::cout << "Error - Failed to write " << fileName << "!" << std::endl;
+	}
+	return saved;
+}
+
+ImageBuffer ImageIO::loadPreview_RGBA32(const MappedFile & file, uint32_t & width, uint32_t & height, bool keepAspectRatio, Orientation * orientation)
+{
+	//e.g. an embedded preview of any size or a JPEG decoded at 1/8 scale
+	const Decoder * decoder = Decoder::find(file);
+	uint32_t previewWidth = 0;
+	uint32_t previewHeight = 0;
+	ImageBuffer rawData = decoder != nullptr ? decoder->decodePreview(file, 0, 0, previewWidth, previewHeight) : ImageBuffer();
+	Decoder::Info info;
+	if (rawData.empty() || !decoder->readInfo(file, info))
+	{
+		return ImageBuffer();
+	}
+	//scale the preview to exactly the size the full image will have, so the full image covers it
+	fitToTarget(info.width, info.height, info.orientation, width, height, keepAspectRatio);
+	rawData = resize_RGBA32(rawData, previewWidth, previewHeight, width, height, false);
+	applyOrientation(rawData, width, height, info.orientation, orientation);
+	return rawData;
+}
+
+void ImageIO::fitDimensions(uint32_t originalWidth, uint32_t originalHeight, uint32_t & width, uint32_t & height, bool keepAspectRatio)
+{
+	if (keepAspectRatio)
+	{
+		//make sure the image fits within width x height
+		const float originalAspect = (float)originalWidth / (float)originalHeight;
+		//check if adjusting the width gives acceptable new height
+		if (width / originalAspect <= height)
+		{
+			//zoom image to make width fit. heigth follows
+			const float zoomWidth = (float)width / (float)originalWidth;
+			height = zoomWidth * originalHeight;
+		}
+		//check if adjusting the height gives acceptable new width
+		else if (height * originalAspect <= width)
+		{
+			//zoom image to make height fit. width follows
+			const float zoomHeight = (float)height / (float)originalHeight;
+			width = zoomHeight * originalWidth;
+		}
+	}
+}
+
+ImageBuffer ImageIO::resize_RGBA32(const ImageBuffer & data, uint32_t originalWidth, uint32_t originalHeight, uint32_t & width, uint32_t & height, bool keepAspectRatio)
+{
+	fitDimensions(originalWidth, originalHeight, width, height, keepAspectRatio);
+	if (width == originalWidth && height == originalHeight)
+	{
+		return data;
+	}
+	ImageBuffer rawData;
+	//wrap data in bitmap. FreeImage only reads from it, but wants a non-const pointer
+	FIBITMAP * fiBitmap = FreeImage_ConvertFromRawBits(const_cast<BYTE *>(data.data()), originalWidth, originalHeight, originalWidth * 4, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, TRUE);
+	if (fiBitmap != nullptr)
+	{
+		//resample with the same filter as when loading
+		FIBITMAP * fiScaled = FreeImage_Rescale(fiBitmap, width, height, FILTER_BILINEAR);
+		if (fiScaled != nullptr)
+		{
+			//FreeImage stores scanlines bottom-up
+			rawData.resize(width * height * 4);
+			for (size_t i = 0; i < height; i++)
 			{
-				const uint32_t originalWidth = FreeImage_GetWidth(fiBitmap);
-				const uint32_t originalHeight = FreeImage_GetHeight(fiBitmap);
-				//smart resize image first if needed
-				if (fiBitmap != nullptr && (originalWidth != width || originalHeight != height))
-				{
-					if (keepAspectRatio)
-					{
-						//make sure the image fits within width x height
-						const float originalAspect = (float)originalWidth / (float)originalHeight;
-						//check if adjusting the width gives acceptable new height
-						if (width / originalAspect <= height)
-						{
-							//zoom image to make width fit. heigth follows
-							const float zoomWidth = (float)width / (float)originalWidth;
-							height = zoomWidth * originalHeight;
-						}
-						//check if adjusting the height gives acceptable new width
-						else if (height * originalAspect <= width)
-						{
-							//zoom image to make height fit. width follows
-							const float zoomHeight = (float)height / (float)originalHeight;
-							width = zoomHeight * originalWidth;
-						}
-					}
-					//now try to resample image with good filtering
-					FIBITMAP * fiScaled = FreeImage_Rescale(fiBitmap, width, height, FILTER_BILINEAR);//CATMULLROM);
-					if (fiScaled != nullptr)
-					{
-						//worked. delete old image and use scaled image in rest of function.
-						FreeImage_Unload(fiBitmap);
-						fiBitmap = fiScaled;
-					}
-				}
-				//flip image now about y-axis
-				FreeImage_FlipVertical(fiBitmap);
-				//const unsigned int pitch = FreeImage_GetPitch(fiBitmap);
-				//loop through scanlines and add all pixel data to the return vector
-				//this is necessary, because width*height*bpp might not be == pitch
-				unsigned char * tempData = new unsigned char[width * height * 4];
-				for (size_t i = 0; i < height; i++)
-				{
-					const BYTE * scanLine = FreeImage_GetScanLine(fiBitmap, i);
-					memcpy(tempData + (i * width * 4), scanLine, width * 4);
-				}
-				//convert from BGRA to RGBA
-				/*for(size_t i = 0; i < width*height; i++)
-				{
-					RGBQUAD bgra = ((RGBQUAD *)tempData)[i];
-					RGBQUAD rgba;
-					rgba.rgbBlue = bgra.rgbRed;
-					rgba.rgbGreen = bgra.rgbGreen;
-					rgba.rgbRed = bgra.rgbBlue;
-					rgba.rgbReserved = bgra.rgbReserved;
-					((RGBQUAD *)tempData)[i] = rgba;
-				}*/
-				rawData = std::vector<unsigned char>(tempData, tempData + width * height * 4);
-				//free bitmap data
-				FreeImage_Unload(fiBitmap);
-				delete[] tempData;
+				memcpy(rawData.data() + (i * width * 4), FreeImage_GetScanLine(fiScaled, height - 1 - i), width * 4);
 			}
+			FreeImage_Unload(fiScaled);
 		}
-		else
+		FreeImage_Unload(fiBitmap);
+	}
+	if (rawData.empty())
+	{
+		std::cout << "Error - Failed to resize image!" << std::endl;
+	}
+	return rawData;
+}
+
+ImageBuffer ImageIO::orient_RGBA32(const ImageBuffer & data, uint32_t & width, uint32_t & height, const Orientation & orientation)
+{
+	const uint32_t sourceWidth = width;
+	if (swapsAxes(orientation))
+	{
+		std::swap(width, height);
+	}
+	//walk destination scanlines and fetch the pixels from where they are in the source
+	int32_t t[6];
+	Framebuffer::getTransform(orientation.rotation, orientation.mirror, width, height, t);
+	ImageBuffer rawData(data.size());
+	const uint32_t * source = reinterpret_cast<const uint32_t *>(data.data());
+	uint32_t * dest = reinterpret_cast<uint32_t *>(rawData.data());
+	const int32_t step = t[0] + t[3] * (int32_t)sourceWidth;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const uint32_t * sourcePixel = source + (t[4] * (int32_t)y + t[5]) * (int32_t)sourceWidth + t[1] * (int32_t)y + t[2];
+		for (uint32_t x = 0; x < width; ++x, sourcePixel += step)
 		{
-			std::cout << "Error - Failed to load image!" << std::endl;
+			*dest++ = *sourcePixel;
 		}
 	}
-	else
+	return rawData;
+}
+
+bool ImageIO::swapsAxes(const Orientation & orientation)
+{
+	return orientation.rotation == Framebuffer::ROTATE_90 || orientation.rotation == Framebuffer::ROTATE_270;
+}
+
+ImageIO::Orientation ImageIO::readOrientation(FIBITMAP * fiBitmap)
+{
+	FITAG * tag = nullptr;
+	if (FreeImage_GetMetadata(FIMD_EXIF_MAIN, fiBitmap, "Orientation", &tag) && tag != nullptr && FreeImage_GetTagType(tag) == FIDT_SHORT && FreeImage_GetTagCount(tag) > 0)
 	{
-		std::cout << "Error - File type unknown/unsupported!" << std::endl;
+		return orientationFromExif(*static_cast<const WORD *>(FreeImage_GetTagValue(tag)));
 	}
-	return rawData;
+	return orientationFromExif(1);
+}
+
+ImageIO::Orientation ImageIO::orientationFromExif(uint32_t value)
+{
+	//EXIF orientation values 1-8 as rotation and mirroring
+	static const Orientation orientations[9] = {
+		{Framebuffer::ROTATE_0, false},
+		{Framebuffer::ROTATE_0, false}, {Framebuffer::ROTATE_0, true},
+		{Framebuffer::ROTATE_180, false}, {Framebuffer::ROTATE_180, true},
+		{Framebuffer::ROTATE_270, true}, {Framebuffer::ROTATE_90, false},
+		{Framebuffer::ROTATE_90, true}, {Framebuffer::ROTATE_270, false}
+	};
+	return orientations[value < 9 ? value : 0];
+}
+
+bool ImageIO::isImageFile(const std::string & fileName)
+{
+	const FREE_IMAGE_FORMAT fif = FreeImage_GetFIFFromFilename(fileName.c_str());
+	return (fif != FIF_UNKNOWN) && FreeImage_FIFSupportsReading(fif);
+}
+
+bool ImageIO::listImageFiles(const std::string & directoryName, std::vector<std::string> & fileNames)
+{
+	fileNames.clear();
+	DIR * directory = opendir(directoryName.c_str());
+	if (directory == nullptr) {
+		std::cout << "Failed to open directory " << directoryName << "!" << std::endl;
+		return false;
+	}
+	while (struct dirent * entry = readdir(directory)) {
+		const std::string name = entry->d_name;
+		struct stat info;
+		if (name[0] != '.' && stat((directoryName + "/" + name).c_str(), &info) == 0 && S_ISREG(info.st_mode) && isImageFile(name)) {
+			fileNames.push_back(name);
+		}
+	}
+	closedir(directory);
+	std::sort(fileNames.begin(), fileNames.end());
+	return true;
 }
@@ -1,21 +1,150 @@
-#pragma once
-
-#include <string>
-#include <vector>
-#include <FreeImage.h>
-
-
-class ImageIO
-{
-public:
-	/*!
-	Load image from file to 32bit RGBA data and resize to given dimensions.
-	\param[in] fileName Path to file to load.
-	\param[in, out] width Optional. Target width of image. Pass 0 to return original image dimensions. Upon return contains the actual image width.
-	\param[in, out] height Optional. Target height of image. Pass 0 to return original image dimensions. Upon return contains the actual image height.
-	\param[in] keepAspectRatio Optional. Pass true to keep the aspect ratio when resizing.
-	\return Returns the image data on success or an empty vector on failure.
-	\note When resizing with \sa keepAspectRatio makes the image fit completely inside the rectangle \sa width x \sa height.
-	*/
-	static std::vector<uint8_t> loadFile_RGBA32(const std::string & fileName, uint32_t & width, uint32_t & height, bool keepAspectRatio = true);
-};
+#pragma once
+
+#include <string>
+#include <vector>
+#include <FreeImage.h>
+
+#include "mappedFile.h"
+#include "framebuffer.h"
+#include "imageMemory.h"
+
+
+class Decoder;
+
+class ImageIO
+{
+public:
+	/*! How an image has to be rotated and mirrored to be displayed upright, e.g. as stored in its EXIF data. Mirroring is applied before rotating. */
+	struct Orientation
+	{
+		Framebuffer::Orientation rotation;
+		bool mirror;
+	};
+
+	/*!
+	Load image from file to 32bit RGBA data and resize to given dimensions.
+	\param[in] fileName Path to file to load.
+	\param[in, out] width Optional. Target width of image. Pass 0 to return original image dimensions. Upon return contains the actual image width.
+	\param[in, out] height Optional. Target height of image. Pass 0 to return original image dimensions. Upon return contains the actual image height.
+	\param[in] keepAspectRatio Optional. Pass true to keep the aspect ratio when resizing.
+	\param[out] orientation Optional. If passed, the image is returned as stored and its orientation is returned here, so it can be rotated while displaying it.
+	If nullptr, the image is rotated upright before returning it.
+	\return Returns the image data on success or an empty vector on failure.
+	\note The data is 32bit A8R8G8B8 with straight alpha. Images without alpha channel are opaque.
+	\note When resizing with \sa keepAspectRatio makes the image fit completely inside the rectangle \sa width x \sa height after it has been rotated upright.
+	\note Images are decoded by the first \sa Decoder that recognizes the file. JPEG and PNG files are decoded directly into the result
+	at the smallest scale that still is at least as big as the target size.
+	\note If an image in a format that can not be decoded at a smaller scale has an embedded preview that is big enough, only the preview is decoded.
+	JPEG files are always decoded, their EXIF thumbnails are not used.
+	*/
+	static ImageBuffer loadFile_RGBA32(const std::string & fileName, uint32_t & width, uint32_t & height, bool keepAspectRatio = true, Orientation * orientation = nullptr);
+
+	/*!
+	Load image from a file that is already in memory to 32bit RGBA data and resize to given dimensions.
+	Use this to decode files that have been fetched in the background. Parameters and return value are the same as above.
+	*/
+	static ImageBuffer loadFile_RGBA32(const MappedFile & file, uint32_t & width, uint32_t & height, bool keepAspectRatio = true, Orientation * orientation = nullptr);
+
+	/*!
+	Save 32bit RGBA data to an image file.
+	\param[in] fileName Path to file to write. The file format is deduced from the extension, e.g. ".png".
+	\param[in] data X8R8G8B8 image data, tightly packed.
+	\param[in] width Width of image data.
+	\param[in] height Height of image data.
+	\return Returns false if the format is unknown or the file could not be written.
+	\note PNG files are written with the fastest compression, so saving does not take much CPU time.
+	*/
+	static bool saveFile_RGBA32(const std::string & fileName, const ImageBuffer & data, uint32_t width, uint32_t height);
+
+	/*!
+	Quickly load a coarse version of an image, so something can be displayed while the full image decodes.
+	Uses \sa Decoder::decodePreview(), which decodes JPEG files at 1/8 scale and uses an embedded preview of any size for other formats, e.g. camera raw files.
+	Parameters are the same as for \sa loadFile_RGBA32. The preview is scaled to the same dimensions the full image will have, so the full image completely covers it.
+	\return Returns the image data on success or an empty vector if there is no fast way to preview the image.
+	*/
+	static ImageBuffer loadPreview_RGBA32(const MappedFile & file, uint32_t & width, uint32_t & height, bool keepAspectRatio = true, Orientation * orientation = nullptr);
+
+	/*!
+	Resize 32bit RGBA data the same way \sa loadFile_RGBA32 does.
+	\param[in] data Image data.
+	\param[in] originalWidth Width of image data.
+	\param[in] originalHeight Height of image data.
+	\param[in, out] width Target width of image. Upon return contains the actual image width.
+	\param[in, out] height Target height of image. Upon return contains the actual image height.
+	\param[in] keepAspectRatio Optional. Pass true to keep the aspect ratio when resizing.
+	\return Returns the resized image data on success or an empty vector on failure.
+	*/
+	static ImageBuffer resize_RGBA32(const ImageBuffer & data, uint32_t originalWidth, uint32_t originalHeight, uint32_t & width, uint32_t & height, bool keepAspectRatio = true);
+
+	/*!
+	Rotate and mirror 32bit image data.
+	\param[in] data Image data.
+	\param[in, out] width Width of image data. Upon return contains the width of the rotated image.
+	\param[in, out] height Height of image data. Upon return contains the height of the rotated image.
+	\param[in] orientation How to rotate and mirror the image.
+	\return Returns the rotated image data.
+	*/
+	static ImageBuffer orient_RGBA32(const ImageBuffer & data, uint32_t & width, uint32_t & height, const Orientation & orientation);
+
+	/*!
+	Calculate the dimensions an image is resized to by \sa loadFile_RGBA32.
+	\param[in] originalWidth Width of image.
+	\param[in] originalHeight Height of image.
+	\param[in, out] width Target width of image. Upon return contains the actual image width.
+	\param[in, out] height Target height of image. Upon return contains the actual image height.
+	\param[in] keepAspectRatio Pass true to keep the aspect ratio. If false \sa width and \sa height are not changed.
+	*/
+	static void fitDimensions(uint32_t originalWidth, uint32_t originalHeight, uint32_t & width, uint32_t & height, bool keepAspectRatio);
+
+	/*!
+	Check if a file looks like an image we can read by its extension. Does not access the file.
+	\param[in] fileName Name of file to check.
+	\return Returns true if the file extension belongs to a readable image format.
+	*/
+	static bool isImageFile(const std::string & fileName);
+
+	/*!
+	Find all image files in a directory by their extension. Hidden files and subdirectories are skipped.
+	\param[in] directoryName Directory to search.
+	\param[out] fileNames Upon return contains the names of the image files without the directory, sorted by name.
+	\return Returns false if the directory could not be read.
+	*/
+	static bool listImageFiles(const std::string & directoryName, std::vector<std::string> & fileNames);
+
+	/*!
+	Read EXIF orientation of an image.
+	\return Returns the orientation or no rotation if the image has no orientation tag.
+	*/
+	static Orientation readOrientation(FIBITMAP * fiBitmap);
+
+	/*!
+	Convert an EXIF orientation value to rotation and mirroring.
+	\param[in] value EXIF orientation 1-8.
+	\return Returns the orientation or no rotation if the value is invalid.
+	*/
+	static Orientation orientationFromExif(uint32_t value);
+
+private:
+	/*!
+	Check if an orientation swaps width and height.
+	*/
+	static bool swapsAxes(const Orientation & orientation);
+
+	/*!
+	Calculate the size an image is resized to like \sa loadFile_RGBA32 does. The target size is rotated like the image is when displayed.
+	\param[in, out] width Target width. Pass 0 to keep the image dimensions. Upon return contains the width of the resized, not yet oriented image.
+	\param[in, out] height Target height. Pass 0 to keep the image dimensions. Upon return contains the height of the resized, not yet oriented image.
+	*/
+	static void fitToTarget(uint32_t imageWidth, uint32_t imageHeight, const Orientation & imageOrientation, uint32_t & width, uint32_t & height, bool keepAspectRatio);
+
+	/*!
+	Return the orientation of an image to the caller or, if \sa orientation is nullptr, rotate the image upright.
+	*/
+	static void applyOrientation(ImageBuffer & data, uint32_t & width, uint32_t & height, const Orientation & imageOrientation, Orientation * orientation);
+
+	/*!
+	Decode an image with a decoder, resize and orient it like \sa loadFile_RGBA32 does.
+	\return Returns the image data or an empty vector if the decoder failed and the next one should be tried.
+	*/
+	static ImageBuffer loadDirect(const Decoder & decoder, const MappedFile & file, uint32_t & width, uint32_t & height, bool keepAspectRatio, Orientation * orientation);
+};
@@ -0,0 +1,148 @@
+#include "imageMemory.h"
+
+#include <iostream>
+#include <new>
+#include <atomic>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+
+//the flag is new in Linux 5.14. older kernels reject it and buffers are faulted in when they are touched
+#ifndef MADV_POPULATE_WRITE
+	#define MADV_POPULATE_WRITE 23
+#endif
+//explicit huge pages come in the default huge page size unless a size is asked for. older headers lack the size flags
+#ifndef MAP_HUGE_SHIFT
+	#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+	#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+
+ImageMemory::HugePages ImageMemory::m_hugePages = ImageMemory::TRANSPARENT;
+bool ImageMemory::m_locking = false;
+
+//buffers of at least a huge page always reserve whole huge pages, so they can be released without knowing how they were mapped
+static size_t mappingSize(size_t size)
+{
+	if (size < ImageMemory::HUGE_PAGE_SIZE) {
+		static const size_t pageSize = sysconf(_SC_PAGESIZE);
+		return (size + pageSize - 1) & ~(pageSize - 1);
+	}
+	return (size + ImageMemory::HUGE_PAGE_SIZE - 1) & ~(ImageMemory::HUGE_PAGE_SIZE - 1);
+}
+
+bool ImageMemory::isMapped(size_t size)
+{
+	return size >= HUGE_PAGE_SIZE || (m_locking && size >= LOCKABLE_SIZE);
+}
+
+bool ImageMemory::hugePagesFromString(const std::string & name, HugePages & hugePages)
+{
+	if (name == "none") {
+		hugePages = NONE;
+	}
+	else if (name == "transparent") {
+		hugePages = TRANSPARENT;
+	}
+	else if (name == "explicit") {
+		hugePages = EXPLICIT;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+void ImageMemory::setHugePages(HugePages hugePages)
+{
+	m_hugePages = hugePages;
+}
+
+void ImageMemory::setLocking(bool enabled)
+{
+	m_locking = enabled;
+}
+
+void * ImageMemory::allocate(size_t size)
+{
+	if (!isMapped(size)) {
+		return ::operator new(size);
+	}
+	const size_t length = mappingSize(size);
+	if (size < HUGE_PAGE_SIZE) {
+		//buffers that may be locked get pages of their own, so locking them never locks heap memory of other allocations
+		void * memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+		if (memory == MAP_FAILED) {
+			throw std::bad_alloc();
+		}
+		return memory;
+	}
+	if (m_hugePages == EXPLICIT) {
+		//huge pages from the pool are aligned and faulted in right away. ask for the size buffers are rounded to, in case the default is bigger
+		void * memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB | MAP_POPULATE, -1, 0);
+		if (memory != MAP_FAILED) {
+			return memory;
+		}
+	}
+	//map one huge page more than needed and cut off the ends, so the buffer starts at a huge page boundary
+	uint8_t * mapping = static_cast<uint8_t *>(mmap(nullptr, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (mapping == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+	uint8_t * memory = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(mapping) + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+	if (memory > mapping) {
+		munmap(mapping, memory - mapping);
+	}
+	munmap(memory + length, mapping + HUGE_PAGE_SIZE - memory);
+	//advise before faulting in, else the kernel uses small pages and only merges them much later
+	if (m_hugePages != NONE) {
+		madvise(memory, length, MADV_HUGEPAGE);
+	}
+	madvise(memory, size, MADV_POPULATE_WRITE);
+	return memory;
+}
+
+void ImageMemory::release(void * memory, size_t size)
+{
+	if (memory == nullptr) {
+		return;
+	}
+	if (!isMapped(size)) {
+		::operator delete(memory);
+	}
+	else {
+		//unmapping also releases a lock
+		munmap(memory, mappingSize(size));
+	}
+}
+
+void ImageMemory::discard(void * memory, size_t size, size_t length)
+{
+	if (memory == nullptr || size < HUGE_PAGE_SIZE) {
+		return;
+	}
+	//mapped buffers start at a huge page boundary, so whole huge pages are dropped without splitting any.
+	//locked or explicit huge pages may refuse this on older kernels. the memory is released with the buffer then
+	length = std::min(length, size) & ~(HUGE_PAGE_SIZE - 1);
+	if (length > 0) {
+		madvise(memory, length, MADV_DONTNEED);
+	}
+}
+
+bool ImageMemory::lock(const void * memory, size_t size)
+{
+	//smaller buffers come from the heap. locking them would lock pages shared with other allocations for good
+	if (!m_locking || memory == nullptr || size < LOCKABLE_SIZE) {
+		return false;
+	}
+	if (mlock(memory, size) != 0) {
+		static std::atomic<bool> warned(false);
+		if (!warned.exchange(true)) {
+			std::cout << "Failed to lock image memory. Raise the locked memory limit with \"ulimit -l\" or run with CAP_IPC_LOCK." << std::endl;
+		}
+		return false;
+	}
+	return true;
+}
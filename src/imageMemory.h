@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <inttypes.h>
+#include <cstddef>
+
+
+/*!
+Memory for big image buffers, like decoded images and full-screen frames.
+Buffers of at least \sa HUGE_PAGE_SIZE are mapped from the system directly instead of coming from the heap. They are aligned to huge pages
+and can be backed by them, so touching a full-screen image takes a few page faults and TLB entries instead of thousands. Mapped buffers are
+faulted in by the kernel in one go when they are allocated, on the CPU of the allocating thread, so their memory is local to that thread.
+Smaller buffers come from the heap as usual, except when locking is enabled. Then buffers of at least \sa LOCKABLE_SIZE are mapped too,
+so they can be locked without locking heap memory of other allocations.
+*/
+class ImageMemory
+{
+public:
+	enum HugePages { NONE, TRANSPARENT, EXPLICIT }; //!<NONE uses normal pages. TRANSPARENT asks the kernel for transparent huge pages. EXPLICIT uses the reserved pool of 2MB huge pages (/sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages, or vm.nr_hugepages if 2MB is the default size) and falls back to TRANSPARENT if it is empty.
+
+	static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024; //!<Size of a huge page on x86 and ARM with 4kB pages.
+	static const size_t LOCKABLE_SIZE = 64 * 1024; //!<Smallest buffer that \sa lock() locks.
+
+	/*!
+	Parse huge page mode.
+	\param[in] name One of "none", "transparent" or "explicit".
+	\param[out] hugePages Upon return contains the mode.
+	\return Returns false if the name is unknown.
+	*/
+	static bool hugePagesFromString(const std::string & name, HugePages & hugePages);
+
+	/*!
+	Set how buffers allocated from now on are backed. The default is TRANSPARENT.
+	\note Call this before any threads are started.
+	*/
+	static void setHugePages(HugePages hugePages);
+
+	/*!
+	Lock buffers into memory, so frames that must be displayed on time are never paged out. Allows \sa lock() to do something. Off by default.
+	\note Call this before any buffers are allocated, because it changes where buffers come from.
+	*/
+	static void setLocking(bool enabled);
+
+	/*!
+	Get memory for a buffer.
+	\return Returns memory aligned to at least 16 Bytes. Throws std::bad_alloc if there is no memory.
+	*/
+	static void * allocate(size_t size);
+
+	/*!
+	Release memory from \sa allocate(). The size must be the same that was allocated.
+	*/
+	static void release(void * memory, size_t size);
+
+	/*!
+	Give the memory at the start of a buffer back to the system when it is not needed anymore, while the rest of the buffer still is.
+	Only whole huge pages of buffers of at least \sa HUGE_PAGE_SIZE are given back. Heap buffers are left alone.
+	\param[in] memory Start of a buffer from \sa allocate().
+	\param[in] size Size of the buffer that was allocated.
+	\param[in] length Number of bytes at the start of the buffer that are not needed anymore. They read as zero afterwards.
+	*/
+	static void discard(void * memory, size_t size, size_t length);
+
+	/*!
+	Lock a buffer into memory if locking is enabled. The lock is released automatically when the buffer is released.
+	Buffers smaller than \sa LOCKABLE_SIZE come from the heap and are never locked.
+	Locked memory is limited by RLIMIT_MEMLOCK. If that is too small, a message is printed once and the buffer is left unlocked.
+	\param[in] memory Start of a buffer from \sa allocate().
+	\param[in] size Size of the buffer. Must not be bigger than the size that was allocated.
+	\return Returns true if the buffer was locked.
+	*/
+	static bool lock(const void * memory, size_t size);
+
+private:
+	/*!
+	Check if a buffer is mapped from the system instead of coming from the heap.
+	*/
+	static bool isMapped(size_t size);
+
+	static HugePages m_hugePages;
+	static bool m_locking;
+};
+
+/*!
+Allocator handing out \sa ImageMemory, so standard containers can hold image data.
+*/
+template <typename T>
+class ImageAllocator
+{
+public:
+	typedef T value_type;
+
+	ImageAllocator() {}
+
+	template <typename U>
+	ImageAllocator(const ImageAllocator<U> &) {}
+
+	T * allocate(size_t count)
+	{
+		return static_cast<T *>(ImageMemory::allocate(count * sizeof(T)));
+	}
+
+	void deallocate(T * memory, size_t count)
+	{
+		ImageMemory::release(memory, count * sizeof(T));
+	}
+};
+
+template <typename T, typename U>
+bool operator==(const ImageAllocator<T> &, const ImageAllocator<U> &) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const ImageAllocator<T> &, const ImageAllocator<U> &) { return false; }
+
+typedef std::vector<uint8_t, ImageAllocator<uint8_t>> ImageBuffer; //!<Buffer for image data. Use it for everything that can be as big as an image.
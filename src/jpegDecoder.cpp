@@ -0,0 +1,135 @@
+#include "jpegDecoder.h"
+
+#include <cstdio>
+#include <csetjmp>
+#include <cstring>
+#include <algorithm>
+#include <jpeglib.h>
+
+
+/*! libjpeg reports errors by calling error_exit, which must not return. We jump back to the decoding function instead. */
+struct JpegErrorManager
+{
+	jpeg_error_mgr manager;
+	jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr cinfo)
+{
+	longjmp(reinterpret_cast<JpegErrorManager *>(cinfo->err)->jump, 1);
+}
+
+static void jpegOutputMessage(j_common_ptr)
+{
+	//broken files fall back to FreeImage, which reports the error. do not spam the console with warnings
+}
+
+static void setupJpeg(jpeg_decompress_struct & cinfo, JpegErrorManager & errorManager, const MappedFile & file)
+{
+	cinfo.err = jpeg_std_error(&errorManager.manager);
+	errorManager.manager.error_exit = jpegErrorExit;
+	errorManager.manager.output_message = jpegOutputMessage;
+	jpeg_create_decompress(&cinfo);
+	jpeg_mem_src(&cinfo, file.getData(), file.getSize());
+}
+
+const char * JpegDecoder::getName() const
+{
+	return "libjpeg-turbo";
+}
+
+bool JpegDecoder::canDecode(const MappedFile & file) const
+{
+	const uint8_t * data = file.getData();
+	return file.getSize() > 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff;
+}
+
+bool JpegDecoder::readInfo(const MappedFile & file, Info & info) const
+{
+	jpeg_decompress_struct cinfo;
+	JpegErrorManager errorManager;
+	if (setjmp(errorManager.jump))
+	{
+		jpeg_destroy_decompress(&cinfo);
+		return false;
+	}
+	setupJpeg(cinfo, errorManager, file);
+	//keep APP1 markers, they contain the EXIF data
+	jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xffff);
+	jpeg_read_header(&cinfo, TRUE);
+	//CMYK can not be converted to RGB by libjpeg. leave that to FreeImage
+	const bool supported = cinfo.jpeg_color_space != JCS_CMYK && cinfo.jpeg_color_space != JCS_YCCK;
+	info.width = cinfo.image_width;
+	info.height = cinfo.image_height;
+	info.orientation = ImageIO::orientationFromExif(1);
+	for (jpeg_saved_marker_ptr marker = cinfo.marker_list; marker != nullptr; marker = marker->next)
+	{
+		if (marker->marker == JPEG_APP0 + 1 && marker->data_length > 6 && memcmp(marker->data, "Exif\0\0", 6) == 0)
+		{
+			info.orientation = readExifOrientation(marker->data + 6, marker->data_length - 6);
+			break;
+		}
+	}
+	jpeg_destroy_decompress(&cinfo);
+	return supported;
+}
+
+uint32_t JpegDecoder::getMaxScaleDenominator() const
+{
+	return 8;
+}
+
+bool JpegDecoder::decode(const MappedFile & file, uint8_t * dest, uint32_t destLineLength, uint32_t scaleDenominator) const
+{
+	jpeg_decompress_struct cinfo;
+	JpegErrorManager errorManager;
+	if (setjmp(errorManager.jump))
+	{
+		//this also frees the memory allocated from the decoder pools
+		jpeg_destroy_decompress(&cinfo);
+		return false;
+	}
+	setupJpeg(cinfo, errorManager, file);
+	jpeg_read_header(&cinfo, TRUE);
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = scaleDenominator;
+	//B,G,R,A in memory is X8R8G8B8 on little-endian machines. libjpeg sets the alpha byte to 0xff
+	cinfo.out_color_space = JCS_EXT_BGRA;
+	jpeg_start_decompress(&cinfo);
+	//read blocks of rows straight into the destination
+	while (cinfo.output_scanline < cinfo.output_height)
+	{
+		JSAMPROW rows[16];
+		const JDIMENSION count = std::min(cinfo.output_height - cinfo.output_scanline, (JDIMENSION)16);
+		for (JDIMENSION i = 0; i < count; ++i)
+		{
+			rows[i] = dest + (size_t)(cinfo.output_scanline + i) * destLineLength;
+		}
+		jpeg_read_scanlines(&cinfo, rows, count);
+	}
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	return true;
+}
+
+ImageBuffer JpegDecoder::decodePreview(const MappedFile & file, uint32_t minWidth, uint32_t minHeight, uint32_t & width, uint32_t & height) const
+{
+	//decoding at 1/8 scale only needs the DC coefficients of the DCT blocks
+	Info info;
+	if (!readInfo(file, info))
+	{
+		return ImageBuffer();
+	}
+	width = scaledSize(info.width, 8);
+	height = scaledSize(info.height, 8);
+	if (width < minWidth || height < minHeight)
+	{
+		return ImageBuffer();
+	}
+	ImageBuffer data((size_t)width * height * 4);
+	if (!decode(file, data.data(), width * 4, 8))
+	{
+		return ImageBuffer();
+	}
+	return data;
+}
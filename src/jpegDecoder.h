@@ -0,0 +1,19 @@
+#pragma once
+
+#include "decoder.h"
+
+
+/*!
+Decodes JPEG files with libjpeg-turbo. The decoder writes rows directly in the destination format and scales with the DCT
+by 1/2, 1/4 or 1/8, which only needs a fraction of the work. Previews are decoded at 1/8 scale. Embedded EXIF thumbnails are not used.
+*/
+class JpegDecoder : public Decoder
+{
+public:
+	const char * getName() const override;
+	bool canDecode(const MappedFile & file) const override;
+	bool readInfo(const MappedFile & file, Info & info) const override;
+	uint32_t getMaxScaleDenominator() const override;
+	bool decode(const MappedFile & file, uint8_t * dest, uint32_t destLineLength, uint32_t scaleDenominator = 1) const override;
+	ImageBuffer decodePreview(const MappedFile & file, uint32_t minWidth, uint32_t minHeight, uint32_t & width, uint32_t & height) const override;
+};
@@ -0,0 +1,173 @@
+#include "layerStack.h"
+#include "pixelOps.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+LayerStack::LayerStack(uint32_t width, uint32_t height, uint32_t backgroundColor)
+	: m_width(width)
+	, m_height(height)
+	, m_backgroundColor(0xff000000 | backgroundColor)
+	, m_composition(width * height)
+{
+	invalidate();
+}
+
+size_t LayerStack::addLayer(ImageBuffer && data, uint32_t width, uint32_t height, int32_t x, int32_t y, bool hasAlpha, uint8_t opacity)
+{
+	Layer layer;
+	layer.data = std::move(data);
+	layer.width = width;
+	layer.height = height;
+	layer.x = x;
+	layer.y = y;
+	layer.opacity = opacity;
+	layer.visible = true;
+	//convert layer to premultiplied alpha once, so compositing does not have to
+	uint32_t * pixels = reinterpret_cast<uint32_t *>(layer.data.data());
+	if (hasAlpha) {
+		layer.opaque = true;
+		for (size_t pixel = 0; pixel < width * height && layer.opaque; ++pixel) {
+			layer.opaque = (pixels[pixel] >> 24) == 255;
+		}
+		PixelOps::premultiplyAlpha(pixels, width * height);
+	}
+	else {
+		layer.opaque = true;
+		PixelOps::setOpaque(pixels, width * height);
+	}
+	m_layers.push_back(std::move(layer));
+	markDirty(m_layers.back());
+	return m_layers.size() - 1;
+}
+
+void LayerStack::setLayerPosition(size_t layer, int32_t x, int32_t y)
+{
+	if (m_layers[layer].x != x || m_layers[layer].y != y) {
+		//old and new area need to be redrawn
+		markDirty(m_layers[layer]);
+		m_layers[layer].x = x;
+		m_layers[layer].y = y;
+		markDirty(m_layers[layer]);
+	}
+}
+
+void LayerStack::setLayerOpacity(size_t layer, uint8_t opacity)
+{
+	if (m_layers[layer].opacity != opacity) {
+		m_layers[layer].opacity = opacity;
+		markDirty(m_layers[layer]);
+	}
+}
+
+void LayerStack::setLayerVisible(size_t layer, bool visible)
+{
+	if (m_layers[layer].visible != visible) {
+		m_layers[layer].visible = visible;
+		markDirty(m_layers[layer]);
+	}
+}
+
+void LayerStack::setBackgroundColor(uint32_t color)
+{
+	m_backgroundColor = 0xff000000 | color;
+	invalidate();
+}
+
+void LayerStack::invalidate()
+{
+	m_dirty.left = 0;
+	m_dirty.top = 0;
+	m_dirty.right = m_width;
+	m_dirty.bottom = m_height;
+}
+
+void LayerStack::markDirty(const Layer & layer)
+{
+	//clip layer area to composition
+	const int32_t left = std::max(layer.x, 0);
+	const int32_t top = std::max(layer.y, 0);
+	const int32_t right = std::min(layer.x + (int32_t)layer.width, (int32_t)m_width);
+	const int32_t bottom = std::min(layer.y + (int32_t)layer.height, (int32_t)m_height);
+	if (left >= right || top >= bottom) {
+		return;
+	}
+	//grow dirty area
+	if (m_dirty.left >= m_dirty.right || m_dirty.top >= m_dirty.bottom) {
+		m_dirty.left = left;
+		m_dirty.top = top;
+		m_dirty.right = right;
+		m_dirty.bottom = bottom;
+	}
+	else {
+		m_dirty.left = std::min(m_dirty.left, left);
+		m_dirty.top = std::min(m_dirty.top, top);
+		m_dirty.right = std::max(m_dirty.right, right);
+		m_dirty.bottom = std::max(m_dirty.bottom, bottom);
+	}
+}
+
+void LayerStack::compose()
+{
+	const uint32_t dirtyWidth = m_dirty.right - m_dirty.left;
+	//fill dirty area with background
+	for (int32_t line = m_dirty.top; line < m_dirty.bottom; ++line) {
+		uint32_t * dest = m_composition.data() + line * m_width + m_dirty.left;
+		std::fill(dest, dest + dirtyWidth, m_backgroundColor);
+	}
+	//blend layers bottom to top
+	for (auto layerIt = m_layers.cbegin(); layerIt != m_layers.cend(); ++layerIt) {
+		const Layer & layer = *layerIt;
+		if (!layer.visible || layer.opacity == 0) {
+			continue;
+		}
+		//intersect layer with dirty area
+		const int32_t left = std::max(layer.x, m_dirty.left);
+		const int32_t top = std::max(layer.y, m_dirty.top);
+		const int32_t right = std::min(layer.x + (int32_t)layer.width, m_dirty.right);
+		const int32_t bottom = std::min(layer.y + (int32_t)layer.height, m_dirty.bottom);
+		if (left >= right || top >= bottom) {
+			continue;
+		}
+		const uint32_t * source = reinterpret_cast<const uint32_t *>(layer.data.data());
+		for (int32_t line = top; line < bottom; ++line) {
+			uint32_t * destLine = m_composition.data() + line * m_width + left;
+			const uint32_t * srcLine = source + (line - layer.y) * layer.width + (left - layer.x);
+			if (layer.opaque && layer.opacity == 255) {
+				memcpy(destLine, srcLine, (right - left) * 4);
+			}
+			else {
+				PixelOps::blendLine(destLine, srcLine, right - left, layer.opacity);
+			}
+		}
+	}
+}
+
+void LayerStack::present(Framebuffer & framebuffer, uint32_t x, uint32_t y)
+{
+	if (m_dirty.left >= m_dirty.right || m_dirty.top >= m_dirty.bottom) {
+		return;
+	}
+	compose();
+	//send dirty area to framebuffer
+	const uint8_t * data = reinterpret_cast<const uint8_t *>(m_composition.data() + m_dirty.top * m_width + m_dirty.left);
+	framebuffer.blit(x + m_dirty.left, y + m_dirty.top, data, m_dirty.right - m_dirty.left, m_dirty.bottom - m_dirty.top, Framebuffer::X8R8G8B8, m_width * 4);
+	m_dirty.right = m_dirty.left;
+	m_dirty.bottom = m_dirty.top;
+}
+
+uint32_t LayerStack::getWidth() const
+{
+	return m_width;
+}
+
+uint32_t LayerStack::getHeight() const
+{
+	return m_height;
+}
+
+const uint8_t * LayerStack::getData() const
+{
+	return reinterpret_cast<const uint8_t *>(m_composition.data());
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "framebuffer.h"
+
+#include <vector>
+
+
+/*!
+Stack of image layers composited in normal (cached) memory before being sent to the framebuffer.
+The bottom of the stack is a solid background color, layers are blended on top of it in the order they were added.
+Only the area that changed since the last \sa present() is composited and blitted again.
+*/
+class LayerStack
+{
+public:
+	/*!
+	Construct layer stack.
+	\param[in] width Width of composition in pixels. Usually the framebuffer width.
+	\param[in] height Height of composition in pixels. Usually the framebuffer height.
+	\param[in] backgroundColor Optional. X8R8G8B8 background color.
+	*/
+	LayerStack(uint32_t width, uint32_t height, uint32_t backgroundColor = 0);
+
+	/*!
+	Add a layer on top of the stack.
+	\param[in] data 32bit image data, as returned by \sa ImageIO::loadFile_RGBA32. The stack takes ownership of the data.
+	\param[in] width Width of image in pixels.
+	\param[in] height Height of image in pixels.
+	\param[in] x Horizontal position of layer in composition. Negative values are allowed.
+	\param[in] y Vertical position of layer in composition. Negative values are allowed.
+	\param[in] hasAlpha Pass true if data is straight alpha A8R8G8B8, false if it is X8R8G8B8 and should be opaque.
+	\param[in] opacity Optional. Global opacity of the layer. 255 is opaque.
+	\return Returns the index of the new layer.
+	*/
+	size_t addLayer(ImageBuffer && data, uint32_t width, uint32_t height, int32_t x, int32_t y, bool hasAlpha, uint8_t opacity = 255);
+
+	void setLayerPosition(size_t layer, int32_t x, int32_t y);
+	void setLayerOpacity(size_t layer, uint8_t opacity);
+	void setLayerVisible(size_t layer, bool visible);
+	void setBackgroundColor(uint32_t color);
+
+	/*!
+	Mark the whole composition as changed, so the next \sa present() redraws everything.
+	*/
+	void invalidate();
+
+	/*!
+	Composite the changed area and blit it to the framebuffer.
+	\param[in] framebuffer Framebuffer to draw to.
+	\param[in] x Optional. Horizontal position of composition in framebuffer.
+	\param[in] y Optional. Vertical position of composition in framebuffer.
+	*/
+	void present(Framebuffer & framebuffer, uint32_t x = 0, uint32_t y = 0);
+
+	uint32_t getWidth() const;
+	uint32_t getHeight() const;
+
+	/*!
+	Get composited X8R8G8B8 image data. Call \sa present() first to make sure it is up to date.
+	*/
+	const uint8_t * getData() const;
+
+private:
+	/*! Rectangle with exclusive right and bottom coordinates. */
+	struct Rect
+	{
+		int32_t left;
+		int32_t top;
+		int32_t right;
+		int32_t bottom;
+	};
+
+	/*! A single layer. Data is always stored as premultiplied A8R8G8B8. */
+	struct Layer
+	{
+		ImageBuffer data;
+		uint32_t width;
+		uint32_t height;
+		int32_t x;
+		int32_t y;
+		uint8_t opacity;
+		bool opaque; //!<True if all pixels are opaque, so the layer can be copied instead of blended.
+		bool visible;
+	};
+
+	/*!
+	Add the area of a layer to the area that needs to be composited.
+	*/
+	void markDirty(const Layer & layer);
+
+	/*!
+	Composite the dirty area in memory.
+	*/
+	void compose();
+
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_backgroundColor;
+	std::vector<Layer> m_layers;
+	std::vector<uint32_t> m_composition; //!<Composited X8R8G8B8 image.
+	Rect m_dirty; //!<Area that changed since last \sa present().
+};
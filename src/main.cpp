@@ -2,32 +2,135 @@
 #include <string>
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <ctime>
 
 #include "framebuffer.h"
 #include "imageIO.h"
+#include "tilePyramid.h"
+#include "viewer.h"
+#include "layerStack.h"
+#include "slideshow.h"
+#include "prerender.h"
+#include "contactSheet.h"
+#include "displayGroup.h"
+#include "folderWatcher.h"
+#include "textRenderer.h"
+#include "benchmark.h"
+#include "terminalInput.h"
 
 
-std::string imageFile = "";
+std::vector<std::string> imageFiles;
 std::string frameBufferDevice = "";
 std::shared_ptr<Framebuffer> frameBuffer;
+std::unique_ptr<TextRenderer> textRenderer; //!<Draws caption, clock and statistics if any of them is enabled.
+size_t captionLabel = 0;
+size_t clockLabel = 0;
+size_t statsLabel = 0;
 
 bool oneshot = false;
 bool displayTwice = false;
+bool panZoom = false;
+std::vector<std::string> overlays; //!<Overlay specifications in the form FILE[@X,Y[,OPACITY]].
+Transition::Type transition = Transition::CROSSFADE;
+uint32_t transitionDuration = 1000; //!<Transition duration in milliseconds.
+uint32_t slideDelay = 5; //!<Display time of an image in a slideshow in seconds.
+uint32_t frameRate = 60; //!<Transition frame rate if page flipping is not available.
+Framebuffer::Orientation orientation = Framebuffer::ROTATE_0;
+bool mirror = false;
+bool dither = true; //!<Use ordered dithering on 8bit palettized framebuffers.
+bool progressive = false; //!<Display a coarse preview while the full image decodes.
+uint32_t wallColumns = 0; //!<Number of framebuffers per row of a video wall.
+uint32_t wallRows = 0; //!<Number of framebuffer rows of a video wall.
+std::string prerenderDirectory; //!<Directory of images to convert to raw frames.
+std::string prerenderOutput; //!<Directory to write raw frames to.
+std::string prerenderTarget; //!<Target framebuffer in the form WIDTHxHEIGHT@FORMAT[:LINELENGTH].
+std::string watchDirectory; //!<Directory to watch for new images.
+std::string gridDirectory; //!<Directory of images to display as thumbnails.
+std::string captureFile; //!<Image or raw frame file to save the contents of the framebuffer to.
+std::string benchmarkBaseline; //!<File with benchmark results to compare to.
+uint32_t benchmarkTolerance = 20; //!<How much worse than the baseline benchmark results may be in percent.
+bool checkOnly = false; //!<Only check the pixels of all drawing operations without measuring them.
+bool benchmarkRecord = false; //!<Write the benchmark results to the baseline file instead of comparing to it.
+std::string cpuList; //!<CPUs to run on, e.g. "2-3". Empty to run on all CPUs.
+bool showCaption = false; //!<Display the file name over the image.
+bool showClock = false; //!<Display the time over the image.
+bool showStats = false; //!<Display decoding and drawing times over the image.
 //bool autozoom = false;
 
 
 void printUsage()
 {
 	std::cout << "Usage:" << std::endl;
-	std::cout << "sfivt " << "[OPTIONS] <FRAMEBUFFER> <IMAGEFILE>" << "." << std::endl;
+	std::cout << "sfivt " << "[OPTIONS] <FRAMEBUFFER> <IMAGEFILE> [<IMAGEFILE> ...]" << "." << std::endl;
+	std::cout << "Pass multiple image files to display them as a slideshow." << std::endl;
+	std::cout << "Pass multiple framebuffers separated by commas to display an image on all of them, e.g. \"/dev/fb0,/dev/fb1\"." << std::endl;
+	std::cout << "sfivt " << "--prerender <DIRECTORY> --target <WIDTH>x<HEIGHT>@<FORMAT>[:<LINELENGTH>] [--output <DIRECTORY>]" << "." << std::endl;
+	std::cout << "Convert all images in a directory to raw frames that can be copied to a framebuffer as-is." << std::endl;
+	std::cout << "sfivt " << "[OPTIONS] --watch <DIRECTORY> <FRAMEBUFFER>" << "." << std::endl;
+	std::cout << "Display every new image written to a directory." << std::endl;
+	std::cout << "sfivt " << "--grid <DIRECTORY> [--output <DIRECTORY>] <FRAMEBUFFER>" << "." << std::endl;
+	std::cout << "Display all images in a directory as pages of thumbnails." << std::endl;
+	std::cout << "sfivt " << "--capture <FILE> <FRAMEBUFFER>" << "." << std::endl;
+	std::cout << "Save what the framebuffer displays to an image file or a raw frame." << std::endl;
+	std::cout << "sfivt " << "--benchmark <BASELINEFILE> [--record] [--tolerance <PERCENT>]" << "." << std::endl;
+	std::cout << "Check and measure drawing in all pixel formats on virtual framebuffers and compare to a baseline." << std::endl;
+	std::cout << "sfivt " << "--check" << "." << std::endl;
+	std::cout << "Only check the pixels drawn in all pixel formats on virtual framebuffers." << std::endl;
 	std::cout << "Options:" << std::endl;
 	std::cout << "-1" << " - One-shot. Display image and quit without waiting for <ENTER>." << std::endl;
 	std::cout << "-2" << " - Display image twice. Useful if your USB screen is buggy." << std::endl;
+	std::cout << "-p" << " - Pan and zoom. Display image in original size. Pan with cursor keys, zoom with +/-, fit with 0, quit with q." << std::endl;
 	//std::cout << "-a" << " - Auto-zoom. Fit image to framebuffer." << std::endl;
+	std::cout << "--rotate <DEGREES>" << " - Rotate display clockwise by 0, 90, 180 or 270 degrees, e.g. for panels mounted in portrait." << std::endl;
+	std::cout << "--mirror" << " - Mirror display horizontally. Applied before rotating." << std::endl;
+	std::cout << "--nodither" << " - Do not dither images on 8bit palettized framebuffers." << std::endl;
+	std::cout << "--progressive" << " - Display a coarse preview of the image first and replace it when the image is fully decoded. Prints the time to the first and the final image." << std::endl;
+	std::cout << "--overlay <FILE>[@X,Y[,OPACITY]]" << " - Blend an image with alpha channel over the image at X,Y. Negative values are relative to the right/bottom edge. Can be used multiple times." << std::endl;
+	std::cout << "--transition <TYPE>" << " - Slideshow transition. One of none, crossfade, wipe or slide. Default is crossfade." << std::endl;
+	std::cout << "--duration <MS>" << " - Slideshow transition duration in milliseconds. Default is 1000." << std::endl;
+	std::cout << "--delay <S>" << " - Slideshow image display time in seconds. Default is 5." << std::endl;
+	std::cout << "--fps <N>" << " - Transition frame rate if the framebuffer can not flip pages. Default is 60." << std::endl;
+	std::cout << "--wall <COLUMNS>x<ROWS>" << " - Arrange multiple framebuffers as a video wall, row by row in the order given. Each framebuffer displays its part of the image." << std::endl;
+	std::cout << "--prerender <DIRECTORY>" << " - Convert all images in DIRECTORY to raw frames in parallel. Unchanged images are skipped." << std::endl;
+	std::cout << "--target <WIDTH>x<HEIGHT>@<FORMAT>[:<LINELENGTH>]" << " - Framebuffer to prerender for. FORMAT is one of X8R8G8B8, R8G8B8X8, R8G8B8, X1R5G5B5, R5G6B5, B8G8R8, X8B8G8R8, B8G8R8X8, B5G6R5, X1B5G5R5, GREY8 or PALETTE8 (fixed R3G3B2 palette). LINELENGTH is in Bytes." << std::endl;
+	std::cout << "--output <DIRECTORY>" << " - Directory to write prerendered frames or grid thumbnails to. Default is <DIRECTORY>/prerendered or <DIRECTORY>/.thumbnails." << std::endl;
+	std::cout << "--capture <FILE>" << " - Save the framebuffer contents to FILE and exit. The format is deduced from the extension, e.g. .png. .raw files get the native format and line length of the framebuffer, like prerendered frames." << std::endl;
+	std::cout << "--benchmark <BASELINEFILE>" << " - Blit all pixel formats to all framebuffer formats in memory and check every pixel against a per-pixel reference, then check blending, interpolation and compositing layers the same way and display a PNG image in every format. Then measure throughput and peak memory use. "
+		<< "Fails if pixels are wrong, results are worse than in BASELINEFILE or BASELINEFILE does not exist." << std::endl;
+	std::cout << "--record" << " - Write the --benchmark results to BASELINEFILE instead of comparing to it. Fails only if pixels are wrong." << std::endl;
+	std::cout << "--tolerance <PERCENT>" << " - How much worse than the baseline the averaged benchmark results may be. Single format combinations fail if they are more than 50% worse. Default is 20." << std::endl;
+	std::cout << "--check" << " - Check pixels like --benchmark does, but do not measure anything." << std::endl;
+	std::cout << "--watch <DIRECTORY>" << " - Display the newest image whenever images are written or moved to DIRECTORY, until <ENTER> is pressed. Prints the time from arrival to display." << std::endl;
+	std::cout << "--grid <DIRECTORY>" << " - Display all images in DIRECTORY as thumbnails. Change pages with the cursor keys, space or page up/down, quit with q. Thumbnails are cached in the framebuffer format." << std::endl;
+	std::cout << "--cpus <LIST>" << " - Run decoding and conversion threads only on these CPUs, e.g. \"2-3,6\", to keep them away from latency-critical services." << std::endl;
+	std::cout << "--hugepages <MODE>" << " - How big image buffers are backed. One of none, transparent or explicit (reserved huge page pool). Default is transparent." << std::endl;
+	std::cout << "--lockframes" << " - Lock slideshow frames into memory, so they are never paged out. Needs a big enough \"ulimit -l\"." << std::endl;
+	std::cout << "--caption" << " - Display the file name at the bottom of the screen." << std::endl;
+	std::cout << "--clock" << " - Display the time in the top-right corner, updated every second." << std::endl;
+	std::cout << "--stats" << " - Display decoding and drawing times in the top-left corner." << std::endl;
 	std::cout << "e.g. \"sfivt -1 /dev/fb1 ~/foo/bar.png\"." << std::endl;
+	std::cout << "e.g. \"sfivt --prerender ~/foo --target 800x480@R5G6B5\"." << std::endl;
 	std::cout << "svift can read all formats that FreeImage can, so more or less: JPG/PNG/TIFF/BMP/TGA/GIF." << std::endl;
 }
 
+bool parseNumber(const char * text, uint32_t & value)
+{
+	char * end = nullptr;
+	const unsigned long number = strtoul(text, &end, 10);
+	if (end == text || *end != '\0') {
+		std::cout << "Bad number \"" << text << "\"!" << std::endl;
+		return false;
+	}
+	value = number;
+	return true;
+}
+
 bool parseCommandLine(int argc, char * argv[])
 {
 	//parse command line arguments
@@ -46,6 +149,122 @@ bool parseCommandLine(int argc, char * argv[])
 		else if (argument == "-2") {
 			displayTwice = true;
 		}
+		else if (argument == "-p") {
+			panZoom = true;
+		}
+		else if (argument == "--rotate" && i + 1 < argc) {
+			const std::string degrees = argv[++i];
+			if (degrees == "0") {
+				orientation = Framebuffer::ROTATE_0;
+			}
+			else if (degrees == "90") {
+				orientation = Framebuffer::ROTATE_90;
+			}
+			else if (degrees == "180") {
+				orientation = Framebuffer::ROTATE_180;
+			}
+			else if (degrees == "270") {
+				orientation = Framebuffer::ROTATE_270;
+			}
+			else {
+				std::cout << "Bad rotation \"" << degrees << "\"!" << std::endl;
+				return false;
+			}
+		}
+		else if (argument == "--mirror") {
+			mirror = true;
+		}
+		else if (argument == "--nodither") {
+			dither = false;
+		}
+		else if (argument == "--progressive") {
+			progressive = true;
+		}
+		else if (argument == "--overlay" && i + 1 < argc) {
+			overlays.push_back(argv[++i]);
+		}
+		else if (argument == "--transition" && i + 1 < argc) {
+			if (!Transition::typeFromString(argv[++i], transition)) {
+				std::cout << "Unknown transition \"" << argv[i] << "\"!" << std::endl;
+				return false;
+			}
+		}
+		else if (argument == "--duration" && i + 1 < argc) {
+			if (!parseNumber(argv[++i], transitionDuration)) {
+				return false;
+			}
+		}
+		else if (argument == "--delay" && i + 1 < argc) {
+			if (!parseNumber(argv[++i], slideDelay)) {
+				return false;
+			}
+		}
+		else if (argument == "--fps" && i + 1 < argc) {
+			if (!parseNumber(argv[++i], frameRate)) {
+				return false;
+			}
+		}
+		else if (argument == "--wall" && i + 1 < argc) {
+			if (sscanf(argv[++i], "%ux%u", &wallColumns, &wallRows) != 2 || wallColumns == 0 || wallRows == 0) {
+				std::cout << "Bad wall size \"" << argv[i] << "\"!" << std::endl;
+				return false;
+			}
+		}
+		else if (argument == "--prerender" && i + 1 < argc) {
+			prerenderDirectory = argv[++i];
+		}
+		else if (argument == "--target" && i + 1 < argc) {
+			prerenderTarget = argv[++i];
+		}
+		else if (argument == "--output" && i + 1 < argc) {
+			prerenderOutput = argv[++i];
+		}
+		else if (argument == "--watch" && i + 1 < argc) {
+			watchDirectory = argv[++i];
+		}
+		else if (argument == "--grid" && i + 1 < argc) {
+			gridDirectory = argv[++i];
+		}
+		else if (argument == "--capture" && i + 1 < argc) {
+			captureFile = argv[++i];
+		}
+		else if (argument == "--benchmark" && i + 1 < argc) {
+			benchmarkBaseline = argv[++i];
+		}
+		else if (argument == "--check") {
+			checkOnly = true;
+		}
+		else if (argument == "--record") {
+			benchmarkRecord = true;
+		}
+		else if (argument == "--tolerance" && i + 1 < argc) {
+			if (!parseNumber(argv[++i], benchmarkTolerance)) {
+				return false;
+			}
+		}
+		else if (argument == "--cpus" && i + 1 < argc) {
+			cpuList = argv[++i];
+		}
+		else if (argument == "--hugepages" && i + 1 < argc) {
+			ImageMemory::HugePages hugePages = ImageMemory::TRANSPARENT;
+			if (!ImageMemory::hugePagesFromString(argv[++i], hugePages)) {
+				std::cout << "Unknown huge page mode \"" << argv[i] << "\"!" << std::endl;
+				return false;
+			}
+			ImageMemory::setHugePages(hugePages);
+		}
+		else if (argument == "--lockframes") {
+			ImageMemory::setLocking(true);
+		}
+		else if (argument == "--caption") {
+			showCaption = true;
+		}
+		else if (argument == "--clock") {
+			showClock = true;
+		}
+		else if (argument == "--stats") {
+			showStats = true;
+		}
 		/*else if (argument == "-a") {
 			autozoom = true;
 		}*/
@@ -54,16 +273,362 @@ bool parseCommandLine(int argc, char * argv[])
 			if (frameBufferDevice.empty()) {
 				frameBufferDevice = argument;
 			}
-			else if (imageFile.empty()) {
-				imageFile = argument;
-			}
 			else {
-				std::cout << "Too many options!" << std::endl;
-				printUsage();
-				return false;
+				imageFiles.push_back(argument);
 			}
 		}
 	}
+	//benchmarking uses virtual framebuffers
+	if (checkOnly || !benchmarkBaseline.empty()) {
+		if (!frameBufferDevice.empty()) {
+			printUsage();
+			return false;
+		}
+		return true;
+	}
+	//prerendering does not need a framebuffer
+	if (!prerenderDirectory.empty()) {
+		if (prerenderTarget.empty() || !frameBufferDevice.empty()) {
+			printUsage();
+			return false;
+		}
+		return true;
+	}
+	//watching a directory, displaying a grid and capturing do not need image files
+	if (!watchDirectory.empty() || !gridDirectory.empty() || !captureFile.empty()) {
+		if (frameBufferDevice.empty() || !imageFiles.empty()) {
+			printUsage();
+			return false;
+		}
+		return true;
+	}
+	if (imageFiles.empty()) {
+		printUsage();
+		return false;
+	}
+	return true;
+}
+
+int runPanZoom()
+{
+	//load image in original size
+	uint32_t width = 0;
+	uint32_t height = 0;
+	ImageBuffer data = ImageIO::loadFile_RGBA32(imageFiles.front(), width, height);
+	if (data.empty()) {
+		std::cout << "Failed to load image!" << std::endl;
+		return -3;
+	}
+	//build pyramid in the background. the viewer shows levels as soon as they're ready
+	TilePyramid pyramid(std::move(data), width, height, frameBuffer->getFormat(), frameBuffer->getWidth(), frameBuffer->getHeight());
+	//hide cursor
+	std::cout << "\e[?1;0;127c" << std::flush;
+	Viewer viewer(*frameBuffer, pyramid);
+	viewer.run();
+	//unhide cursor
+	std::cout << "\e[?0;0;0c";
+	return 0;
+}
+
+int runPrerender()
+{
+	Prerenderer::Target target;
+	if (!Prerenderer::parseTarget(prerenderTarget, target)) {
+		std::cout << "Bad target \"" << prerenderTarget << "\"!" << std::endl;
+		return -1;
+	}
+	if (prerenderOutput.empty()) {
+		prerenderOutput = prerenderDirectory + "/prerendered";
+	}
+	Prerenderer prerenderer(target, prerenderOutput);
+	return prerenderer.run(prerenderDirectory) ? 0 : -3;
+}
+
+int runBenchmark()
+{
+	Benchmark benchmark(benchmarkBaseline, benchmarkRecord, benchmarkTolerance / 100.0f);
+	if (checkOnly && benchmarkBaseline.empty()) {
+		return benchmark.check() ? 0 : -3;
+	}
+	return benchmark.run() ? 0 : -3;
+}
+
+int runGrid()
+{
+	if (prerenderOutput.empty()) {
+		prerenderOutput = gridDirectory + "/.thumbnails";
+	}
+	//hide cursor
+	std::cout << "\e[?1;0;127c" << std::flush;
+	ContactSheet contactSheet(*frameBuffer, gridDirectory, prerenderOutput);
+	const bool shown = contactSheet.run();
+	//unhide cursor
+	std::cout << "\e[?0;0;0c";
+	return shown ? 0 : -3;
+}
+
+int runCapture()
+{
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point start = Clock::now();
+	//leave mode and palette alone. another instance of sfivt may be displaying something on it
+	Framebuffer framebuffer(frameBufferDevice, true);
+	if (!framebuffer.isAvailable()) {
+		std::cout << "Failed to initialize framebuffer!" << std::endl;
+		return -2;
+	}
+	uint32_t width = framebuffer.getWidth();
+	uint32_t height = framebuffer.getHeight();
+	bool saved = false;
+	if (captureFile.size() > 4 && captureFile.compare(captureFile.size() - 4, 4, ".raw") == 0) {
+		//raw frames are stored like prerendered frames, so they can be compared to them or copied back to the framebuffer
+		ImageBuffer data(framebuffer.getLineLength() * height);
+		framebuffer.readback(data.data(), framebuffer.getLineLength(), framebuffer.getFormat(), 0, 0, width, height);
+		std::ofstream out(captureFile.c_str(), std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char *>(data.data()), data.size());
+		saved = out.good();
+		if (!saved) {
+			std::cout << "Failed to write " << captureFile << "!" << std::endl;
+		}
+	}
+	else {
+		const ImageBuffer data = framebuffer.readback(0, 0, width, height);
+		saved = ImageIO::saveFile_RGBA32(captureFile, data, width, height);
+	}
+	if (!saved) {
+		return -3;
+	}
+	std::cout << "Captured " << width << "x" << height << " to " << captureFile << " in " << std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count() << "ms." << std::endl;
+	return 0;
+}
+
+int runDisplayGroup(const std::vector<std::string> & devices)
+{
+	if (panZoom || !overlays.empty() || imageFiles.size() > 1 || !watchDirectory.empty() || !gridDirectory.empty()) {
+		std::cout << "Pan and zoom, overlays, slideshows, grids and watching a directory only work with one framebuffer!" << std::endl;
+		return -1;
+	}
+	DisplayGroup displays(devices);
+	if (!displays.isAvailable()) {
+		std::cout << "Failed to initialize framebuffers!" << std::endl;
+		return -2;
+	}
+	displays.setOrientation(orientation, mirror);
+	displays.setDithering(dither);
+	if (wallColumns > 0 && !displays.setWall(wallColumns, wallRows)) {
+		return -1;
+	}
+	//decode image only once for all framebuffers
+	uint32_t width = 0;
+	uint32_t height = 0;
+	displays.getImageSize(width, height);
+	//walls need the image upright, else it is rotated upright while blitting
+	ImageIO::Orientation imageOrientation = {Framebuffer::ROTATE_0, false};
+	ImageBuffer data = ImageIO::loadFile_RGBA32(imageFiles.front(), width, height, true, wallColumns > 0 ? nullptr : &imageOrientation);
+	if (data.empty()) {
+		std::cout << "Failed to load image!" << std::endl;
+		return -3;
+	}
+	displays.show(data, width, height, imageOrientation);
+	if (displayTwice) {
+		displays.show(data, width, height, imageOrientation);
+	}
+	//wait for input?
+	if (!oneshot) {
+		std::cin.get();
+	}
+	else {
+		usleep(100*1000);
+	}
+	return 0;
+}
+
+bool addOverlay(LayerStack & layers, const std::string & overlay)
+{
+	//split specification into file name and position
+	std::string fileName = overlay;
+	int x = 0;
+	int y = 0;
+	unsigned int opacity = 255;
+	const size_t separator = overlay.rfind('@');
+	if (separator != std::string::npos) {
+		fileName = overlay.substr(0, separator);
+		if (sscanf(overlay.c_str() + separator + 1, "%d,%d,%u", &x, &y, &opacity) < 2 || opacity > 255) {
+			std::cout << "Bad overlay position \"" << overlay.substr(separator + 1) << "\"!" << std::endl;
+			return false;
+		}
+	}
+	uint32_t width = 0;
+	uint32_t height = 0;
+	ImageBuffer data = ImageIO::loadFile_RGBA32(fileName, width, height);
+	if (data.empty()) {
+		std::cout << "Failed to load overlay " << fileName << "!" << std::endl;
+		return false;
+	}
+	//negative positions are relative to the right/bottom edge
+	if (x < 0) {
+		x += (int)layers.getWidth() - (int)width + 1;
+	}
+	if (y < 0) {
+		y += (int)layers.getHeight() - (int)height + 1;
+	}
+	layers.addLayer(std::move(data), width, height, x, y, true, opacity);
+	return true;
+}
+
+std::string currentTime()
+{
+	const time_t now = time(nullptr);
+	struct tm local;
+	char text[16];
+	strftime(text, sizeof(text), "%H:%M:%S", localtime_r(&now, &local));
+	return text;
+}
+
+int32_t millisecondsToNextSecond()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return 1000 - now.tv_nsec / 1000000;
+}
+
+void createLabels()
+{
+	if (!showCaption && !showClock && !showStats) {
+		return;
+	}
+	textRenderer.reset(new TextRenderer(*frameBuffer));
+	//the caption box lets the image shine through. clock and statistics change often and are opaque, so they are just copied
+	captionLabel = textRenderer->addLabel(0, -1, 0xffffff, 0, 160);
+	clockLabel = textRenderer->addLabel(-1, 0);
+	statsLabel = textRenderer->addLabel(0, 0);
+}
+
+void drawLabels(const std::string & fileName, const std::string & stats)
+{
+	if (!textRenderer) {
+		return;
+	}
+	//text is drawn upright on the display, even if the image was rotated
+	frameBuffer->setOrientation(orientation, mirror);
+	textRenderer->invalidate();
+	if (showCaption) {
+		textRenderer->setText(captionLabel, fileName.substr(fileName.find_last_of('/') + 1));
+	}
+	if (showClock) {
+		textRenderer->setText(clockLabel, currentTime());
+	}
+	if (showStats) {
+		textRenderer->setText(statsLabel, stats);
+	}
+	textRenderer->present();
+}
+
+void waitForEnter()
+{
+	if (!textRenderer || !showClock) {
+		std::cin.get();
+		return;
+	}
+	//redraw the clock every second. only its label is drawn, and only if the text changed
+	for (;;) {
+		textRenderer->setText(clockLabel, currentTime());
+		textRenderer->present();
+		const TerminalInput::Result result = TerminalInput::wait(millisecondsToNextSecond());
+		if (result == TerminalInput::INPUT) {
+			TerminalInput::skipInput();
+			return;
+		}
+		else if (result == TerminalInput::FAILED) {
+			return;
+		}
+	}
+}
+
+void showImage(const ImageBuffer & data, uint32_t width, uint32_t height, const ImageIO::Orientation & imageOrientation)
+{
+	frameBuffer->setOrientation(orientation, mirror);
+	frameBuffer->addOrientation(imageOrientation.rotation, imageOrientation.mirror);
+	if (frameBuffer->getFormat() == Framebuffer::PALETTE8) {
+		frameBuffer->setPalette(Palette::fromImage(data.data(), width, height));
+	}
+	//only clear the borders around the image, so the old image is replaced without flashing black
+	const uint32_t x = width < frameBuffer->getWidth() ? (frameBuffer->getWidth() - width) / 2 : 0;
+	const uint32_t y = height < frameBuffer->getHeight() ? (frameBuffer->getHeight() - height) / 2 : 0;
+	uint8_t clearColor[4];
+	frameBuffer->convertColor(clearColor, 0);
+	frameBuffer->fillRect(0, 0, frameBuffer->getWidth(), y, clearColor);
+	frameBuffer->fillRect(0, y + height, frameBuffer->getWidth(), frameBuffer->getHeight() - std::min(y + height, frameBuffer->getHeight()), clearColor);
+	frameBuffer->fillRect(0, y, x, height, clearColor);
+	frameBuffer->fillRect(x + width, y, frameBuffer->getWidth() - std::min(x + width, frameBuffer->getWidth()), height, clearColor);
+	frameBuffer->blit(x, y, data.data(), width, height, Framebuffer::X8R8G8B8);
+}
+
+int runWatch()
+{
+	FolderWatcher watcher(watchDirectory);
+	if (!watcher.isValid()) {
+		return -3;
+	}
+	std::cout << "Watching " << watchDirectory << " for new images. Press <ENTER> to quit." << std::endl;
+	//hide cursor
+	std::cout << "\e[?1;0;127c" << std::flush;
+	std::string fileName;
+	FolderWatcher::Clock::time_point arrival;
+	uint32_t dropped = 0;
+	FolderWatcher::Result result;
+	while ((result = watcher.wait(fileName, arrival, dropped, textRenderer && showClock ? millisecondsToNextSecond() : -1)) == FolderWatcher::FILE_ARRIVED || result == FolderWatcher::TIMEOUT) {
+		if (result == FolderWatcher::TIMEOUT) {
+			textRenderer->setText(clockLabel, currentTime());
+			textRenderer->present();
+			continue;
+		}
+		//the framebuffer stays open, so this only decodes and draws
+		uint32_t width = frameBuffer->getWidth();
+		uint32_t height = frameBuffer->getHeight();
+		ImageIO::Orientation imageOrientation = {Framebuffer::ROTATE_0, false};
+		const ImageBuffer data = ImageIO::loadFile_RGBA32(fileName, width, height, true, &imageOrientation);
+		if (data.empty()) {
+			std::cout << "Failed to load " << fileName << "!" << std::endl;
+			continue;
+		}
+		showImage(data, width, height, imageOrientation);
+		const uint32_t latency = std::chrono::duration_cast<std::chrono::milliseconds>(FolderWatcher::Clock::now() - arrival).count();
+		drawLabels(fileName, "Displayed " + std::to_string(latency) + "ms after arrival");
+		std::cout << "Displayed " << fileName << " " << latency << "ms after it arrived";
+		if (dropped > 0) {
+			std::cout << ", skipped " << dropped << " older file" << (dropped > 1 ? "s" : "");
+		}
+		std::cout << "." << std::endl;
+	}
+	//unhide cursor
+	std::cout << "\e[?0;0;0c";
+	return result == FolderWatcher::FAILED ? -3 : 0;
+}
+
+bool showPreview(const MappedFile & file, uint32_t & width, uint32_t & height)
+{
+	//the preview is fitted and rotated exactly like the full image will be
+	width = frameBuffer->getWidth();
+	height = frameBuffer->getHeight();
+	ImageIO::Orientation imageOrientation = {Framebuffer::ROTATE_0, false};
+	ImageBuffer data = ImageIO::loadPreview_RGBA32(file, width, height, true, overlays.empty() ? &imageOrientation : nullptr);
+	if (data.empty()) {
+		return false;
+	}
+	frameBuffer->setOrientation(orientation, mirror);
+	frameBuffer->addOrientation(imageOrientation.rotation, imageOrientation.mirror);
+	if (frameBuffer->getFormat() == Framebuffer::PALETTE8) {
+		frameBuffer->setPalette(Palette::fromImage(data.data(), width, height));
+	}
+	uint8_t clearColor[4];
+	frameBuffer->convertColor(clearColor, 0);
+	frameBuffer->clear(clearColor);
+	const uint32_t x = width < frameBuffer->getWidth() ? (frameBuffer->getWidth() - width) / 2 : 0;
+	const uint32_t y = height < frameBuffer->getHeight() ? (frameBuffer->getHeight() - height) / 2 : 0;
+	frameBuffer->blit(x, y, data.data(), width, height, Framebuffer::X8R8G8B8);
+	//the full image is drawn with the display orientation again
+	frameBuffer->setOrientation(orientation, mirror);
 	return true;
 }
 
@@ -71,7 +636,7 @@ int main(int argc, char * argv[])
 {
 	std::cout << "sfivt - A Simple Frambuffer Image viewing Tool v0.8 alpha" << std::endl;
 	
-	if (argc < 3 || argc > 5) {
+	if (argc < 2) {
 		printUsage();
 		return -1;
 	}
@@ -79,48 +644,165 @@ int main(int argc, char * argv[])
 	if (!parseCommandLine(argc, argv)) {
 		return -1;
 	}
+	//threads inherit the CPUs they may run on, so do this before any are started
+	if (!cpuList.empty() && !ThreadPool::setCpus(cpuList)) {
+		return -1;
+	}
+
+	if (checkOnly || !benchmarkBaseline.empty()) {
+		return runBenchmark();
+	}
+	if (!prerenderDirectory.empty()) {
+		return runPrerender();
+	}
 	
+	//split framebuffer device list
+	std::vector<std::string> devices;
+	size_t start = 0;
+	size_t separator;
+	while ((separator = frameBufferDevice.find(',', start)) != std::string::npos) {
+		devices.push_back(frameBufferDevice.substr(start, separator - start));
+		start = separator + 1;
+	}
+	devices.push_back(frameBufferDevice.substr(start));
+	if (!captureFile.empty()) {
+		if (devices.size() > 1) {
+			std::cout << "Only one framebuffer can be captured at a time!" << std::endl;
+			return -1;
+		}
+		return runCapture();
+	}
+	if (devices.size() > 1 || wallColumns > 0) {
+		return runDisplayGroup(devices);
+	}
+
 	//create framebuffer
 	frameBuffer = std::make_shared<Framebuffer>(frameBufferDevice);
 	if (!frameBuffer->isAvailable()) {
 		std::cout << "Failed to initialize framebuffer!" << std::endl;
 		return -2;
 	}
+	//everything is drawn rotated from now on, so images are also fitted to the rotated size
+	frameBuffer->setOrientation(orientation, mirror);
+	frameBuffer->setDithering(dither);
+
+	if ((showCaption || showClock || showStats) && (panZoom || imageFiles.size() > 1 || !gridDirectory.empty())) {
+		std::cout << "Caption, clock and statistics are only displayed for single images and when watching a directory." << std::endl;
+	}
+	else {
+		createLabels();
+	}
+
+	if (panZoom) {
+		return runPanZoom();
+	}
+
+	if (!watchDirectory.empty()) {
+		return runWatch();
+	}
+
+	if (!gridDirectory.empty()) {
+		return runGrid();
+	}
+
+	if (imageFiles.size() > 1) {
+		//hide cursor
+		std::cout << "\e[?1;0;127c" << std::flush;
+		Slideshow slideshow(*frameBuffer, imageFiles, transition, transitionDuration, slideDelay * 1000, !oneshot, frameRate);
+		const bool shown = slideshow.run();
+		//unhide cursor
+		std::cout << "\e[?0;0;0c";
+		return shown ? 0 : -3;
+	}
 	
-	//try loading the image
+	//map file once, so a preview and the image are decoded from the same memory
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point loadStart = Clock::now();
+	const MappedFile file(imageFiles.front());
+	if (!file.isValid()) {
+		std::cout << "Failed to open " << imageFiles.front() << "!" << std::endl;
+		return -3;
+	}
+
+	//wait for input?
+	if (!oneshot) {
+		//hide cursor
+		std::cout << "\e[?1;0;127c" << std::flush;
+	}
+
+	//show something as soon as possible, then refine it to the full image
+	uint32_t previewWidth = 0;
+	uint32_t previewHeight = 0;
+	const bool previewShown = progressive && showPreview(file, previewWidth, previewHeight);
+	if (previewShown) {
+		std::cout << "First pixel after " << std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - loadStart).count() << "ms." << std::endl;
+	}
+	
+	//try loading the image. it is rotated upright while blitting, except when overlays need to stay where they are
 	uint32_t width = frameBuffer->getWidth();
 	uint32_t height = frameBuffer->getHeight();
-	std::vector<uint8_t> data = ImageIO::loadFile_RGBA32(imageFile, width, height);
+	ImageIO::Orientation imageOrientation = {Framebuffer::ROTATE_0, false};
+	ImageBuffer data = ImageIO::loadFile_RGBA32(file, width, height, true, overlays.empty() ? &imageOrientation : nullptr);
 	if (data.empty()) {
 		std::cout << "Failed to load image!" << std::endl;
+		if (!oneshot) {
+			//unhide cursor
+			std::cout << "\e[?0;0;0c";
+		}
 		return -3;
 	}
-	
-	//wait for input?
-	if (!oneshot) {
-		//hide cursor
-		std::cout << "\e[?1;0;127c";
+	const Clock::time_point decodeEnd = Clock::now();
+	frameBuffer->addOrientation(imageOrientation.rotation, imageOrientation.mirror);
+	//palettized framebuffers get a palette made for the image
+	if (frameBuffer->getFormat() == Framebuffer::PALETTE8) {
+		ThreadPool threadPool;
+		frameBuffer->setPalette(Palette::fromImage(data.data(), width, height, 0, Palette::MAX_COLORS, &threadPool));
 	}
 	
-	//clear framebuffer to black
-	uint32_t inColor = 0;
-	uint8_t * clearColor = frameBuffer->convertToFramebufferFormat((const uint8_t *)&inColor, Framebuffer::X8R8G8B8);
-	frameBuffer->clear(clearColor);
-	delete [] clearColor;
+	//clear framebuffer to black. the full image covers a preview of the same size completely, so do not flash black then
+	if (!previewShown || previewWidth != width || previewHeight != height) {
+		uint8_t clearColor[4];
+		frameBuffer->convertColor(clearColor, 0);
+		frameBuffer->clear(clearColor);
+	}
 	
 	//display the image centered on screen
 	uint32_t x = width < frameBuffer->getWidth() ? (frameBuffer->getWidth() - width) / 2 : 0;
 	uint32_t y = height < frameBuffer->getHeight() ? (frameBuffer->getHeight() - height) / 2 : 0;
-	frameBuffer->blit(x, y, data.data(), width, height, Framebuffer::X8R8G8B8);
-
-	if (displayTwice) {
+	if (overlays.empty()) {
 		frameBuffer->blit(x, y, data.data(), width, height, Framebuffer::X8R8G8B8);
+
+		if (displayTwice) {
+			frameBuffer->blit(x, y, data.data(), width, height, Framebuffer::X8R8G8B8);
+		}
+	}
+	else {
+		//composite image and overlays in memory and display the result
+		LayerStack layers(frameBuffer->getWidth(), frameBuffer->getHeight());
+		layers.addLayer(std::move(data), width, height, x, y, true);
+		for (auto overlayIt = overlays.cbegin(); overlayIt != overlays.cend(); ++overlayIt) {
+			if (!addOverlay(layers, *overlayIt)) {
+				return -3;
+			}
+		}
+		layers.present(*frameBuffer);
+
+		if (displayTwice) {
+			layers.invalidate();
+			layers.present(*frameBuffer);
+		}
+	}
+	const Clock::time_point drawEnd = Clock::now();
+	drawLabels(imageFiles.front(), "Decoded in " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(decodeEnd - loadStart).count())
+		+ "ms, drawn in " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(drawEnd - decodeEnd).count()) + "ms");
+	if (progressive) {
+		std::cout << "Final image after " << std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - loadStart).count() << "ms." << std::endl;
 	}
 
 	//wait for input?
 	if (!oneshot) {
 		//wait for user return
-		std::cin.get();
+		waitForEnter();
 		//unhide cursor
 		std::cout << "\e[?0;0;0c";
 	}
@@ -0,0 +1,120 @@
+#include "mappedFile.h"
+
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+MappedFile::MappedFile()
+	: m_mapping(nullptr)
+	, m_size(0)
+{
+}
+
+MappedFile::MappedFile(const std::string & fileName, bool populate)
+	: m_fileName(fileName)
+	, m_mapping(nullptr)
+	, m_size(0)
+{
+	const int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0) {
+		close(fd);
+		return;
+	}
+	const size_t size = info.st_size;
+	//we read the file once from start to end. tell the kernel to start reading ahead now
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	void * mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, 0);
+	if (mapping != MAP_FAILED) {
+		madvise(mapping, size, MADV_SEQUENTIAL);
+		madvise(mapping, size, MADV_WILLNEED);
+		m_mapping = static_cast<uint8_t *>(mapping);
+		m_size = size;
+	}
+	else {
+		//file system does not support mapping. read file instead
+		m_buffer.resize(size);
+		size_t done = 0;
+		while (done < size) {
+			const ssize_t result = read(fd, m_buffer.data() + done, size - done);
+			if (result <= 0) {
+				break;
+			}
+			done += result;
+		}
+		if (done == size) {
+			m_size = size;
+		}
+		else {
+			m_buffer.clear();
+		}
+	}
+	//the mapping keeps the file alive
+	close(fd);
+}
+
+MappedFile::MappedFile(MappedFile && other)
+	: m_fileName(std::move(other.m_fileName))
+	, m_mapping(other.m_mapping)
+	, m_buffer(std::move(other.m_buffer))
+	, m_size(other.m_size)
+{
+	other.m_mapping = nullptr;
+	other.m_size = 0;
+}
+
+MappedFile & MappedFile::operator=(MappedFile && other)
+{
+	if (this != &other) {
+		unmap();
+		m_fileName = std::move(other.m_fileName);
+		m_mapping = other.m_mapping;
+		m_buffer = std::move(other.m_buffer);
+		m_size = other.m_size;
+		other.m_mapping = nullptr;
+		other.m_size = 0;
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	unmap();
+}
+
+void MappedFile::unmap()
+{
+	if (m_mapping != nullptr) {
+		munmap(m_mapping, m_size);
+		m_mapping = nullptr;
+	}
+	m_buffer.clear();
+	m_size = 0;
+}
+
+bool MappedFile::isValid() const
+{
+	return m_size > 0;
+}
+
+const std::string & MappedFile::getFileName() const
+{
+	return m_fileName;
+}
+
+const uint8_t * MappedFile::getData() const
+{
+	return m_mapping != nullptr ? m_mapping : m_buffer.data();
+}
+
+size_t MappedFile::getSize() const
+{
+	return m_size;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <inttypes.h>
+#include <cstddef>
+
+
+/*!
+Read-only view of the contents of a file. The file is memory-mapped if possible, else read into memory.
+Decoders can work on the data directly instead of doing their own blocking reads.
+*/
+class MappedFile
+{
+public:
+	/*!
+	Construct an empty, invalid file.
+	*/
+	MappedFile();
+
+	/*!
+	Open and map file.
+	\param[in] fileName Path to file to open.
+	\param[in] populate Optional. Pass true to read all of the file before returning. Use this on an I/O thread to fetch a file in the background.
+	If false the kernel is only told to start reading ahead and pages are read when they are accessed.
+	*/
+	MappedFile(const std::string & fileName, bool populate = false);
+
+	MappedFile(MappedFile && other);
+	MappedFile & operator=(MappedFile && other);
+	MappedFile(const MappedFile &) = delete;
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	~MappedFile();
+
+	/*!
+	Check if the file could be opened and is not empty.
+	*/
+	bool isValid() const;
+
+	/*!
+	Get path of file.
+	*/
+	const std::string & getFileName() const;
+
+	/*!
+	Get pointer to file contents.
+	*/
+	const uint8_t * getData() const;
+
+	/*!
+	Get size of file contents in Bytes.
+	*/
+	size_t getSize() const;
+
+private:
+	void unmap();
+
+	std::string m_fileName;
+	uint8_t * m_mapping; //!<Start of memory mapping or nullptr if the file was read.
+	std::vector<uint8_t> m_buffer; //!<File contents if the file could not be mapped.
+	size_t m_size;
+};
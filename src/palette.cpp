@@ -0,0 +1,326 @@
+#include "palette.h"
+
+#include <algorithm>
+#include <mutex>
+#include <cmath>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#include <arm_neon.h>
+	#define PALETTE_NEON
+#endif
+
+
+const uint32_t Palette::MAX_COLORS;
+
+static const uint32_t CUBE_CELLS = 32 * 32 * 32; //!<Number of cells of the inverse colormap, one per 15bit color.
+
+//4x4 Bayer matrix for ordered dithering
+static const int32_t BAYER[4][4] = {
+	{ 0,  8,  2, 10},
+	{12,  4, 14,  6},
+	{ 3, 11,  1,  9},
+	{15,  7, 13,  5}
+};
+
+//get index of the inverse colormap cell a X8R8G8B8 pixel falls into
+static inline uint32_t cellIndex(uint32_t pixel)
+{
+	return (pixel >> 9 & 0x7c00) | (pixel >> 6 & 0x03e0) | (pixel >> 3 & 0x001f);
+}
+
+//get red (0), green (1) or blue (2) channel of a cell index
+static inline uint32_t cellChannel(uint32_t cell, uint32_t axis)
+{
+	return (cell >> (10 - axis * 5)) & 0x1f;
+}
+
+//expand 5bit channel to 8bit, so white stays white
+static inline uint32_t expand5(uint32_t value)
+{
+	return value << 3 | value >> 2;
+}
+
+//dither about as strong as the distance between neighbouring colors of an evenly spread palette
+static int32_t ditherSpread(uint32_t colorCount)
+{
+	return std::min(64, (int32_t)(256.0 / std::cbrt((double)std::max(colorCount, 1u))));
+}
+
+Palette::Palette()
+	: m_colors(MAX_COLORS)
+	, m_colorCount(MAX_COLORS)
+	, m_inverse(CUBE_CELLS)
+	, m_ditherSpread(ditherSpread(MAX_COLORS))
+{
+	for (uint32_t index = 0; index < MAX_COLORS; ++index) {
+		const uint32_t red = index >> 5;
+		const uint32_t green = (index >> 2) & 0x07;
+		const uint32_t blue = index & 0x03;
+		m_colors[index] = 0xff000000 | (red << 5 | red << 2 | red >> 1) << 16 | (green << 5 | green << 2 | green >> 1) << 8 | blue * 0x55;
+	}
+	//the palette is a regular grid, so the nearest entry can be found channel by channel
+	for (uint32_t cell = 0; cell < CUBE_CELLS; ++cell) {
+		const uint32_t red = (expand5(cellChannel(cell, 0)) * 7 + 127) / 255;
+		const uint32_t green = (expand5(cellChannel(cell, 1)) * 7 + 127) / 255;
+		const uint32_t blue = (expand5(cellChannel(cell, 2)) * 3 + 127) / 255;
+		m_inverse[cell] = red << 5 | green << 2 | blue;
+	}
+}
+
+Palette Palette::fromImage(const uint8_t * data, uint32_t width, uint32_t height, uint32_t lineLength, uint32_t colorCount, ThreadPool * threadPool)
+{
+	if (lineLength == 0) {
+		lineLength = width * 4;
+	}
+	colorCount = std::min(colorCount, MAX_COLORS);
+	//build histogram of 15bit colors. every thread counts into its own histogram first
+	std::vector<uint32_t> histogram(CUBE_CELLS, 0);
+	std::mutex histogramMutex;
+	auto countColors = [&](size_t begin, size_t end) {
+		std::vector<uint32_t> counts(CUBE_CELLS, 0);
+		for (size_t line = begin; line < end; ++line) {
+			const uint32_t * pixel = reinterpret_cast<const uint32_t *>(data + line * lineLength);
+			for (uint32_t column = 0; column < width; ++column, pixel++) {
+				counts[cellIndex(*pixel)]++;
+			}
+		}
+		std::lock_guard<std::mutex> lock(histogramMutex);
+		for (uint32_t cell = 0; cell < CUBE_CELLS; ++cell) {
+			histogram[cell] += counts[cell];
+		}
+	};
+	if (threadPool != nullptr) {
+		threadPool->parallelFor(height, countColors, (height + threadPool->getThreadCount() - 1) / threadPool->getThreadCount());
+	}
+	else {
+		countColors(0, height);
+	}
+	//collect colors that are used
+	std::vector<uint16_t> cells;
+	for (uint32_t cell = 0; cell < CUBE_CELLS; ++cell) {
+		if (histogram[cell] != 0) {
+			cells.push_back(cell);
+		}
+	}
+	//median cut. boxes are ranges of the cell list
+	struct Box
+	{
+		uint32_t begin;
+		uint32_t end;
+		uint64_t count; //!<Number of pixels in box.
+		uint32_t axis; //!<Channel with the biggest range.
+		uint32_t extent; //!<Range of that channel.
+	};
+	auto shrinkBox = [&](Box & box) {
+		uint32_t minimum[3] = {31, 31, 31};
+		uint32_t maximum[3] = {0, 0, 0};
+		box.count = 0;
+		for (uint32_t index = box.begin; index < box.end; ++index) {
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				minimum[axis] = std::min(minimum[axis], cellChannel(cells[index], axis));
+				maximum[axis] = std::max(maximum[axis], cellChannel(cells[index], axis));
+			}
+			box.count += histogram[cells[index]];
+		}
+		box.axis = 0;
+		box.extent = 0;
+		for (uint32_t axis = 0; axis < 3; ++axis) {
+			if (maximum[axis] - minimum[axis] > box.extent) {
+				box.axis = axis;
+				box.extent = maximum[axis] - minimum[axis];
+			}
+		}
+	};
+	std::vector<Box> boxes;
+	if (!cells.empty() && colorCount > 0) {
+		Box box = {0, (uint32_t)cells.size(), 0, 0, 0};
+		shrinkBox(box);
+		boxes.push_back(box);
+	}
+	while (boxes.size() < colorCount) {
+		//split the box with many pixels spread over a big range. boxes with only one color can not be split
+		size_t best = boxes.size();
+		uint64_t bestScore = 0;
+		for (size_t index = 0; index < boxes.size(); ++index) {
+			const uint64_t score = boxes[index].count * boxes[index].extent;
+			if (score > bestScore) {
+				best = index;
+				bestScore = score;
+			}
+		}
+		if (best == boxes.size()) {
+			break;
+		}
+		Box lower = boxes[best];
+		const uint32_t axis = lower.axis;
+		std::sort(cells.begin() + lower.begin, cells.begin() + lower.end, [axis](uint16_t a, uint16_t b) { return cellChannel(a, axis) < cellChannel(b, axis); });
+		//split at the median pixel, but keep at least one cell in both boxes
+		uint32_t split = lower.begin;
+		uint64_t sum = 0;
+		do {
+			sum += histogram[cells[split++]];
+		} while (split < lower.end - 1 && sum * 2 < lower.count);
+		Box upper = {split, lower.end, 0, 0, 0};
+		lower.end = split;
+		shrinkBox(lower);
+		shrinkBox(upper);
+		boxes[best] = lower;
+		boxes.push_back(upper);
+	}
+	//palette entries are the average colors of the boxes
+	Palette palette;
+	std::fill(palette.m_colors.begin(), palette.m_colors.end(), 0xff000000);
+	palette.m_colorCount = boxes.size();
+	for (size_t index = 0; index < boxes.size(); ++index) {
+		uint64_t sums[3] = {0, 0, 0};
+		for (uint32_t cell = boxes[index].begin; cell < boxes[index].end; ++cell) {
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				sums[axis] += expand5(cellChannel(cells[cell], axis)) * (uint64_t)histogram[cells[cell]];
+			}
+		}
+		const uint64_t count = boxes[index].count;
+		palette.m_colors[index] = 0xff000000 | (uint32_t)((sums[0] + count / 2) / count) << 16 | (uint32_t)((sums[1] + count / 2) / count) << 8 | (uint32_t)((sums[2] + count / 2) / count);
+	}
+	palette.m_ditherSpread = ditherSpread(palette.m_colorCount);
+	palette.buildInverse(threadPool);
+	return palette;
+}
+
+Palette Palette::fromColors(const std::vector<uint32_t> & colors, ThreadPool * threadPool)
+{
+	Palette palette;
+	std::fill(palette.m_colors.begin(), palette.m_colors.end(), 0xff000000);
+	palette.m_colorCount = std::min((uint32_t)colors.size(), MAX_COLORS);
+	for (uint32_t index = 0; index < palette.m_colorCount; ++index) {
+		palette.m_colors[index] = 0xff000000 | colors[index];
+	}
+	palette.m_ditherSpread = ditherSpread(palette.m_colorCount);
+	palette.buildInverse(threadPool);
+	return palette;
+}
+
+void Palette::buildInverse(ThreadPool * threadPool)
+{
+	//split colors into channels, so the search loop can be vectorized by the compiler
+	std::vector<int32_t> reds(m_colorCount);
+	std::vector<int32_t> greens(m_colorCount);
+	std::vector<int32_t> blues(m_colorCount);
+	for (uint32_t index = 0; index < m_colorCount; ++index) {
+		reds[index] = (m_colors[index] >> 16) & 0xff;
+		greens[index] = (m_colors[index] >> 8) & 0xff;
+		blues[index] = m_colors[index] & 0xff;
+	}
+	//search nearest color for every cell. the eye is most sensitive to green and least to blue, so weight the channels
+	auto findNearest = [&](size_t begin, size_t end) {
+		for (uint32_t cell = begin * 1024; cell < end * 1024; ++cell) {
+			const int32_t red = expand5(cellChannel(cell, 0));
+			const int32_t green = expand5(cellChannel(cell, 1));
+			const int32_t blue = expand5(cellChannel(cell, 2));
+			uint32_t nearest = 0;
+			int32_t nearestDistance = INT32_MAX;
+			for (uint32_t index = 0; index < m_colorCount; ++index) {
+				const int32_t distance = 3 * (reds[index] - red) * (reds[index] - red) + 4 * (greens[index] - green) * (greens[index] - green) + 2 * (blues[index] - blue) * (blues[index] - blue);
+				if (distance < nearestDistance) {
+					nearest = index;
+					nearestDistance = distance;
+				}
+			}
+			m_inverse[cell] = nearest;
+		}
+	};
+	//one red slice of the cube per item
+	if (threadPool != nullptr) {
+		threadPool->parallelFor(32, findNearest, 1);
+	}
+	else {
+		findNearest(0, 32);
+	}
+}
+
+const std::vector<uint32_t> & Palette::getColors() const
+{
+	return m_colors;
+}
+
+uint32_t Palette::getColorCount() const
+{
+	return m_colorCount;
+}
+
+void Palette::mapLine(uint8_t * dest, const uint32_t * source, size_t count, uint32_t x, uint32_t y, bool dither) const
+{
+	//the dither pattern repeats every 4 pixels, so get offsets for the next 4 pixels. they are added to all channels
+	int32_t offsets[4] = {0, 0, 0, 0};
+	if (dither) {
+		for (uint32_t pixel = 0; pixel < 4; ++pixel) {
+			offsets[pixel] = ((BAYER[y & 3][(x + pixel) & 3] * 2 - 15) * m_ditherSpread) / 32;
+		}
+	}
+	const uint8_t * inverse = m_inverse.data();
+	size_t pixel = 0;
+#if defined(__SSE2__) || defined(PALETTE_NEON)
+	//SIMD has no signed saturating add for unsigned bytes, so add the positive and subtract the negative part of the offsets
+	uint32_t add[4];
+	uint32_t sub[4];
+	for (uint32_t lane = 0; lane < 4; ++lane) {
+		add[lane] = (offsets[lane] > 0 ? offsets[lane] : 0) * 0x010101;
+		sub[lane] = (offsets[lane] < 0 ? -offsets[lane] : 0) * 0x010101;
+	}
+	uint32_t cells[4];
+#endif
+#if defined(__SSE2__)
+	const __m128i add128 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(add));
+	const __m128i sub128 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sub));
+	const __m128i redMask = _mm_set1_epi32(0x7c00);
+	const __m128i greenMask = _mm_set1_epi32(0x03e0);
+	const __m128i blueMask = _mm_set1_epi32(0x001f);
+	for (; pixel + 4 <= count; pixel += 4) {
+		__m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + pixel));
+		src = _mm_subs_epu8(_mm_adds_epu8(src, add128), sub128);
+		//calculate cell indices for 4 pixels at once, then look them up
+		const __m128i red = _mm_and_si128(_mm_srli_epi32(src, 9), redMask);
+		const __m128i green = _mm_and_si128(_mm_srli_epi32(src, 6), greenMask);
+		const __m128i blue = _mm_and_si128(_mm_srli_epi32(src, 3), blueMask);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(cells), _mm_or_si128(_mm_or_si128(red, green), blue));
+		dest[pixel] = inverse[cells[0]];
+		dest[pixel + 1] = inverse[cells[1]];
+		dest[pixel + 2] = inverse[cells[2]];
+		dest[pixel + 3] = inverse[cells[3]];
+	}
+#elif defined(PALETTE_NEON)
+	const uint8x16_t add128 = vreinterpretq_u8_u32(vld1q_u32(add));
+	const uint8x16_t sub128 = vreinterpretq_u8_u32(vld1q_u32(sub));
+	const uint32x4_t redMask = vdupq_n_u32(0x7c00);
+	const uint32x4_t greenMask = vdupq_n_u32(0x03e0);
+	const uint32x4_t blueMask = vdupq_n_u32(0x001f);
+	for (; pixel + 4 <= count; pixel += 4) {
+		const uint8x16_t src8 = vqsubq_u8(vqaddq_u8(vreinterpretq_u8_u32(vld1q_u32(source + pixel)), add128), sub128);
+		const uint32x4_t src = vreinterpretq_u32_u8(src8);
+		const uint32x4_t red = vandq_u32(vshrq_n_u32(src, 9), redMask);
+		const uint32x4_t green = vandq_u32(vshrq_n_u32(src, 6), greenMask);
+		const uint32x4_t blue = vandq_u32(vshrq_n_u32(src, 3), blueMask);
+		vst1q_u32(cells, vorrq_u32(vorrq_u32(red, green), blue));
+		dest[pixel] = inverse[cells[0]];
+		dest[pixel + 1] = inverse[cells[1]];
+		dest[pixel + 2] = inverse[cells[2]];
+		dest[pixel + 3] = inverse[cells[3]];
+	}
+#endif
+	//map remaining pixels. the SIMD loops always end at a multiple of 4, so the offsets still line up
+	for (; pixel < count; ++pixel) {
+		const int32_t offset = offsets[pixel & 3];
+		const int32_t red = std::min(std::max((int32_t)((source[pixel] >> 16) & 0xff) + offset, 0), 255);
+		const int32_t green = std::min(std::max((int32_t)((source[pixel] >> 8) & 0xff) + offset, 0), 255);
+		const int32_t blue = std::min(std::max((int32_t)(source[pixel] & 0xff) + offset, 0), 255);
+		dest[pixel] = inverse[cellIndex(red << 16 | green << 8 | blue)];
+	}
+}
+
+void Palette::unmapLine(uint32_t * dest, const uint8_t * source, size_t count) const
+{
+	for (size_t pixel = 0; pixel < count; ++pixel) {
+		dest[pixel] = m_colors[source[pixel]];
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "threadPool.h"
+
+#include <vector>
+#include <inttypes.h>
+#include <stddef.h>
+
+
+/*!
+Color palette for 8bit pseudocolor framebuffers.
+Pixels are mapped to palette indices through an inverse colormap, a 32x32x32 cube holding the nearest palette entry for every 15bit color.
+Mapping a pixel is a table lookup then instead of a search through the palette.
+*/
+class Palette
+{
+public:
+	static const uint32_t MAX_COLORS = 256; //!<Number of entries of an 8bit palette.
+
+	/*!
+	Construct the fixed R3G3B2 palette. Indices are RRRGGGBB, which is what \sa PixelOps::packLine uses for Framebuffer::PALETTE8.
+	*/
+	Palette();
+
+	/*!
+	Compute an optimized palette for an image with the median-cut algorithm.
+	\param[in] data X8R8G8B8 image data.
+	\param[in] width Width of image.
+	\param[in] height Height of image.
+	\param[in] lineLength Optional. Length of a scanline in Bytes. Pass 0 for tightly packed data.
+	\param[in] colorCount Optional. Maximum number of palette entries.
+	\param[in] threadPool Optional. Threads that build the color histogram and the inverse colormap.
+	\return Returns the palette. Images with fewer colors get fewer entries.
+	*/
+	static Palette fromImage(const uint8_t * data, uint32_t width, uint32_t height, uint32_t lineLength = 0, uint32_t colorCount = MAX_COLORS, ThreadPool * threadPool = nullptr);
+
+	/*!
+	Construct a palette from given colors, e.g. the palette a framebuffer is using.
+	\param[in] colors X8R8G8B8 colors. Only the first \sa MAX_COLORS are used.
+	\param[in] threadPool Optional. Threads that build the inverse colormap.
+	*/
+	static Palette fromColors(const std::vector<uint32_t> & colors, ThreadPool * threadPool = nullptr);
+
+	/*!
+	Get palette entries as X8R8G8B8 colors. There are always \sa MAX_COLORS entries, unused ones are black.
+	*/
+	const std::vector<uint32_t> & getColors() const;
+
+	/*!
+	Get number of palette entries in use.
+	*/
+	uint32_t getColorCount() const;
+
+	/*!
+	Map a scanline of X8R8G8B8 pixels to palette indices.
+	\param[out] dest Palette indices.
+	\param[in] source X8R8G8B8 pixels.
+	\param[in] count Number of consecutive pixels to map.
+	\param[in] x Horizontal position of the first pixel on the display. Selects the dither pattern.
+	\param[in] y Vertical position of the scanline on the display. Selects the dither pattern.
+	\param[in] dither Pass true to use ordered dithering, which hides banding, but adds a fine pattern.
+	\note Ordered dithering does not depend on neighbouring pixels, so scanlines can be mapped in any order and by multiple threads.
+	*/
+	void mapLine(uint8_t * dest, const uint32_t * source, size_t count, uint32_t x, uint32_t y, bool dither) const;
+
+	/*!
+	Convert a scanline of palette indices to X8R8G8B8 pixels.
+	\param[out] dest X8R8G8B8 pixels.
+	\param[in] source Palette indices.
+	\param[in] count Number of consecutive pixels to convert.
+	*/
+	void unmapLine(uint32_t * dest, const uint8_t * source, size_t count) const;
+
+private:
+	/*!
+	Find the nearest palette entry for every cell of the inverse colormap.
+	*/
+	void buildInverse(ThreadPool * threadPool);
+
+	std::vector<uint32_t> m_colors;
+	uint32_t m_colorCount;
+	std::vector<uint8_t> m_inverse; //!<Palette index for every 15bit color, indexed like X1R5G5B5 pixels.
+	int32_t m_ditherSpread; //!<Amplitude of the dither pattern. About the distance between neighbouring palette colors.
+};
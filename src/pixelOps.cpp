@@ -0,0 +1,742 @@
+#include "pixelOps.h"
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+	//the byte shuffle kernels need SSSE3. if the compiler does not target it, they are built for it anyway and only used if the CPU has it
+	#if defined(__SSSE3__) || defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+		#include <tmmintrin.h>
+		#define PIXELOPS_SSSE3
+	#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#include <arm_neon.h>
+	#define PIXELOPS_NEON
+#endif
+
+
+//exact rounded division by 255 for x <= 255 * 255
+static inline uint32_t div255(uint32_t x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+#if defined(__SSE2__)
+//exact rounded division by 255 for all 16bit lanes
+static inline __m128i div255_epu16(__m128i x)
+{
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+//copy alpha lane of two unpacked 16bit pixels to all lanes of the pixel
+static inline __m128i broadcastAlpha_epu16(__m128i x)
+{
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+}
+#elif defined(PIXELOPS_NEON)
+//exact rounded division by 255 for all 16bit lanes, narrowing to 8bit
+static inline uint8x8_t div255_u16(uint16x8_t x)
+{
+	return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+#endif
+
+//how to convert a pixel format with the generic kernels. built once per format from its channel layout
+struct Layout
+{
+	bool byteChannels; //!<True if red, green and blue are whole Bytes. Pixels are converted with Byte shuffles then.
+	bool shortChannels; //!<True if red, green and blue have 4 to 8 bits, so a channel is expanded with a single pair of shifts. The 16bit vector paths need this.
+	uint32_t bytesPerPixel;
+	uint32_t channelByte[3]; //!<Byte of red, green and blue in a pixel.
+	uint32_t byteChannel[4]; //!<X8R8G8B8 Byte stored in every Byte of a pixel or 4 if the Byte is unused.
+	uint8_t unpackShuffle[16]; //!<Source Byte for every Byte of 4 X8R8G8B8 pixels. 0x80 gives zero.
+	uint8_t packShuffle[16]; //!<X8R8G8B8 Byte for every Byte of 4 destination pixels. 0x80 gives zero.
+	uint8_t packFill[16]; //!<Bytes or-ed into 4 destination pixels, so unused Bytes are set.
+	uint32_t shift[3]; //!<Bit position of red, green and blue in a packed pixel.
+	uint32_t bits[3]; //!<Bits of red, green and blue in a packed pixel.
+	uint32_t fill; //!<Unused bits of a packed pixel. They are set like the hand-written kernels do.
+};
+
+static Layout makeLayout(const Framebuffer::PixelFormatInfo & info)
+{
+	Layout layout;
+	memset(&layout, 0, sizeof(Layout));
+	layout.bytesPerPixel = info.bytesPerPixel;
+	layout.shift[0] = info.shiftRed;
+	layout.shift[1] = info.shiftGreen;
+	layout.shift[2] = info.shiftBlue;
+	layout.bits[0] = info.bitsRed;
+	layout.bits[1] = info.bitsGreen;
+	layout.bits[2] = info.bitsBlue;
+	layout.byteChannels = (info.bytesPerPixel == 3 || info.bytesPerPixel == 4);
+	layout.shortChannels = true;
+	uint32_t usedBits = 0;
+	for (uint32_t channel = 0; channel < 3; ++channel) {
+		layout.byteChannels = layout.byteChannels && layout.bits[channel] == 8 && (layout.shift[channel] % 8) == 0;
+		layout.shortChannels = layout.shortChannels && layout.bits[channel] >= 4 && layout.bits[channel] <= 8;
+		layout.channelByte[channel] = layout.shift[channel] / 8;
+		usedBits |= ((1 << layout.bits[channel]) - 1) << layout.shift[channel];
+	}
+	layout.fill = ~usedBits & (info.bytesPerPixel == 4 ? 0xffffffff : (1 << info.bitsPerPixel) - 1);
+	//X8R8G8B8 has blue in Byte 0, green in Byte 1 and red in Byte 2
+	for (uint32_t byte = 0; byte < 4; ++byte) {
+		layout.byteChannel[byte] = 4;
+		for (uint32_t channel = 0; channel < 3; ++channel) {
+			if (layout.channelByte[channel] == byte) {
+				layout.byteChannel[byte] = 2 - channel;
+			}
+		}
+	}
+	memset(layout.packShuffle, 0x80, sizeof(layout.packShuffle));
+	for (uint32_t pixel = 0; pixel < 4 && layout.byteChannels; ++pixel) {
+		for (uint32_t channel = 0; channel < 3; ++channel) {
+			layout.unpackShuffle[pixel * 4 + 2 - channel] = pixel * layout.bytesPerPixel + layout.channelByte[channel];
+		}
+		layout.unpackShuffle[pixel * 4 + 3] = 0x80;
+		for (uint32_t byte = 0; byte < layout.bytesPerPixel; ++byte) {
+			if (layout.byteChannel[byte] < 4) {
+				layout.packShuffle[pixel * layout.bytesPerPixel + byte] = pixel * 4 + layout.byteChannel[byte];
+			}
+			else {
+				layout.packFill[pixel * layout.bytesPerPixel + byte] = 0xff;
+			}
+		}
+	}
+	return layout;
+}
+
+static const Layout & getLayout(Framebuffer::PixelFormat format)
+{
+	//initialization of static locals is thread-safe, so layouts are built exactly once
+	static const std::vector<Layout> layouts = [] {
+		std::vector<Layout> result;
+		for (size_t index = 0; index < Framebuffer::pixelFormatCount; ++index) {
+			result.push_back(makeLayout(Framebuffer::pixelFormatInfo[index]));
+		}
+		return result;
+	}();
+	if (format < Framebuffer::pixelFormatCount) {
+		return layouts[format];
+	}
+	//formats for the channel layouts of devices are added while running. build their layouts when they are first used and keep them, there are only a few
+	static std::mutex deviceLayoutMutex;
+	static std::map<Framebuffer::PixelFormat, Layout> deviceLayouts;
+	std::lock_guard<std::mutex> lock(deviceLayoutMutex);
+	auto layout = deviceLayouts.find(format);
+	if (layout == deviceLayouts.end()) {
+		layout = deviceLayouts.insert(std::make_pair(format, makeLayout(Framebuffer::getPixelFormatInfo(format)))).first;
+	}
+	return layout->second;
+}
+
+#if defined(PIXELOPS_SSSE3)
+static bool hasSSSE3()
+{
+#if defined(__SSSE3__)
+	return true;
+#else
+	//the CPU does not change, so ask only once
+	static const bool supported = [] {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("ssse3") != 0;
+	}();
+	return supported;
+#endif
+}
+
+//shuffle 4 pixels at once. 16 Bytes are loaded, so stop early for 3 Byte pixels. returns how many pixels were converted
+__attribute__((target("ssse3"))) static size_t unpackShuffle(uint32_t * dest, const uint8_t * source, const Layout & layout, size_t count)
+{
+	const uint32_t bytesPerPixel = layout.bytesPerPixel;
+	const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(layout.unpackShuffle));
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	const size_t loadPixels = (16 + bytesPerPixel - 1) / bytesPerPixel;
+	size_t pixel = 0;
+	for (; pixel + loadPixels <= count; pixel += 4) {
+		const __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + pixel * bytesPerPixel));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + pixel), _mm_or_si128(_mm_shuffle_epi8(src, shuffle), alpha));
+	}
+	return pixel;
+}
+
+//shuffle 4 pixels at once. 16 Bytes are stored, so stop early for 3 Byte pixels. the Bytes written past 4 pixels are written again later
+__attribute__((target("ssse3"))) static size_t packShuffle(uint8_t * dest, const uint32_t * source, const Layout & layout, size_t count)
+{
+	const uint32_t bytesPerPixel = layout.bytesPerPixel;
+	const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(layout.packShuffle));
+	const __m128i fill = _mm_loadu_si128(reinterpret_cast<const __m128i *>(layout.packFill));
+	const size_t storePixels = (16 + bytesPerPixel - 1) / bytesPerPixel;
+	size_t pixel = 0;
+	for (; pixel + storePixels <= count; pixel += 4) {
+		const __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + pixel));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + pixel * bytesPerPixel), _mm_or_si128(_mm_shuffle_epi8(src, shuffle), fill));
+	}
+	return pixel;
+}
+#endif
+
+//expand channel with less than 8 bits to 8 bits by replicating the upper bits, so white stays white. channels with more bits keep their upper 8 bits
+static inline uint32_t expandChannel(uint32_t value, uint32_t bits)
+{
+	if (bits >= 8) {
+		return value >> (bits - 8);
+	}
+	uint32_t result = value << (8 - bits);
+	for (uint32_t repeated = bits; repeated < 8; repeated += bits) {
+		result |= value << (8 - bits) >> repeated;
+	}
+	return result;
+}
+
+//reduce an 8bit color component to a channel. channels with more bits repeat the bits of the component, so 255 stays the maximum
+static inline uint32_t reduceChannel(uint32_t value, uint32_t bits)
+{
+	return bits <= 8 ? value >> (8 - bits) : (value << (bits - 8) | value >> (16 - bits));
+}
+
+void PixelOps::premultiplyAlpha(uint32_t * data, size_t count)
+{
+	for (size_t pixel = 0; pixel < count; ++pixel, data++) {
+		const uint32_t alpha = *data >> 24;
+		if (alpha != 255) {
+			const uint32_t red = div255(((*data >> 16) & 0xff) * alpha);
+			const uint32_t green = div255(((*data >> 8) & 0xff) * alpha);
+			const uint32_t blue = div255((*data & 0xff) * alpha);
+			*data = alpha << 24 | red << 16 | green << 8 | blue;
+		}
+	}
+}
+
+void PixelOps::setOpaque(uint32_t * data, size_t count)
+{
+	for (size_t pixel = 0; pixel < count; ++pixel, data++) {
+		*data |= 0xff000000;
+	}
+}
+
+void PixelOps::blendLine(uint32_t * dest, const uint32_t * source, size_t count, uint8_t opacity)
+{
+	size_t pixel = 0;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i maxValue = _mm_set1_epi16(255);
+	const __m128i opacity16 = _mm_set1_epi16(opacity);
+	const __m128i alphaMask = _mm_set1_epi32(0xff000000);
+	for (; pixel + 4 <= count; pixel += 4) {
+		const __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + pixel));
+		//skip if all source pixels are fully transparent
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(src, alphaMask), zero)) == 0xffff) {
+			continue;
+		}
+		const __m128i dst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dest + pixel));
+		//unpack pixels to 16bit per channel
+		__m128i srcLo = _mm_unpacklo_epi8(src, zero);
+		__m128i srcHi = _mm_unpackhi_epi8(src, zero);
+		if (opacity != 255) {
+			srcLo = div255_epu16(_mm_mullo_epi16(srcLo, opacity16));
+			srcHi = div255_epu16(_mm_mullo_epi16(srcHi, opacity16));
+		}
+		const __m128i invAlphaLo = _mm_sub_epi16(maxValue, broadcastAlpha_epu16(srcLo));
+		const __m128i invAlphaHi = _mm_sub_epi16(maxValue, broadcastAlpha_epu16(srcHi));
+		const __m128i dstLo = _mm_add_epi16(srcLo, div255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), invAlphaLo)));
+		const __m128i dstHi = _mm_add_epi16(srcHi, div255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), invAlphaHi)));
+		//pack back to 8bit and make opaque
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + pixel), _mm_or_si128(_mm_packus_epi16(dstLo, dstHi), alphaMask));
+	}
+#elif defined(PIXELOPS_NEON)
+	const uint8x8_t opacity8 = vdup_n_u8(opacity);
+	for (; pixel + 8 <= count; pixel += 8) {
+		//load pixels deinterleaved to B, G, R, A planes
+		uint8x8x4_t src = vld4_u8(reinterpret_cast<const uint8_t *>(source + pixel));
+		//skip if all source pixels are fully transparent
+		if (vget_lane_u64(vreinterpret_u64_u8(src.val[3]), 0) == 0) {
+			continue;
+		}
+		uint8x8x4_t dst = vld4_u8(reinterpret_cast<const uint8_t *>(dest + pixel));
+		if (opacity != 255) {
+			for (int channel = 0; channel < 4; ++channel) {
+				src.val[channel] = div255_u16(vmull_u8(src.val[channel], opacity8));
+			}
+		}
+		const uint8x8_t invAlpha = vmvn_u8(src.val[3]);
+		for (int channel = 0; channel < 3; ++channel) {
+			dst.val[channel] = vqadd_u8(src.val[channel], div255_u16(vmull_u8(dst.val[channel], invAlpha)));
+		}
+		dst.val[3] = vdup_n_u8(255);
+		vst4_u8(reinterpret_cast<uint8_t *>(dest + pixel), dst);
+	}
+#endif
+	//blend remaining pixels
+	for (; pixel < count; ++pixel) {
+		uint32_t src = source[pixel];
+		if (opacity != 255) {
+			src = div255((src >> 24) * opacity) << 24 | div255(((src >> 16) & 0xff) * opacity) << 16 | div255(((src >> 8) & 0xff) * opacity) << 8 | div255((src & 0xff) * opacity);
+		}
+		const uint32_t invAlpha = 255 - (src >> 24);
+		const uint32_t dst = dest[pixel];
+		const uint32_t red = ((src >> 16) & 0xff) + div255(((dst >> 16) & 0xff) * invAlpha);
+		const uint32_t green = ((src >> 8) & 0xff) + div255(((dst >> 8) & 0xff) * invAlpha);
+		const uint32_t blue = (src & 0xff) + div255((dst & 0xff) * invAlpha);
+		dest[pixel] = 0xff000000 | (red > 255 ? 255 : red) << 16 | (green > 255 ? 255 : green) << 8 | (blue > 255 ? 255 : blue);
+	}
+}
+
+void PixelOps::lerpLine(uint8_t * dest, const uint8_t * from, const uint8_t * to, Framebuffer::PixelFormat format, size_t count, uint8_t weight)
+{
+	//the channels at the ends of the 16bit formats have the same size, so swapped layouts interpolate the same way
+	if (format == Framebuffer::R5G6B5 || format == Framebuffer::B5G6R5) {
+		lerp16(reinterpret_cast<uint16_t *>(dest), reinterpret_cast<const uint16_t *>(from), reinterpret_cast<const uint16_t *>(to), count, weight, 6);
+	}
+	else if (format == Framebuffer::X1R5G5B5 || format == Framebuffer::X1B5G5R5) {
+		lerp16(reinterpret_cast<uint16_t *>(dest), reinterpret_cast<const uint16_t *>(from), reinterpret_cast<const uint16_t *>(to), count, weight, 5);
+	}
+	else if (format == Framebuffer::GREY8 || getLayout(format).byteChannels) {
+		//formats with 8bit channels are interpolated Byte by Byte
+		lerpBytes(dest, from, to, count * Framebuffer::getPixelFormatInfo(format).bytesPerPixel, weight);
+	}
+	else {
+		//palette indices and the channels of other packed layouts, e.g. of devices, can not be interpolated directly. interpolate the colors in small chunks on the stack
+		const uint32_t bytesPerPixel = Framebuffer::getPixelFormatInfo(format).bytesPerPixel;
+		static const size_t CHUNK_SIZE = 64;
+		uint32_t fromChunk[CHUNK_SIZE];
+		uint32_t toChunk[CHUNK_SIZE];
+		for (size_t pixel = 0; pixel < count; pixel += CHUNK_SIZE) {
+			const size_t chunkCount = (count - pixel) < CHUNK_SIZE ? (count - pixel) : CHUNK_SIZE;
+			unpackLine(fromChunk, from + pixel * bytesPerPixel, format, chunkCount);
+			unpackLine(toChunk, to + pixel * bytesPerPixel, format, chunkCount);
+			lerpBytes(reinterpret_cast<uint8_t *>(fromChunk), reinterpret_cast<const uint8_t *>(fromChunk), reinterpret_cast<const uint8_t *>(toChunk), chunkCount * 4, weight);
+			packLine(dest + pixel * bytesPerPixel, format, fromChunk, chunkCount);
+		}
+	}
+}
+
+void PixelOps::lerpBytes(uint8_t * dest, const uint8_t * from, const uint8_t * to, size_t count, uint8_t weight)
+{
+	size_t index = 0;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i toWeight = _mm_set1_epi16(weight);
+	const __m128i fromWeight = _mm_set1_epi16(255 - weight);
+	for (; index + 16 <= count; index += 16) {
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(from + index));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(to + index));
+		//a * (255 - weight) + b * weight fits into 16bit
+		const __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), fromWeight), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), toWeight));
+		const __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), fromWeight), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), toWeight));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + index), _mm_packus_epi16(div255_epu16(lo), div255_epu16(hi)));
+	}
+#elif defined(PIXELOPS_NEON)
+	const uint8x8_t toWeight = vdup_n_u8(weight);
+	const uint8x8_t fromWeight = vdup_n_u8(255 - weight);
+	for (; index + 16 <= count; index += 16) {
+		const uint8x16_t a = vld1q_u8(from + index);
+		const uint8x16_t b = vld1q_u8(to + index);
+		const uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(a), fromWeight), vget_low_u8(b), toWeight);
+		const uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(a), fromWeight), vget_high_u8(b), toWeight);
+		vst1q_u8(dest + index, vcombine_u8(div255_u16(lo), div255_u16(hi)));
+	}
+#endif
+	for (; index < count; ++index) {
+		dest[index] = div255(from[index] * (255 - weight) + to[index] * weight);
+	}
+}
+
+void PixelOps::lerp16(uint16_t * dest, const uint16_t * from, const uint16_t * to, size_t count, uint8_t weight, uint32_t greenBits)
+{
+	//set up channel positions. the top bit of X1R5G5B5 is set in the result
+	const uint16_t redShift = 5 + greenBits;
+	const uint16_t greenMask = (1 << greenBits) - 1;
+	const uint16_t fillBits = (greenBits == 5) ? 0x8000 : 0;
+	size_t pixel = 0;
+#if defined(__SSE2__)
+	const __m128i toWeight = _mm_set1_epi16(weight);
+	const __m128i fromWeight = _mm_set1_epi16(255 - weight);
+	const __m128i mask5 = _mm_set1_epi16(0x1f);
+	const __m128i maskGreen = _mm_set1_epi16(greenMask);
+	const __m128i fill = _mm_set1_epi16(fillBits);
+	const __m128i shiftRed = _mm_cvtsi32_si128(redShift);
+	for (; pixel + 8 <= count; pixel += 8) {
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(from + pixel));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(to + pixel));
+		//unpack channels, interpolate them and pack them again
+		const __m128i red = div255_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srl_epi16(a, shiftRed), mask5), fromWeight), _mm_mullo_epi16(_mm_and_si128(_mm_srl_epi16(b, shiftRed), mask5), toWeight)));
+		const __m128i green = div255_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(a, 5), maskGreen), fromWeight), _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(b, 5), maskGreen), toWeight)));
+		const __m128i blue = div255_epu16(_mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(a, mask5), fromWeight), _mm_mullo_epi16(_mm_and_si128(b, mask5), toWeight)));
+		const __m128i result = _mm_or_si128(_mm_or_si128(_mm_sll_epi16(red, shiftRed), _mm_slli_epi16(green, 5)), _mm_or_si128(blue, fill));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + pixel), result);
+	}
+#elif defined(PIXELOPS_NEON)
+	const uint16x8_t toWeight = vdupq_n_u16(weight);
+	const uint16x8_t fromWeight = vdupq_n_u16(255 - weight);
+	const uint16x8_t mask5 = vdupq_n_u16(0x1f);
+	const uint16x8_t maskGreen = vdupq_n_u16(greenMask);
+	const uint16x8_t fill = vdupq_n_u16(fillBits);
+	const int16x8_t shiftRedRight = vdupq_n_s16(-(int16_t)redShift);
+	const int16x8_t shiftRedLeft = vdupq_n_s16(redShift);
+	for (; pixel + 8 <= count; pixel += 8) {
+		const uint16x8_t a = vld1q_u16(from + pixel);
+		const uint16x8_t b = vld1q_u16(to + pixel);
+		const uint16x8_t red = vmlaq_u16(vmulq_u16(vandq_u16(vshlq_u16(a, shiftRedRight), mask5), fromWeight), vandq_u16(vshlq_u16(b, shiftRedRight), mask5), toWeight);
+		const uint16x8_t green = vmlaq_u16(vmulq_u16(vandq_u16(vshrq_n_u16(a, 5), maskGreen), fromWeight), vandq_u16(vshrq_n_u16(b, 5), maskGreen), toWeight);
+		const uint16x8_t blue = vmlaq_u16(vmulq_u16(vandq_u16(a, mask5), fromWeight), vandq_u16(b, mask5), toWeight);
+		const uint16x8_t result = vorrq_u16(vorrq_u16(vshlq_u16(vmovl_u8(div255_u16(red)), shiftRedLeft), vshlq_n_u16(vmovl_u8(div255_u16(green)), 5)), vorrq_u16(vmovl_u8(div255_u16(blue)), fill));
+		vst1q_u16(dest + pixel, result);
+	}
+#endif
+	for (; pixel < count; ++pixel) {
+		const uint32_t red = div255(((from[pixel] >> redShift) & 0x1f) * (255 - weight) + ((to[pixel] >> redShift) & 0x1f) * weight);
+		const uint32_t green = div255(((from[pixel] >> 5) & greenMask) * (255 - weight) + ((to[pixel] >> 5) & greenMask) * weight);
+		const uint32_t blue = div255((from[pixel] & 0x1f) * (255 - weight) + (to[pixel] & 0x1f) * weight);
+		dest[pixel] = fillBits | red << redShift | green << 5 | blue;
+	}
+}
+
+void PixelOps::unpackLine(uint32_t * dest, const uint8_t * source, Framebuffer::PixelFormat sourceFormat, size_t count)
+{
+	size_t pixel = 0;
+	if (sourceFormat == Framebuffer::GREY8) {
+#if defined(__SSE2__)
+		//duplicate every Byte twice to get 16 pixels at once
+		const __m128i alpha = _mm_set1_epi32(0xff000000);
+		for (; pixel + 16 <= count; pixel += 16) {
+			const __m128i grey = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + pixel));
+			const __m128i lo = _mm_unpacklo_epi8(grey, grey);
+			const __m128i hi = _mm_unpackhi_epi8(grey, grey);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + pixel), _mm_or_si128(_mm_unpacklo_epi16(lo, lo), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + pixel + 4), _mm_or_si128(_mm_unpackhi_epi16(lo, lo), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + pixel + 8), _mm_or_si128(_mm_unpacklo_epi16(hi, hi), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + pixel + 12), _mm_or_si128(_mm_unpackhi_epi16(hi, hi), alpha));
+		}
+#elif defined(PIXELOPS_NEON)
+		//store the grey plane as blue, green and red plane
+		uint8x16x4_t dst;
+		dst.val[3] = vdupq_n_u8(255);
+		for (; pixel + 16 <= count; pixel += 16) {
+			dst.val[0] = dst.val[1] = dst.val[2] = vld1q_u8(source + pixel);
+			vst4q_u8(reinterpret_cast<uint8_t *>(dest + pixel), dst);
+		}
+#endif
+		for (; pixel < count; ++pixel) {
+			dest[pixel] = 0xff000000 | source[pixel] << 16 | source[pixel] << 8 | source[pixel];
+		}
+	}
+	else if (sourceFormat == Framebuffer::PALETTE8) {
+		//fixed R3G3B2 palette
+		for (; pixel < count; ++pixel, dest++, source++) {
+			const uint32_t red = *source >> 5;
+			const uint32_t green = (*source >> 2) & 0x07;
+			const uint32_t blue = *source & 0x03;
+			*dest = 0xff000000 | (red << 5 | red << 2 | red >> 1) << 16 | (green << 5 | green << 2 | green >> 1) << 8 | blue * 0x55;
+		}
+	}
+	else if (sourceFormat == Framebuffer::X8R8G8B8 || sourceFormat == Framebuffer::A8R8G8B8) {
+		const uint32_t * src = reinterpret_cast<const uint32_t *>(source);
+#if defined(__SSE2__)
+		const __m128i alpha = _mm_set1_epi32(0xff000000);
+		for (; pixel + 4 <= count; pixel += 4) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + pixel), _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + pixel)), alpha));
+		}
+#elif defined(PIXELOPS_NEON)
+		const uint32x4_t alpha = vdupq_n_u32(0xff000000);
+		for (; pixel + 4 <= count; pixel += 4) {
+			vst1q_u32(dest + pixel, vorrq_u32(vld1q_u32(src + pixel), alpha));
+		}
+#endif
+		for (; pixel < count; ++pixel) {
+			dest[pixel] = 0xff000000 | src[pixel];
+		}
+	}
+	else if (sourceFormat != Framebuffer::BAD_PIXELFORMAT) {
+		//the generic kernels have vector paths for all other layouts and give the same results as plain conversion
+		unpackGeneric(dest, source, sourceFormat, count);
+	}
+}
+
+void PixelOps::unpackGeneric(uint32_t * dest, const uint8_t * source, Framebuffer::PixelFormat sourceFormat, size_t count)
+{
+	const Layout & layout = getLayout(sourceFormat);
+	const uint32_t bytesPerPixel = layout.bytesPerPixel;
+	size_t pixel = 0;
+	if (layout.byteChannels) {
+#if defined(PIXELOPS_SSSE3)
+		if (hasSSSE3()) {
+			pixel = unpackShuffle(dest, source, layout, count);
+		}
+#elif defined(PIXELOPS_NEON)
+		//load 16 pixels deinterleaved to Byte planes and store the planes in X8R8G8B8 order
+		uint8x16x4_t dst;
+		dst.val[3] = vdupq_n_u8(255);
+		if (bytesPerPixel == 4) {
+			for (; pixel + 16 <= count; pixel += 16) {
+				const uint8x16x4_t src = vld4q_u8(source + pixel * 4);
+				for (uint32_t channel = 0; channel < 3; ++channel) {
+					dst.val[2 - channel] = src.val[layout.channelByte[channel]];
+				}
+				vst4q_u8(reinterpret_cast<uint8_t *>(dest + pixel), dst);
+			}
+		}
+		else {
+			for (; pixel + 16 <= count; pixel += 16) {
+				const uint8x16x3_t src = vld3q_u8(source + pixel * 3);
+				for (uint32_t channel = 0; channel < 3; ++channel) {
+					dst.val[2 - channel] = src.val[layout.channelByte[channel]];
+				}
+				vst4q_u8(reinterpret_cast<uint8_t *>(dest + pixel), dst);
+			}
+		}
+#endif
+		const uint32_t redByte = layout.channelByte[0];
+		const uint32_t greenByte = layout.channelByte[1];
+		const uint32_t blueByte = layout.channelByte[2];
+		for (; pixel < count; ++pixel) {
+			const uint8_t * src = source + pixel * bytesPerPixel;
+			dest[pixel] = 0xff000000 | src[redByte] << 16 | src[greenByte] << 8 | src[blueByte];
+		}
+	}
+	else {
+#if defined(__SSE2__)
+		if (bytesPerPixel == 2 && layout.shortChannels) {
+			//8 pixels at once. shift counts come from the layout, so use the variants taking counts from a register
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i alpha = _mm_set1_epi32(0xff000000);
+			__m128i shift[3];
+			__m128i mask[3];
+			__m128i expandLeft[3];
+			__m128i expandRight[3];
+			for (uint32_t channel = 0; channel < 3; ++channel) {
+				shift[channel] = _mm_cvtsi32_si128(layout.shift[channel]);
+				mask[channel] = _mm_set1_epi32((1 << layout.bits[channel]) - 1);
+				expandLeft[channel] = _mm_cvtsi32_si128(8 - layout.bits[channel]);
+				expandRight[channel] = _mm_cvtsi32_si128(2 * layout.bits[channel] - 8);
+			}
+			for (; pixel + 8 <= count; pixel += 8) {
+				const __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + pixel * 2));
+				for (uint32_t half = 0; half < 2; ++half) {
+					const __m128i values = half == 0 ? _mm_unpacklo_epi16(src, zero) : _mm_unpackhi_epi16(src, zero);
+					__m128i result = alpha;
+					for (uint32_t channel = 0; channel < 3; ++channel) {
+						const __m128i value = _mm_and_si128(_mm_srl_epi32(values, shift[channel]), mask[channel]);
+						const __m128i expanded = _mm_or_si128(_mm_sll_epi32(value, expandLeft[channel]), _mm_srl_epi32(value, expandRight[channel]));
+						result = _mm_or_si128(result, _mm_sll_epi32(expanded, _mm_cvtsi32_si128(16 - 8 * channel)));
+					}
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + pixel + half * 4), result);
+				}
+			}
+		}
+#elif defined(PIXELOPS_NEON)
+		if (bytesPerPixel == 2 && layout.shortChannels) {
+			//8 pixels at once. negative shift counts shift right
+			const uint32x4_t alpha = vdupq_n_u32(0xff000000);
+			int32x4_t shiftRight[3];
+			uint32x4_t mask[3];
+			int32x4_t expandLeft[3];
+			int32x4_t expandRight[3];
+			int32x4_t position[3];
+			for (uint32_t channel = 0; channel < 3; ++channel) {
+				shiftRight[channel] = vdupq_n_s32(-(int32_t)layout.shift[channel]);
+				mask[channel] = vdupq_n_u32((1 << layout.bits[channel]) - 1);
+				expandLeft[channel] = vdupq_n_s32(8 - layout.bits[channel]);
+				expandRight[channel] = vdupq_n_s32(-(int32_t)(2 * layout.bits[channel] - 8));
+				position[channel] = vdupq_n_s32(16 - 8 * channel);
+			}
+			for (; pixel + 8 <= count; pixel += 8) {
+				const uint16x8_t src = vld1q_u16(reinterpret_cast<const uint16_t *>(source + pixel * 2));
+				for (uint32_t half = 0; half < 2; ++half) {
+					const uint32x4_t values = vmovl_u16(half == 0 ? vget_low_u16(src) : vget_high_u16(src));
+					uint32x4_t result = alpha;
+					for (uint32_t channel = 0; channel < 3; ++channel) {
+						const uint32x4_t value = vandq_u32(vshlq_u32(values, shiftRight[channel]), mask[channel]);
+						const uint32x4_t expanded = vorrq_u32(vshlq_u32(value, expandLeft[channel]), vshlq_u32(value, expandRight[channel]));
+						result = vorrq_u32(result, vshlq_u32(expanded, position[channel]));
+					}
+					vst1q_u32(dest + pixel + half * 4, result);
+				}
+			}
+		}
+#endif
+		for (; pixel < count; ++pixel) {
+			uint32_t value = 0;
+			memcpy(&value, source + pixel * bytesPerPixel, bytesPerPixel);
+			uint32_t result = 0xff000000;
+			for (uint32_t channel = 0; channel < 3; ++channel) {
+				result |= expandChannel((value >> layout.shift[channel]) & ((1 << layout.bits[channel]) - 1), layout.bits[channel]) << (16 - 8 * channel);
+			}
+			dest[pixel] = result;
+		}
+	}
+}
+
+void PixelOps::packGeneric(uint8_t * dest, Framebuffer::PixelFormat destFormat, const uint32_t * source, size_t count)
+{
+	const Layout & layout = getLayout(destFormat);
+	const uint32_t bytesPerPixel = layout.bytesPerPixel;
+	size_t pixel = 0;
+	if (layout.byteChannels) {
+#if defined(PIXELOPS_SSSE3)
+		if (hasSSSE3()) {
+			pixel = packShuffle(dest, source, layout, count);
+		}
+#elif defined(PIXELOPS_NEON)
+		//load 16 pixels deinterleaved to Byte planes and store the planes in destination order
+		const uint8x16_t fill = vdupq_n_u8(255);
+		if (bytesPerPixel == 4) {
+			for (; pixel + 16 <= count; pixel += 16) {
+				const uint8x16x4_t src = vld4q_u8(reinterpret_cast<const uint8_t *>(source + pixel));
+				uint8x16x4_t dst;
+				for (uint32_t byte = 0; byte < 4; ++byte) {
+					dst.val[byte] = layout.byteChannel[byte] < 4 ? src.val[layout.byteChannel[byte]] : fill;
+				}
+				vst4q_u8(dest + pixel * 4, dst);
+			}
+		}
+		else {
+			for (; pixel + 16 <= count; pixel += 16) {
+				const uint8x16x4_t src = vld4q_u8(reinterpret_cast<const uint8_t *>(source + pixel));
+				uint8x16x3_t dst;
+				for (uint32_t byte = 0; byte < 3; ++byte) {
+					dst.val[byte] = layout.byteChannel[byte] < 4 ? src.val[layout.byteChannel[byte]] : fill;
+				}
+				vst3q_u8(dest + pixel * 3, dst);
+			}
+		}
+#endif
+		for (; pixel < count; ++pixel) {
+			const uint8_t * src = reinterpret_cast<const uint8_t *>(source + pixel);
+			uint8_t * dst = dest + pixel * bytesPerPixel;
+			for (uint32_t byte = 0; byte < bytesPerPixel; ++byte) {
+				dst[byte] = layout.byteChannel[byte] < 4 ? src[layout.byteChannel[byte]] : 0xff;
+			}
+		}
+	}
+	else {
+#if defined(__SSE2__)
+		if (bytesPerPixel == 2 && layout.shortChannels) {
+			//8 pixels at once. shift counts come from the layout, so use the variants taking counts from a register
+			const __m128i fill = _mm_set1_epi32(layout.fill);
+			__m128i shiftRight[3];
+			__m128i shiftLeft[3];
+			__m128i mask[3];
+			for (uint32_t channel = 0; channel < 3; ++channel) {
+				shiftRight[channel] = _mm_cvtsi32_si128(16 - 8 * channel + 8 - layout.bits[channel]);
+				shiftLeft[channel] = _mm_cvtsi32_si128(layout.shift[channel]);
+				mask[channel] = _mm_set1_epi32((1 << layout.bits[channel]) - 1);
+			}
+			for (; pixel + 8 <= count; pixel += 8) {
+				__m128i halves[2];
+				for (uint32_t half = 0; half < 2; ++half) {
+					const __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + pixel + half * 4));
+					__m128i result = fill;
+					for (uint32_t channel = 0; channel < 3; ++channel) {
+						result = _mm_or_si128(result, _mm_sll_epi32(_mm_and_si128(_mm_srl_epi32(src, shiftRight[channel]), mask[channel]), shiftLeft[channel]));
+					}
+					//sign-extend the low 16 bits, so saturating packing keeps them as they are
+					halves[half] = _mm_srai_epi32(_mm_slli_epi32(result, 16), 16);
+				}
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + pixel * 2), _mm_packs_epi32(halves[0], halves[1]));
+			}
+		}
+#elif defined(PIXELOPS_NEON)
+		if (bytesPerPixel == 2 && layout.shortChannels) {
+			//8 pixels at once. negative shift counts shift right
+			const uint32x4_t fill = vdupq_n_u32(layout.fill);
+			int32x4_t shiftRight[3];
+			int32x4_t shiftLeft[3];
+			uint32x4_t mask[3];
+			for (uint32_t channel = 0; channel < 3; ++channel) {
+				shiftRight[channel] = vdupq_n_s32(-(int32_t)(16 - 8 * channel + 8 - layout.bits[channel]));
+				shiftLeft[channel] = vdupq_n_s32(layout.shift[channel]);
+				mask[channel] = vdupq_n_u32((1 << layout.bits[channel]) - 1);
+			}
+			for (; pixel + 8 <= count; pixel += 8) {
+				uint16x4_t halves[2];
+				for (uint32_t half = 0; half < 2; ++half) {
+					const uint32x4_t src = vld1q_u32(source + pixel + half * 4);
+					uint32x4_t result = fill;
+					for (uint32_t channel = 0; channel < 3; ++channel) {
+						result = vorrq_u32(result, vshlq_u32(vandq_u32(vshlq_u32(src, shiftRight[channel]), mask[channel]), shiftLeft[channel]));
+					}
+					halves[half] = vmovn_u32(result);
+				}
+				vst1q_u16(reinterpret_cast<uint16_t *>(dest + pixel * 2), vcombine_u16(halves[0], halves[1]));
+			}
+		}
+#endif
+		for (; pixel < count; ++pixel) {
+			uint32_t value = layout.fill;
+			for (uint32_t channel = 0; channel < 3; ++channel) {
+				value |= reduceChannel((source[pixel] >> (16 - 8 * channel)) & 0xff, layout.bits[channel]) << layout.shift[channel];
+			}
+			memcpy(dest + pixel * bytesPerPixel, &value, bytesPerPixel);
+		}
+	}
+}
+
+void PixelOps::packLine(uint8_t * dest, Framebuffer::PixelFormat destFormat, const uint32_t * source, size_t count)
+{
+	size_t pixel = 0;
+	if (destFormat == Framebuffer::GREY8) {
+#if defined(__SSE2__)
+		//sum channels of 8 pixels in 16bit lanes and divide by 3 with a multiplication. (sum * 21846) >> 16 is exact for sums up to 765
+		const __m128i mask = _mm_set1_epi32(0xff);
+		const __m128i third = _mm_set1_epi16(21846);
+		const __m128i zero = _mm_setzero_si128();
+		for (; pixel + 8 <= count; pixel += 8) {
+			__m128i sums[2];
+			for (uint32_t half = 0; half < 2; ++half) {
+				const __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + pixel + half * 4));
+				sums[half] = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(src, mask), _mm_and_si128(_mm_srli_epi32(src, 8), mask)), _mm_and_si128(_mm_srli_epi32(src, 16), mask));
+			}
+			const __m128i grey = _mm_mulhi_epu16(_mm_packs_epi32(sums[0], sums[1]), third);
+			_mm_storel_epi64(reinterpret_cast<__m128i *>(dest + pixel), _mm_packus_epi16(grey, zero));
+		}
+#elif defined(PIXELOPS_NEON)
+		//sum channel planes of 8 pixels in 16bit lanes and divide by 3 with a multiplication. (sum * 21846) >> 16 is exact for sums up to 765
+		const uint16x4_t third = vdup_n_u16(21846);
+		for (; pixel + 8 <= count; pixel += 8) {
+			const uint8x8x4_t src = vld4_u8(reinterpret_cast<const uint8_t *>(source + pixel));
+			const uint16x8_t sum = vaddw_u8(vaddl_u8(src.val[0], src.val[1]), src.val[2]);
+			const uint16x8_t grey = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(sum), third), 16), vshrn_n_u32(vmull_u16(vget_high_u16(sum), third), 16));
+			vst1_u8(dest + pixel, vmovn_u16(grey));
+		}
+#endif
+		for (; pixel < count; ++pixel) {
+			dest[pixel] = (((source[pixel] >> 16) & 0xff) + ((source[pixel] >> 8) & 0xff) + (source[pixel] & 0xff)) / 3;
+		}
+	}
+	else if (destFormat == Framebuffer::PALETTE8) {
+		//fixed R3G3B2 palette. round to the nearest entry like Palette does
+		for (; pixel < count; ++pixel, dest++, source++) {
+			const uint32_t red = (((*source >> 16) & 0xff) * 7 + 127) / 255;
+			const uint32_t green = (((*source >> 8) & 0xff) * 7 + 127) / 255;
+			const uint32_t blue = ((*source & 0xff) * 3 + 127) / 255;
+			*dest = red << 5 | green << 2 | blue;
+		}
+	}
+	else if (destFormat == Framebuffer::X8R8G8B8 || destFormat == Framebuffer::A8R8G8B8) {
+		uint32_t * dst = reinterpret_cast<uint32_t *>(dest);
+#if defined(__SSE2__)
+		const __m128i alpha = _mm_set1_epi32(0xff000000);
+		for (; pixel + 4 <= count; pixel += 4) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + pixel), _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(source + pixel)), alpha));
+		}
+#elif defined(PIXELOPS_NEON)
+		const uint32x4_t alpha = vdupq_n_u32(0xff000000);
+		for (; pixel + 4 <= count; pixel += 4) {
+			vst1q_u32(dst + pixel, vorrq_u32(vld1q_u32(source + pixel), alpha));
+		}
+#endif
+		for (; pixel < count; ++pixel) {
+			dst[pixel] = 0xff000000 | source[pixel];
+		}
+	}
+	else if (destFormat != Framebuffer::BAD_PIXELFORMAT) {
+		//the generic kernels have vector paths for all other layouts and give the same results as plain conversion
+		packGeneric(dest, destFormat, source, count);
+	}
+}
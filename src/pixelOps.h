@@ -0,0 +1,94 @@
+#pragma once
+
+#include "framebuffer.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+
+
+/*!
+Row kernels for pixel data. The blending, interpolation and conversion kernels use SSE2 or NEON if the compiler targets it and fall back to plain C++ otherwise.
+The Byte shuffles of the generic conversion kernels use SSSE3 on x86 if the CPU has it, no matter what the compiler targets.
+Scanlines are processed one at a time, so callers can keep working data in the cache.
+*/
+class PixelOps
+{
+public:
+	/*!
+	Premultiply color channels of straight alpha A8R8G8B8 pixels with their alpha value.
+	\param[in, out] data Pixel data. Converted in place.
+	\param[in] count Number of consecutive pixels to convert.
+	*/
+	static void premultiplyAlpha(uint32_t * data, size_t count);
+
+	/*!
+	Set the alpha channel of X8R8G8B8 pixels to opaque, so they can be used as A8R8G8B8 pixels.
+	\param[in, out] data Pixel data. Converted in place.
+	\param[in] count Number of consecutive pixels to convert.
+	*/
+	static void setOpaque(uint32_t * data, size_t count);
+
+	/*!
+	Blend premultiplied A8R8G8B8 pixels over X8R8G8B8 pixels: dest = source * opacity + dest * (1 - alpha * opacity).
+	\param[in, out] dest X8R8G8B8 destination pixels. Blended pixels are made opaque, pixels under fully transparent source pixels may be left untouched.
+	\param[in] source Premultiplied A8R8G8B8 source pixels.
+	\param[in] count Number of consecutive pixels to blend.
+	\param[in] opacity Optional. Global opacity applied to all source pixels. 255 is opaque.
+	*/
+	static void blendLine(uint32_t * dest, const uint32_t * source, size_t count, uint8_t opacity = 255);
+
+	/*!
+	Linearly interpolate between two scanlines in their native pixel format: dest = from * (1 - weight) + to * weight.
+	Packed formats are unpacked to separate channels and palette indices to colors, so they interpolate correctly.
+	\param[out] dest Destination pixels. May be the same as \sa from or \sa to.
+	\param[in] from Pixels to interpolate from.
+	\param[in] to Pixels to interpolate to.
+	\param[in] format Pixel format of all scanlines.
+	\param[in] count Number of consecutive pixels to interpolate.
+	\param[in] weight Weight of \sa to. 0 returns \sa from, 255 returns \sa to.
+	*/
+	static void lerpLine(uint8_t * dest, const uint8_t * from, const uint8_t * to, Framebuffer::PixelFormat format, size_t count, uint8_t weight);
+
+	/*!
+	Convert a scanline from a framebuffer pixel format to X8R8G8B8.
+	\param[out] dest X8R8G8B8 destination pixels.
+	\param[in] source Source pixels.
+	\param[in] sourceFormat Source pixel format.
+	\param[in] count Number of consecutive pixels to convert.
+	\note PALETTE8 pixels are indices into the fixed R3G3B2 palette here. Use \sa Palette for other palettes.
+	*/
+	static void unpackLine(uint32_t * dest, const uint8_t * source, Framebuffer::PixelFormat sourceFormat, size_t count);
+
+	/*!
+	Convert a scanline from X8R8G8B8 to a framebuffer pixel format.
+	\param[out] dest Destination pixels.
+	\param[in] destFormat Destination pixel format.
+	\param[in] source X8R8G8B8 source pixels.
+	\param[in] count Number of consecutive pixels to convert.
+	\note PALETTE8 pixels are indices into the fixed R3G3B2 palette here. Use \sa Palette for other palettes.
+	*/
+	static void packLine(uint8_t * dest, Framebuffer::PixelFormat destFormat, const uint32_t * source, size_t count);
+
+private:
+	/*!
+	Interpolate single bytes. Used for all formats with 8bit channels.
+	*/
+	static void lerpBytes(uint8_t * dest, const uint8_t * from, const uint8_t * to, size_t count, uint8_t weight);
+
+	/*!
+	Interpolate 16bit pixels channel by channel.
+	\param[in] greenBits Number of bits of the green channel. 6 for R5G6B5 or 5 for X1R5G5B5.
+	*/
+	static void lerp16(uint16_t * dest, const uint16_t * from, const uint16_t * to, size_t count, uint8_t weight, uint32_t greenBits);
+
+	/*!
+	Convert a scanline of any format with RGB channels to X8R8G8B8. The channel layout is taken from Framebuffer::getPixelFormatInfo(), so the layouts of devices work too.
+	Formats with 8bit channels are converted with byte shuffles, packed formats with shifts and masks.
+	*/
+	static void unpackGeneric(uint32_t * dest, const uint8_t * source, Framebuffer::PixelFormat sourceFormat, size_t count);
+
+	/*!
+	Convert a X8R8G8B8 scanline to any format with RGB channels. See \sa unpackGeneric().
+	*/
+	static void packGeneric(uint8_t * dest, Framebuffer::PixelFormat destFormat, const uint32_t * source, size_t count);
+};
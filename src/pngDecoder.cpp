@@ -0,0 +1,216 @@
+#include "pngDecoder.h"
+
+#include <cstring>
+#include <algorithm>
+#include <png.h>
+
+
+/*! Position in the file libpng reads from. */
+struct PngSource
+{
+	const uint8_t * data;
+	size_t size;
+	size_t offset;
+};
+
+static void pngRead(png_structp png, png_bytep out, png_size_t length)
+{
+	PngSource * source = static_cast<PngSource *>(png_get_io_ptr(png));
+	if (length > source->size - source->offset)
+	{
+		png_error(png, "Read past end of file");
+	}
+	memcpy(out, source->data + source->offset, length);
+	source->offset += length;
+}
+
+static void pngError(png_structp png, png_const_charp)
+{
+	//broken files fall back to FreeImage, which reports the error
+	png_longjmp(png, 1);
+}
+
+static void pngWarning(png_structp, png_const_charp)
+{
+}
+
+const char * PngDecoder::getName() const
+{
+	return "libpng";
+}
+
+bool PngDecoder::canDecode(const MappedFile & file) const
+{
+	return file.getSize() > 8 && png_sig_cmp(file.getData(), 0, 8) == 0;
+}
+
+bool PngDecoder::readInfo(const MappedFile & file, Info & info) const
+{
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, pngError, pngWarning);
+	png_infop pngInfo = png != nullptr ? png_create_info_struct(png) : nullptr;
+	if (pngInfo == nullptr)
+	{
+		png_destroy_read_struct(&png, nullptr, nullptr);
+		return false;
+	}
+	if (setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_read_struct(&png, &pngInfo, nullptr);
+		return false;
+	}
+	PngSource source = {file.getData(), file.getSize(), 0};
+	png_set_read_fn(png, &source, pngRead);
+	//reads all chunks up to the image data
+	png_read_info(png, pngInfo);
+	info.width = png_get_image_width(png, pngInfo);
+	info.height = png_get_image_height(png, pngInfo);
+	info.orientation = ImageIO::orientationFromExif(1);
+#ifdef PNG_eXIf_SUPPORTED
+	//the EXIF chunk is only found if it is stored before the image data, which is what writers should do
+	png_uint_32 exifSize = 0;
+	png_bytep exif = nullptr;
+	if (png_get_eXIf_1(png, pngInfo, &exifSize, &exif) != 0 && exif != nullptr)
+	{
+		info.orientation = readExifOrientation(exif, exifSize);
+	}
+#endif
+	png_destroy_read_struct(&png, &pngInfo, nullptr);
+	return true;
+}
+
+uint32_t PngDecoder::getMaxScaleDenominator() const
+{
+	return 8;
+}
+
+bool PngDecoder::decode(const MappedFile & file, uint8_t * dest, uint32_t destLineLength, uint32_t scaleDenominator) const
+{
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, pngError, pngWarning);
+	png_infop pngInfo = png != nullptr ? png_create_info_struct(png) : nullptr;
+	if (pngInfo == nullptr)
+	{
+		png_destroy_read_struct(&png, nullptr, nullptr);
+		return false;
+	}
+	//buffers are changed after setjmp, so they must be volatile to be freed correctly after an error
+	png_bytep volatile image = nullptr;
+	png_uint_32p volatile sums = nullptr;
+	if (setjmp(png_jmpbuf(png)))
+	{
+		png_free(png, image);
+		png_free(png, sums);
+		png_destroy_read_struct(&png, &pngInfo, nullptr);
+		return false;
+	}
+	PngSource source = {file.getData(), file.getSize(), 0};
+	png_set_read_fn(png, &source, pngRead);
+	png_read_info(png, pngInfo);
+	//let libpng expand every format to 8bit B,G,R,A
+	const int colorType = png_get_color_type(png, pngInfo);
+	if (png_get_bit_depth(png, pngInfo) == 16)
+	{
+		png_set_scale_16(png);
+	}
+	if (colorType == PNG_COLOR_TYPE_PALETTE)
+	{
+		png_set_palette_to_rgb(png);
+	}
+	if (colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA)
+	{
+		png_set_expand_gray_1_2_4_to_8(png);
+		png_set_gray_to_rgb(png);
+	}
+	if (png_get_valid(png, pngInfo, PNG_INFO_tRNS))
+	{
+		png_set_tRNS_to_alpha(png);
+	}
+	png_set_bgr(png);
+	png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+	//interlaced images need all passes before any row is complete, so they are read to a full-size buffer
+	const int passes = png_set_interlace_handling(png);
+	png_read_update_info(png, pngInfo);
+	const uint32_t width = png_get_image_width(png, pngInfo);
+	const uint32_t height = png_get_image_height(png, pngInfo);
+	const size_t lineLength = (size_t)width * 4;
+	if (passes == 1 && scaleDenominator == 1)
+	{
+		//the common case. libpng writes rows straight into the destination
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			png_read_row(png, dest + (size_t)y * destLineLength, nullptr);
+		}
+		png_read_end(png, nullptr);
+		png_destroy_read_struct(&png, &pngInfo, nullptr);
+		return true;
+	}
+	if (passes == 1)
+	{
+		image = static_cast<png_bytep>(png_malloc(png, lineLength));
+	}
+	else
+	{
+		image = static_cast<png_bytep>(png_malloc(png, lineLength * height));
+		for (int pass = 0; pass < passes; ++pass)
+		{
+			for (uint32_t y = 0; y < height; ++y)
+			{
+				png_read_row(png, image + y * lineLength, nullptr);
+			}
+		}
+	}
+	//box-filter scaleDenominator x scaleDenominator pixels to one pixel. columns are summed up over the rows of a block
+	const uint32_t scaledWidth = scaledSize(width, scaleDenominator);
+	const size_t sumCount = (size_t)scaledWidth * 4;
+	sums = static_cast<png_uint_32p>(png_malloc(png, sumCount * sizeof(png_uint_32)));
+	memset(sums, 0, sumCount * sizeof(png_uint_32));
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const uint8_t * row = image;
+		if (passes == 1)
+		{
+			png_read_row(png, image, nullptr);
+		}
+		else
+		{
+			row += y * lineLength;
+		}
+		if (scaleDenominator == 1)
+		{
+			memcpy(dest + (size_t)y * destLineLength, row, sumCount);
+			continue;
+		}
+		const uint8_t * pixel = row;
+		for (uint32_t x = 0; x < scaledWidth; ++x)
+		{
+			const uint32_t columns = std::min(scaleDenominator, width - x * scaleDenominator);
+			png_uint_32p sum = sums + x * 4;
+			for (uint32_t i = 0; i < columns; ++i, pixel += 4)
+			{
+				sum[0] += pixel[0];
+				sum[1] += pixel[1];
+				sum[2] += pixel[2];
+				sum[3] += pixel[3];
+			}
+		}
+		//block complete. write average of its pixels
+		if ((y + 1) % scaleDenominator == 0 || y + 1 == height)
+		{
+			const uint32_t rows = y + 1 - (y / scaleDenominator) * scaleDenominator;
+			uint8_t * destPixel = dest + (size_t)(y / scaleDenominator) * destLineLength;
+			for (uint32_t x = 0; x < scaledWidth; ++x, destPixel += 4)
+			{
+				const uint32_t count = rows * std::min(scaleDenominator, width - x * scaleDenominator);
+				png_uint_32p sum = sums + x * 4;
+				for (int c = 0; c < 4; ++c)
+				{
+					destPixel[c] = (uint8_t)((sum[c] + count / 2) / count);
+					sum[c] = 0;
+				}
+			}
+		}
+	}
+	png_free(png, image);
+	png_free(png, sums);
+	png_destroy_read_struct(&png, &pngInfo, nullptr);
+	return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "decoder.h"
+
+
+/*!
+Decodes PNG files with libpng. Rows are expanded to X8R8G8B8 by libpng and written directly to the destination.
+Scaled images are box-filtered while the rows are read, so the full-size image is never stored.
+*/
+class PngDecoder : public Decoder
+{
+public:
+	const char * getName() const override;
+	bool canDecode(const MappedFile & file) const override;
+	bool readInfo(const MappedFile & file, Info & info) const override;
+	uint32_t getMaxScaleDenominator() const override;
+	bool decode(const MappedFile & file, uint8_t * dest, uint32_t destLineLength, uint32_t scaleDenominator = 1) const override;
+};
@@ -0,0 +1,164 @@
+#include "prerender.h"
+#include "imageIO.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <sys/stat.h>
+
+
+//file in the output directory remembering the target the frames were rendered for
+static const char * TARGET_FILE_NAME = ".target";
+
+bool Prerenderer::parseTarget(const std::string & description, Target & target)
+{
+	//split into WIDTHxHEIGHT, FORMAT and optional line length
+	unsigned int width = 0;
+	unsigned int height = 0;
+	char format[32] = {0};
+	unsigned int lineLength = 0;
+	const int fields = sscanf(description.c_str(), "%ux%u@%31[^:]:%u", &width, &height, format, &lineLength);
+	if (fields < 3 || width == 0 || height == 0) {
+		return false;
+	}
+	target.width = width;
+	target.height = height;
+	target.format = Framebuffer::pixelFormatFromString(format);
+	if (target.format == Framebuffer::BAD_PIXELFORMAT) {
+		return false;
+	}
+	const uint32_t minLineLength = width * Framebuffer::getPixelFormatInfo(target.format).bytesPerPixel;
+	target.lineLength = (fields == 4) ? lineLength : minLineLength;
+	return target.lineLength >= minLineLength;
+}
+
+std::string Prerenderer::targetToString(const Target & target)
+{
+	std::ostringstream description;
+	description << target.width << "x" << target.height << "@" << Framebuffer::getPixelFormatInfo(target.format).name << ":" << target.lineLength;
+	return description.str();
+}
+
+Prerenderer::Prerenderer(const Target & target, const std::string & outputDirectory, uint32_t threadCount)
+	: m_target(target)
+	, m_outputDirectory(outputDirectory)
+	, m_threadPool(threadCount)
+{
+}
+
+bool Prerenderer::isUpToDate(const std::string & inputFile, const std::string & frameFile, const Target & target)
+{
+	struct stat inputInfo;
+	struct stat outputInfo;
+	if (stat(inputFile.c_str(), &inputInfo) != 0 || stat(frameFile.c_str(), &outputInfo) != 0) {
+		return false;
+	}
+	if (outputInfo.st_size != (off_t)target.height * target.lineLength) {
+		return false;
+	}
+	//frame must have been written after the image was last modified
+	if (outputInfo.st_mtim.tv_sec != inputInfo.st_mtim.tv_sec) {
+		return outputInfo.st_mtim.tv_sec > inputInfo.st_mtim.tv_sec;
+	}
+	return outputInfo.st_mtim.tv_nsec >= inputInfo.st_mtim.tv_nsec;
+}
+
+bool Prerenderer::renderFrame(const std::string & inputFile, const Target & target, ImageBuffer & frame)
+{
+	//load image fitted to target
+	uint32_t width = target.width;
+	uint32_t height = target.height;
+	ImageIO::Orientation orientation = {Framebuffer::ROTATE_0, false};
+	ImageBuffer data = ImageIO::loadFile_RGBA32(inputFile, width, height, true, &orientation);
+	if (data.empty()) {
+		return false;
+	}
+	//draw it the same way it would be displayed on the device: clear to black, blit centered
+	Framebuffer framebuffer(target.width, target.height, target.format, target.lineLength);
+	framebuffer.setOrientation(orientation.rotation, orientation.mirror);
+	const uint32_t black = 0;
+	uint8_t clearColor[4];
+	Framebuffer::convert(clearColor, 0, framebuffer.getFormat(), (const uint8_t *)&black, 0, Framebuffer::X8R8G8B8, 1);
+	framebuffer.clear(clearColor);
+	const uint32_t x = width < framebuffer.getWidth() ? (framebuffer.getWidth() - width) / 2 : 0;
+	const uint32_t y = height < framebuffer.getHeight() ? (framebuffer.getHeight() - height) / 2 : 0;
+	framebuffer.blit(x, y, data.data(), width, height, Framebuffer::X8R8G8B8);
+	//the framebuffer is rotated for the image, so its height may be the width of the frame
+	frame.assign(framebuffer.getData(), framebuffer.getData() + (size_t)target.lineLength * target.height);
+	return true;
+}
+
+bool Prerenderer::writeFrame(const std::string & frameFile, const ImageBuffer & frame)
+{
+	const std::string tempFile = frameFile + ".tmp";
+	std::ofstream out(tempFile.c_str(), std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char *>(frame.data()), (std::streamsize)frame.size());
+	out.close();
+	if (!out || rename(tempFile.c_str(), frameFile.c_str()) != 0) {
+		remove(tempFile.c_str());
+		return false;
+	}
+	return true;
+}
+
+Prerenderer::Result Prerenderer::renderFile(const std::string & inputFile, const std::string & outputFile, bool force) const
+{
+	if (!force && isUpToDate(inputFile, outputFile, m_target)) {
+		return SKIPPED;
+	}
+	ImageBuffer frame;
+	if (!renderFrame(inputFile, m_target, frame) || !writeFrame(outputFile, frame)) {
+		return FAILED;
+	}
+	return RENDERED;
+}
+
+bool Prerenderer::run(const std::string & inputDirectory)
+{
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point start = Clock::now();
+	//find all image files
+	std::vector<std::string> files;
+	if (!ImageIO::listImageFiles(inputDirectory, files)) {
+		return false;
+	}
+	//create output directory if needed
+	mkdir(m_outputDirectory.c_str(), 0755);
+	//frames rendered for a different target need to be rendered again
+	const std::string targetFile = m_outputDirectory + "/" + TARGET_FILE_NAME;
+	const std::string targetDescription = targetToString(m_target);
+	std::string lastTargetDescription;
+	std::ifstream lastTarget(targetFile.c_str());
+	std::getline(lastTarget, lastTargetDescription);
+	const bool force = (lastTargetDescription != targetDescription);
+	std::cout << "Prerendering " << files.size() << " images for " << targetDescription << " on " << m_threadPool.getThreadCount() << " threads..." << std::endl;
+	//render files in parallel
+	std::atomic<uint32_t> rendered(0);
+	std::atomic<uint32_t> skipped(0);
+	std::atomic<uint32_t> failed(0);
+	m_threadPool.parallelFor(files.size(), [&](size_t begin, size_t end) {
+		for (size_t index = begin; index < end; ++index) {
+			const Result result = renderFile(inputDirectory + "/" + files[index], m_outputDirectory + "/" + files[index] + ".raw", force);
+			if (result == RENDERED) {
+				rendered++;
+			}
+			else if (result == SKIPPED) {
+				skipped++;
+			}
+			else {
+				failed++;
+			}
+		}
+	}, 1);
+	//remember target, so the next run can skip unchanged files
+	if (force) {
+		std::ofstream(targetFile.c_str(), std::ios::trunc) << targetDescription << std::endl;
+	}
+	const double seconds = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count() / 1000.0;
+	std::cout << "Rendered " << rendered << ", skipped " << skipped << " unchanged and failed " << failed << " files in " << seconds << "s." << std::endl;
+	return failed == 0;
+}
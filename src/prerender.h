@@ -0,0 +1,89 @@
+#pragma once
+
+#include "framebuffer.h"
+#include "threadPool.h"
+
+#include <string>
+#include <vector>
+
+
+/*!
+Converts a folder of images to raw frames in the native format of a framebuffer, so devices only need to copy them to the screen.
+Images are fitted, centered and converted exactly as if they were displayed on the target framebuffer.
+Files are processed in parallel and files that have not changed since the last run are skipped.
+*/
+class Prerenderer
+{
+public:
+	/*! Description of the framebuffer the frames are rendered for. */
+	struct Target
+	{
+		uint32_t width;
+		uint32_t height;
+		Framebuffer::PixelFormat format;
+		uint32_t lineLength; //!<Length of a scanline in Bytes.
+	};
+
+	/*!
+	Parse target description.
+	\param[in] description Target in the form WIDTHxHEIGHT@FORMAT[:LINELENGTH], e.g. "800x480@R5G6B5:1600".
+	\param[out] target Upon return contains the target.
+	\return Returns false if the description is invalid.
+	*/
+	static bool parseTarget(const std::string & description, Target & target);
+
+	/*!
+	Convert target to a description that \sa parseTarget can read.
+	*/
+	static std::string targetToString(const Target & target);
+
+	/*!
+	Render an image to a frame the way it would be displayed on the target: fitted, rotated upright, centered and converted to the target format.
+	\param[in] inputFile Image file to load.
+	\param[in] target Framebuffer to render the frame for.
+	\param[out] frame Upon return contains target.height scanlines of target.lineLength Bytes.
+	\return Returns false if the image could not be loaded.
+	*/
+	static bool renderFrame(const std::string & inputFile, const Target & target, ImageBuffer & frame);
+
+	/*!
+	Write a frame to a file. The frame is written to a temporary file first and renamed, so readers never see half-written frames.
+	\return Returns false if the file could not be written.
+	*/
+	static bool writeFrame(const std::string & frameFile, const ImageBuffer & frame);
+
+	/*!
+	Check if frame file exists, has the right size for the target and is newer than the image file.
+	*/
+	static bool isUpToDate(const std::string & inputFile, const std::string & frameFile, const Target & target);
+
+	/*!
+	Construct prerenderer.
+	\param[in] target Framebuffer to render frames for.
+	\param[in] outputDirectory Directory to write frames to. Created if it does not exist.
+	\param[in] threadCount Optional. Number of files to process at the same time. Pass 0 to use one thread per CPU core.
+	*/
+	Prerenderer(const Target & target, const std::string & outputDirectory, uint32_t threadCount = 0);
+
+	/*!
+	Render all images in a directory. A frame is written to OUTPUTDIRECTORY/IMAGEFILENAME.raw for every image.
+	\param[in] inputDirectory Directory to read images from.
+	\return Returns false if any image could not be rendered.
+	*/
+	bool run(const std::string & inputDirectory);
+
+private:
+	enum Result { RENDERED, SKIPPED, FAILED };
+
+	/*!
+	Render a single image to a frame file.
+	\param[in] inputFile Image file to load.
+	\param[in] outputFile Frame file to write.
+	\param[in] force Pass true to render even if the frame file is up to date.
+	*/
+	Result renderFile(const std::string & inputFile, const std::string & outputFile, bool force) const;
+
+	Target m_target;
+	std::string m_outputDirectory;
+	ThreadPool m_threadPool;
+};
@@ -0,0 +1,58 @@
+#include "scratchArena.h"
+
+
+ScratchArena::ScratchArena(size_t blockSize)
+	: m_blockSize(blockSize)
+	, m_currentBlock(0)
+	, m_used(0)
+{
+}
+
+void ScratchArena::addBlock(size_t size)
+{
+	//over-allocate, so the start can be aligned
+	Block block = {std::unique_ptr<uint8_t[]>(new uint8_t[size + ALIGNMENT]), size};
+	m_blocks.push_back(std::move(block));
+}
+
+uint8_t * ScratchArena::allocate(size_t size)
+{
+	//round size up, so the next allocation stays aligned
+	size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	//find block with enough space left. blocks after the current one are unused
+	while (m_currentBlock < m_blocks.size() && m_used + size > m_blocks[m_currentBlock].size) {
+		m_currentBlock++;
+		m_used = 0;
+	}
+	if (m_currentBlock >= m_blocks.size()) {
+		addBlock(size > m_blockSize ? size : m_blockSize);
+		m_currentBlock = m_blocks.size() - 1;
+		m_used = 0;
+	}
+	uint8_t * start = m_blocks[m_currentBlock].memory.get();
+	uint8_t * aligned = start + ((ALIGNMENT - reinterpret_cast<uintptr_t>(start) % ALIGNMENT) % ALIGNMENT);
+	uint8_t * memory = aligned + m_used;
+	m_used += size;
+	return memory;
+}
+
+void ScratchArena::reset()
+{
+	//merge blocks, so the next round fits into one block
+	if (m_blocks.size() > 1) {
+		const size_t capacity = getCapacity();
+		m_blocks.clear();
+		addBlock(capacity);
+	}
+	m_currentBlock = 0;
+	m_used = 0;
+}
+
+size_t ScratchArena::getCapacity() const
+{
+	size_t capacity = 0;
+	for (auto blockIt = m_blocks.cbegin(); blockIt != m_blocks.cend(); ++blockIt) {
+		capacity += blockIt->size;
+	}
+	return capacity;
+}
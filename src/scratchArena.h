@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <inttypes.h>
+#include <cstddef>
+
+
+/*!
+Memory for temporary buffers that is reused instead of being allocated and freed for every operation.
+Allocations are taken from big blocks and are all released at once with \sa reset(). The memory itself is kept, so after
+the first use a repeated operation does not allocate at all. This avoids page faults and heap fragmentation on long-running devices.
+\note Not thread-safe. Use one arena per thread.
+*/
+class ScratchArena
+{
+public:
+	/*!
+	Construct empty arena.
+	\param[in] blockSize Optional. Minimum size of the memory blocks allocated from the system in Bytes.
+	*/
+	ScratchArena(size_t blockSize = 256 * 1024);
+
+	/*!
+	Get memory from arena. It is valid until \sa reset() is called.
+	\param[in] size Number of Bytes needed.
+	\return Returns memory aligned to 64 Bytes, so it can be used with any SIMD instruction set.
+	*/
+	uint8_t * allocate(size_t size);
+
+	/*!
+	Get memory for a number of items from arena. See \sa allocate().
+	*/
+	template <typename T>
+	T * allocate(size_t count)
+	{
+		return reinterpret_cast<T *>(allocate(count * sizeof(T)));
+	}
+
+	/*!
+	Release all allocations, but keep the memory for the next use.
+	If more than one block was needed, they are replaced by one block big enough for everything.
+	*/
+	void reset();
+
+	/*!
+	Get number of Bytes the arena holds.
+	*/
+	size_t getCapacity() const;
+
+private:
+	static const size_t ALIGNMENT = 64;
+
+	struct Block
+	{
+		std::unique_ptr<uint8_t[]> memory;
+		size_t size;
+	};
+
+	/*!
+	Add a block to the arena that can hold at least size Bytes.
+	*/
+	void addBlock(size_t size);
+
+	size_t m_blockSize;
+	std::vector<Block> m_blocks;
+	size_t m_currentBlock; //!<Index of block allocations are taken from.
+	size_t m_used; //!<Bytes used in current block, including alignment.
+};
@@ -0,0 +1,142 @@
+#include "slideshow.h"
+#include "imageIO.h"
+#include "terminalInput.h"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+
+Slideshow::Slideshow(Framebuffer & framebuffer, const std::vector<std::string> & files, Transition::Type transition, uint32_t transitionDuration, uint32_t delay, bool loop, uint32_t frameRate)
+	: m_framebuffer(framebuffer)
+	, m_files(files)
+	, m_transition(framebuffer, m_threadPool, transition, transitionDuration, frameRate)
+	, m_delay(delay)
+	, m_loop(loop)
+{
+}
+
+std::future<MappedFile> Slideshow::fetchFile(const std::string & fileName)
+{
+	//reading the whole file on another thread lets I/O overlap with decoding the current file
+	return std::async(std::launch::async, [fileName]() { return MappedFile(fileName, true); });
+}
+
+bool Slideshow::loadFrame(const MappedFile & file, Frame & frame) const
+{
+	const uint32_t screenWidth = m_framebuffer.getWidth();
+	const uint32_t screenHeight = m_framebuffer.getHeight();
+	uint32_t width = screenWidth;
+	uint32_t height = screenHeight;
+	ImageBuffer data;
+	if (file.isValid()) {
+		data = ImageIO::loadFile_RGBA32(file, width, height);
+	}
+	if (data.empty()) {
+		std::cout << "Failed to load image " << file.getFileName() << "!" << std::endl;
+		return false;
+	}
+	//frames are reused, so this only allocates for the first images
+	const Framebuffer::PixelFormat format = m_framebuffer.getFormat();
+	const uint32_t bytesPerPixel = m_framebuffer.getFormatInfo().bytesPerPixel;
+	const uint32_t lineLength = screenWidth * bytesPerPixel;
+	const uint8_t * oldData = frame.data();
+	frame.resize((size_t)lineLength * screenHeight);
+	//transitions run on a schedule. keep frames in memory, so a page fault can not make one late
+	if (frame.data() != oldData) {
+		ImageMemory::lock(frame.data(), frame.size());
+	}
+	//clear frame to black. convert the first scanline and copy it to the others
+	const uint32_t black = 0xff000000;
+	for (uint32_t pixel = 0; pixel < screenWidth; ++pixel) {
+		Framebuffer::convert(frame.data() + pixel * bytesPerPixel, 0, format, (const uint8_t *)&black, 0, Framebuffer::X8R8G8B8, 1);
+	}
+	for (uint32_t line = 1; line < screenHeight; ++line) {
+		memcpy(frame.data() + line * lineLength, frame.data(), lineLength);
+	}
+	//convert image straight into the center of the frame, so transitions and display are simple copies
+	width = std::min(width, screenWidth);
+	height = std::min(height, screenHeight);
+	const uint32_t x = (screenWidth - width) / 2;
+	const uint32_t y = (screenHeight - height) / 2;
+	Framebuffer::convert(frame.data() + y * lineLength + x * bytesPerPixel, lineLength, format, data.data(), 0, Framebuffer::X8R8G8B8, width, height);
+	return true;
+}
+
+bool Slideshow::waitForEnter(uint32_t milliseconds) const
+{
+	if (TerminalInput::wait(milliseconds) != TerminalInput::INPUT) {
+		return false;
+	}
+	//a closed stdin is readable all the time, so it ends the slideshow too
+	TerminalInput::skipInput();
+	return true;
+}
+
+bool Slideshow::run()
+{
+	typedef std::chrono::steady_clock Clock;
+	//double buffering avoids tearing and gives us vsync for transitions
+	if (!m_framebuffer.enablePageFlipping()) {
+		std::cout << "Using fixed frame budget for transitions." << std::endl;
+	}
+	if (m_files.empty()) {
+		return false;
+	}
+	Frame current;
+	Frame next;
+	bool hasCurrent = false;
+	size_t index = 0;
+	size_t shown = 0;
+	std::future<MappedFile> nextFile = fetchFile(m_files.front());
+	for (;;) {
+		if (index >= m_files.size()) {
+			//stop if this is not a loop or nothing could be loaded in a whole pass
+			if (!m_loop || shown == 0) {
+				break;
+			}
+			index = 0;
+			shown = 0;
+		}
+		//load next image while the current one is displayed
+		const Clock::time_point loadStart = Clock::now();
+		MappedFile file = nextFile.get();
+		//start fetching the file after it while this one decodes
+		if (++index < m_files.size()) {
+			nextFile = fetchFile(m_files[index]);
+		}
+		else if (m_loop) {
+			nextFile = fetchFile(m_files.front());
+		}
+		if (!loadFrame(file, next)) {
+			continue;
+		}
+		shown++;
+		if (hasCurrent) {
+			//wait for the rest of the display time
+			const uint32_t loadTime = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - loadStart).count();
+			if (waitForEnter(loadTime < m_delay ? m_delay - loadTime : 0)) {
+				return true;
+			}
+			m_transition.run(current.data(), next.data());
+			if (m_transition.getFramesDropped() > 0) {
+				std::cout << "Transition rendered " << m_transition.getFramesRendered() << " frames, dropped " << m_transition.getFramesDropped() << "." << std::endl;
+			}
+		}
+		else {
+			//first image. just display it
+			m_framebuffer.blit(0, 0, next.data(), m_framebuffer.getWidth(), m_framebuffer.getHeight(), m_framebuffer.getFormat());
+			m_framebuffer.flip();
+		}
+		//swap buffers instead of allocating a new frame for the next image
+		current.swap(next);
+		hasCurrent = true;
+	}
+	if (!hasCurrent) {
+		return false;
+	}
+	//keep last image on screen for the display time too
+	waitForEnter(m_delay);
+	return true;
+}
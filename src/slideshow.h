@@ -0,0 +1,71 @@
+#pragma once
+
+#include "framebuffer.h"
+#include "threadPool.h"
+#include "transition.h"
+#include "mappedFile.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+
+
+/*!
+Displays a list of images one after another with transitions in between.
+The next image is loaded and converted to a full-screen frame in the framebuffer format while the current one is displayed.
+The file after that is read on an I/O thread meanwhile, so slow storage does not stall decoding.
+*/
+class Slideshow
+{
+public:
+	/*!
+	Construct slideshow.
+	\param[in] framebuffer Framebuffer to display the images on.
+	\param[in] files Image files to display.
+	\param[in] transition Type of transition between images.
+	\param[in] transitionDuration Duration of transition in milliseconds.
+	\param[in] delay Time an image is displayed in milliseconds, not including the transition.
+	\param[in] loop Pass true to start over after the last image, false to return after it.
+	\param[in] frameRate Optional. Transition frames per second to aim for if the framebuffer does not support page flipping.
+	*/
+	Slideshow(Framebuffer & framebuffer, const std::vector<std::string> & files, Transition::Type transition, uint32_t transitionDuration, uint32_t delay, bool loop, uint32_t frameRate = 60);
+
+	/*!
+	Run slideshow until the last image is displayed or the user presses <ENTER>.
+	\return Returns false if no image could be loaded.
+	*/
+	bool run();
+
+private:
+	typedef ImageBuffer Frame; //!<Full-screen image in framebuffer format.
+
+	/*!
+	Start reading a file into memory in the background.
+	\param[in] fileName Image file to read.
+	\return Returns the file once it has been read. Check \sa MappedFile::isValid for errors.
+	*/
+	static std::future<MappedFile> fetchFile(const std::string & fileName);
+
+	/*!
+	Decode image, fit it to the screen, center it and convert it to a full-screen frame.
+	\param[in] file Image file in memory.
+	\param[out] frame Frame to draw to. Its memory is reused if it already has the right size.
+	\return Returns false if the image could not be loaded.
+	*/
+	bool loadFrame(const MappedFile & file, Frame & frame) const;
+
+	/*!
+	Wait for some time or until the user presses <ENTER>.
+	\param[in] milliseconds Time to wait.
+	\return Returns true if the user pressed <ENTER>.
+	*/
+	bool waitForEnter(uint32_t milliseconds) const;
+
+	Framebuffer & m_framebuffer;
+	std::vector<std::string> m_files;
+	ThreadPool m_threadPool;
+	Transition m_transition;
+	uint32_t m_delay; //!<Display time of an image in milliseconds.
+	bool m_loop;
+};
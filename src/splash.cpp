@@ -0,0 +1,220 @@
+//Tiny boot splash. Copies a prerendered raw frame to the framebuffer as fast as possible.
+//It does not link FreeImage, does not use iostreams and does not change the screen mode, so it starts in a few milliseconds.
+//Create frames with "sfivt --prerender <DIRECTORY> --target <WIDTH>x<HEIGHT>@<FORMAT>[:<LINELENGTH>]" for the framebuffer they are displayed on.
+//The .target file prerendering writes next to the frames tells which mode they are for.
+
+#include "mappedFile.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/fb.h>
+
+
+static void printMessage(const char * message)
+{
+	//plain write() avoids initializing stdio or iostreams just for error messages
+	if (write(STDERR_FILENO, message, strlen(message)) < 0) {
+		return;
+	}
+}
+
+//file next to the frames remembering the target they were prerendered for, see prerender.cpp
+static const char * TARGET_FILE_NAME = ".target";
+
+static void printUsage()
+{
+	printMessage("Usage:\nsfivt-splash [--budget <MS>] <FRAMEBUFFER> <FRAMEFILE>.\n");
+	printMessage("Copy a raw frame prerendered with \"sfivt --prerender\" to the framebuffer without changing the screen mode.\n");
+	printMessage("--budget <MS> - Print the time the splash took and fail if it took longer than MS milliseconds.\n");
+	printMessage("The .target file sfivt writes next to prerendered frames must be in the directory of FRAMEFILE.\n");
+	printMessage("e.g. \"sfivt-splash /dev/fb0 /boot/splash/logo.png.raw\".\n");
+}
+
+static uint64_t microseconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+//read the target a frame was prerendered for from the .target file in its directory, e.g. "800x480@R5G6B5:1600"
+static bool readTarget(const char * fileName, uint32_t & width, uint32_t & height, char * format, size_t formatSize, uint32_t & lineLength)
+{
+	char targetFile[4096];
+	const char * slash = strrchr(fileName, '/');
+	if (slash) {
+		snprintf(targetFile, sizeof(targetFile), "%.*s/%s", (int)(slash - fileName), fileName, TARGET_FILE_NAME);
+	}
+	else {
+		snprintf(targetFile, sizeof(targetFile), "%s", TARGET_FILE_NAME);
+	}
+	const int file = open(targetFile, O_RDONLY | O_CLOEXEC);
+	if (file < 0) {
+		return false;
+	}
+	char description[128] = {0};
+	const ssize_t size = read(file, description, sizeof(description) - 1);
+	close(file);
+	if (size <= 0) {
+		return false;
+	}
+	char formatPattern[32];
+	snprintf(formatPattern, sizeof(formatPattern), "%%ux%%u@%%%u[^:\n]:%%u", (unsigned int)formatSize - 1);
+	return sscanf(description, formatPattern, &width, &height, format, &lineLength) == 4;
+}
+
+//check if a pixel format name like R5G6B5 or X6R6G6B6 describes the pixel format of the mode. names list the channels from the highest bit to the lowest
+static bool isModeFormat(const char * format, const struct fb_var_screeninfo & mode, const struct fb_fix_screeninfo & fixedMode)
+{
+	if (strcmp(format, "GREY8") == 0) {
+		return mode.bits_per_pixel == 8 && mode.grayscale == 1;
+	}
+	if (strcmp(format, "PALETTE8") == 0) {
+		return mode.bits_per_pixel == 8 && mode.grayscale != 1 && fixedMode.visual == FB_VISUAL_PSEUDOCOLOR;
+	}
+	//sum up the channels first, so it is known at which bit the first one starts
+	uint32_t bitsPerPixel = 0;
+	for (const char * channel = format; *channel != '\0';) {
+		char * end = nullptr;
+		const unsigned long bits = strtoul(channel + 1, &end, 10);
+		if (end == channel + 1 || bits == 0) {
+			return false;
+		}
+		bitsPerPixel += bits;
+		channel = end;
+	}
+	//15bit modes are stored in 16bit pixels
+	if ((mode.bits_per_pixel == 15 ? 16 : mode.bits_per_pixel) != bitsPerPixel) {
+		return false;
+	}
+	//some drivers do not fill in the channel layout, so only the bits per pixel can be checked
+	if (mode.red.offset == 0 && mode.green.offset == 0 && mode.blue.offset == 0) {
+		return true;
+	}
+	uint32_t position = bitsPerPixel;
+	for (const char * channel = format; *channel != '\0';) {
+		char * end = nullptr;
+		const uint32_t bits = strtoul(channel + 1, &end, 10);
+		position -= bits;
+		const struct fb_bitfield * field = *channel == 'R' ? &mode.red : (*channel == 'G' ? &mode.green : (*channel == 'B' ? &mode.blue : nullptr));
+		if (field && (field->length != bits || field->offset != position)) {
+			return false;
+		}
+		channel = end;
+	}
+	return true;
+}
+
+//load the fixed R3G3B2 palette PALETTE8 frames are rendered with. indices are RRRGGGBB and components are scaled to 16 bits
+static bool loadPalette(int frameBufferDevice)
+{
+	uint16_t red[256];
+	uint16_t green[256];
+	uint16_t blue[256];
+	for (uint32_t index = 0; index < 256; ++index) {
+		const uint32_t r = index >> 5;
+		const uint32_t g = (index >> 2) & 0x07;
+		const uint32_t b = index & 0x03;
+		red[index] = (r << 5 | r << 2 | r >> 1) * 0x0101;
+		green[index] = (g << 5 | g << 2 | g >> 1) * 0x0101;
+		blue[index] = b * 0x5555;
+	}
+	struct fb_cmap colorMap;
+	memset(&colorMap, 0, sizeof(colorMap));
+	colorMap.start = 0;
+	colorMap.len = 256;
+	colorMap.red = red;
+	colorMap.green = green;
+	colorMap.blue = blue;
+	return ioctl(frameBufferDevice, FBIOPUTCMAP, &colorMap) == 0;
+}
+
+int main(int argc, char * argv[])
+{
+	const uint64_t start = microseconds();
+	int argument = 1;
+	long budget = -1;
+	if (argc == 5 && strcmp(argv[1], "--budget") == 0) {
+		budget = strtol(argv[2], nullptr, 10);
+		argument = 3;
+	}
+	else if (argc != 3) {
+		printUsage();
+		return -1;
+	}
+	const char * device = argv[argument];
+	const char * fileName = argv[argument + 1];
+
+	//map the frame first. populating the mapping reads the file in one go, while we set up the framebuffer
+	const MappedFile frame(fileName, true);
+	if (!frame.isValid()) {
+		printMessage("Failed to open frame!\n");
+		return -3;
+	}
+
+	//use the mode the framebuffer is in. setting a mode, even the same one, can reinitialize the display
+	const int frameBufferDevice = open(device, O_RDWR | O_CLOEXEC);
+	if (frameBufferDevice < 0) {
+		printMessage("Failed to open framebuffer for reading/writing!\n");
+		return -2;
+	}
+	struct fb_var_screeninfo mode;
+	struct fb_fix_screeninfo fixedMode;
+	if (ioctl(frameBufferDevice, FBIOGET_VSCREENINFO, &mode) || ioctl(frameBufferDevice, FBIOGET_FSCREENINFO, &fixedMode)) {
+		printMessage("Failed to read mode information!\n");
+		close(frameBufferDevice);
+		return -2;
+	}
+	//the frame must have been rendered for exactly this mode. the same number of Bytes could still be another resolution or pixel format
+	uint32_t width = 0;
+	uint32_t height = 0;
+	char format[32] = {0};
+	uint32_t lineLength = 0;
+	if (!readTarget(fileName, width, height, format, sizeof(format), lineLength)) {
+		printMessage("Failed to read the .target file next to the frame! Prerender frames with sfivt and keep the file in their directory.\n");
+		close(frameBufferDevice);
+		return -3;
+	}
+	const size_t frameSize = (size_t)mode.yres * fixedMode.line_length;
+	if (width != mode.xres || height != mode.yres || lineLength != fixedMode.line_length || !isModeFormat(format, mode, fixedMode) || frame.getSize() != frameSize) {
+		printMessage("Frame does not match the format of the framebuffer! Prerender it with the resolution, format and line length of the framebuffer.\n");
+		close(frameBufferDevice);
+		return -3;
+	}
+	//palette indices only show the right colors with the palette they were rendered for
+	if (strcmp(format, "PALETTE8") == 0 && !loadPalette(frameBufferDevice)) {
+		printMessage("Failed to load the palette!\n");
+		close(frameBufferDevice);
+		return -2;
+	}
+	//draw to the page that is currently displayed
+	const size_t offset = (size_t)mode.yoffset * fixedMode.line_length + (size_t)mode.xoffset * mode.bits_per_pixel / 8;
+	const size_t mappingSize = offset + frameSize;
+	uint8_t * frameBuffer = static_cast<uint8_t *>(mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, frameBufferDevice, 0));
+	if (frameBuffer == MAP_FAILED) {
+		printMessage("Failed to map framebuffer to user memory!\n");
+		close(frameBufferDevice);
+		return -2;
+	}
+	//frame and framebuffer have the same layout, so it is a single copy
+	memcpy(frameBuffer + offset, frame.getData(), frameSize);
+	munmap(frameBuffer, mappingSize);
+	close(frameBufferDevice);
+
+	if (budget >= 0) {
+		const uint64_t elapsed = microseconds() - start;
+		char message[128];
+		snprintf(message, sizeof(message), "Splash took %llu.%03llums of %ldms budget.\n", (unsigned long long)(elapsed / 1000), (unsigned long long)(elapsed % 1000), budget);
+		printMessage(message);
+		if (elapsed > (uint64_t)budget * 1000) {
+			return -4;
+		}
+	}
+	return 0;
+}
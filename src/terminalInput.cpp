@@ -0,0 +1,91 @@
+#include "terminalInput.h"
+
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/select.h>
+
+
+TerminalInput::TerminalInput()
+	: m_isTerminal(tcgetattr(STDIN_FILENO, &m_settings) == 0)
+{
+	if (m_isTerminal) {
+		struct termios newSettings = m_settings;
+		newSettings.c_lflag &= ~(ICANON | ECHO);
+		newSettings.c_cc[VMIN] = 1;
+		newSettings.c_cc[VTIME] = 0;
+		tcsetattr(STDIN_FILENO, TCSANOW, &newSettings);
+	}
+}
+
+TerminalInput::~TerminalInput()
+{
+	if (m_isTerminal) {
+		tcsetattr(STDIN_FILENO, TCSANOW, &m_settings);
+	}
+}
+
+TerminalInput::Result TerminalInput::wait(int32_t timeout, int fd, bool watchInput)
+{
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(std::max(timeout, 0));
+	for (;;) {
+		fd_set readSet;
+		FD_ZERO(&readSet);
+		if (watchInput) {
+			FD_SET(STDIN_FILENO, &readSet);
+		}
+		if (fd >= 0) {
+			FD_SET(fd, &readSet);
+		}
+		//a signal may interrupt the wait, so the time left is computed again every time
+		const int32_t wait = timeout < 0 ? -1 : std::max((int32_t)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count(), 0);
+		struct timeval waitTime = {(time_t)(wait / 1000), (suseconds_t)((wait % 1000) * 1000)};
+		const int result = select(std::max(STDIN_FILENO, fd) + 1, &readSet, nullptr, nullptr, wait >= 0 ? &waitTime : nullptr);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return FAILED;
+		}
+		if (result == 0) {
+			return TIMEOUT;
+		}
+		return (watchInput && FD_ISSET(STDIN_FILENO, &readSet)) ? INPUT : READY;
+	}
+}
+
+bool TerminalInput::readKeys(std::vector<int32_t> & keys)
+{
+	keys.clear();
+	char buffer[64];
+	const ssize_t count = read(STDIN_FILENO, buffer, sizeof(buffer));
+	if (count <= 0) {
+		return false;
+	}
+	for (ssize_t i = 0; i < count; ++i) {
+		if (buffer[i] == '\e' && i + 2 < count && buffer[i + 1] == '[') {
+			//cursor keys and page up/down. the latter end with '~'. unknown sequences are dropped
+			switch (buffer[i + 2]) {
+				case 'A': keys.push_back(KEY_UP); break;
+				case 'B': keys.push_back(KEY_DOWN); break;
+				case 'C': keys.push_back(KEY_RIGHT); break;
+				case 'D': keys.push_back(KEY_LEFT); break;
+				case '5': keys.push_back(KEY_PAGE_UP); break;
+				case '6': keys.push_back(KEY_PAGE_DOWN); break;
+			}
+			i += (i + 3 < count && buffer[i + 3] == '~') ? 3 : 2;
+		}
+		else {
+			keys.push_back((unsigned char)buffer[i]);
+		}
+	}
+	return true;
+}
+
+bool TerminalInput::skipInput()
+{
+	char buffer[64];
+	return read(STDIN_FILENO, buffer, sizeof(buffer)) > 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <inttypes.h>
+#include <termios.h>
+
+
+/*!
+Keyboard input from stdin for the interactive modes.
+While an instance exists, a terminal on stdin is switched to unbuffered input without echo, so keys arrive as soon as they are pressed.
+Without an instance input is line-buffered as usual and arrives when <ENTER> is pressed.
+*/
+class TerminalInput
+{
+public:
+	/*! Keys that the terminal sends as escape sequences. Other keys are returned as their character. */
+	enum Key { KEY_UP = 0x100, KEY_DOWN, KEY_LEFT, KEY_RIGHT, KEY_PAGE_UP, KEY_PAGE_DOWN };
+
+	enum Result { INPUT, READY, TIMEOUT, FAILED };
+
+	/*!
+	Switch the terminal to unbuffered input without echo. Does nothing if stdin is not a terminal.
+	*/
+	TerminalInput();
+
+	TerminalInput(const TerminalInput &) = delete;
+	TerminalInput & operator=(const TerminalInput &) = delete;
+
+	/*!
+	Restore the terminal settings.
+	*/
+	~TerminalInput();
+
+	/*!
+	Wait until there is input on stdin or another file descriptor becomes readable. Waiting continues if a signal interrupts it.
+	\param[in] timeout Maximum time to wait in milliseconds. Pass -1 to wait forever.
+	\param[in] fd Optional. Other file descriptor to wait for or -1.
+	\param[in] watchInput Optional. Pass false to only wait for \sa fd, e.g. after stdin has been closed.
+	\return Returns INPUT if stdin can be read, READY if \sa fd can be read, TIMEOUT if nothing happened in time or FAILED if waiting failed.
+	A closed stdin counts as input. \sa skipInput() tells it apart.
+	*/
+	static Result wait(int32_t timeout, int fd = -1, bool watchInput = true);
+
+	/*!
+	Read the keys that have been pressed. Keys pressed in quick succession are read at once.
+	Cursor keys and page up/down are returned as \sa Key, a single escape is returned as '\\e'.
+	\param[out] keys Upon return contains the keys in the order they were pressed.
+	\return Returns false if stdin has been closed or reading failed.
+	*/
+	static bool readKeys(std::vector<int32_t> & keys);
+
+	/*!
+	Read and drop pending input, e.g. the line ended by <ENTER>.
+	\return Returns false if stdin has been closed or reading failed.
+	*/
+	static bool skipInput();
+
+private:
+	bool m_isTerminal; //!<True if stdin is a terminal and its settings have to be restored.
+	struct termios m_settings; //!<Terminal settings before switching to unbuffered input.
+};
@@ -0,0 +1,337 @@
+#include "textRenderer.h"
+#include "pixelOps.h"
+
+#include <cstring>
+#include <algorithm>
+
+
+static const uint32_t FIRST_CHARACTER = 32; //!<First character in the font, ' '.
+static const uint32_t GLYPH_COUNT = 95; //!<Printable ASCII characters from ' ' to '~'.
+static const uint32_t FONT_ROWS = 9; //!<Rows of a glyph. The last two are for descenders.
+static const uint32_t CELL_WIDTH = 6; //!<Width of a character cell in font pixels. Glyphs are 5 pixels wide.
+static const uint32_t CELL_HEIGHT = 10; //!<Height of a character cell in font pixels.
+static const uint32_t PADDING = 1; //!<Border left of and above the text in font pixels. Cells already have a gap to the right and below.
+
+/*! Built-in 5x9 bitmap font for printable ASCII. Each byte is a row, bit 4 is the leftmost pixel. */
+static const uint8_t font[GLYPH_COUNT][FONT_ROWS] = {
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, //space
+	{0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00}, //!
+	{0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, //"
+	{0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a, 0x00, 0x00}, //#
+	{0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04, 0x00, 0x00}, //$
+	{0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03, 0x00, 0x00}, //%
+	{0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d, 0x00, 0x00}, //&
+	{0x04, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, //'
+	{0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02, 0x00, 0x00}, //(
+	{0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08, 0x00, 0x00}, //)
+	{0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00, 0x00, 0x00}, //*
+	{0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00, 0x00, 0x00}, //+
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c, 0x04, 0x08}, //,
+	{0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00, 0x00, 0x00}, //-
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c, 0x00, 0x00}, //.
+	{0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00, 0x00, 0x00}, ///
+	{0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e, 0x00, 0x00}, //0
+	{0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e, 0x00, 0x00}, //1
+	{0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f, 0x00, 0x00}, //2
+	{0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e, 0x00, 0x00}, //3
+	{0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02, 0x00, 0x00}, //4
+	{0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e, 0x00, 0x00}, //5
+	{0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e, 0x00, 0x00}, //6
+	{0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08, 0x00, 0x00}, //7
+	{0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e, 0x00, 0x00}, //8
+	{0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c, 0x00, 0x00}, //9
+	{0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00, 0x00, 0x00}, //:
+	{0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x04, 0x08, 0x00}, //;
+	{0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02, 0x00, 0x00}, //<
+	{0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00, 0x00, 0x00}, //=
+	{0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08, 0x00, 0x00}, //>
+	{0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04, 0x00, 0x00}, //?
+	{0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e, 0x00, 0x00}, //@
+	{0x0e, 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x00, 0x00}, //A
+	{0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e, 0x00, 0x00}, //B
+	{0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e, 0x00, 0x00}, //C
+	{0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c, 0x00, 0x00}, //D
+	{0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f, 0x00, 0x00}, //E
+	{0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10, 0x00, 0x00}, //F
+	{0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f, 0x00, 0x00}, //G
+	{0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11, 0x00, 0x00}, //H
+	{0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e, 0x00, 0x00}, //I
+	{0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c, 0x00, 0x00}, //J
+	{0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11, 0x00, 0x00}, //K
+	{0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f, 0x00, 0x00}, //L
+	{0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11, 0x00, 0x00}, //M
+	{0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11, 0x00, 0x00}, //N
+	{0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e, 0x00, 0x00}, //O
+	{0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10, 0x00, 0x00}, //P
+	{0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d, 0x00, 0x00}, //Q
+	{0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11, 0x00, 0x00}, //R
+	{0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e, 0x00, 0x00}, //S
+	{0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00}, //T
+	{0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e, 0x00, 0x00}, //U
+	{0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04, 0x00, 0x00}, //V
+	{0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a, 0x00, 0x00}, //W
+	{0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11, 0x00, 0x00}, //X
+	{0x11, 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x00, 0x00}, //Y
+	{0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f, 0x00, 0x00}, //Z
+	{0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e, 0x00, 0x00}, //[
+	{0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00, 0x00, 0x00}, //backslash
+	{0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e, 0x00, 0x00}, //]
+	{0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, //^
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00}, //_
+	{0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, //`
+	{0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f, 0x00, 0x00}, //a
+	{0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e, 0x00, 0x00}, //b
+	{0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e, 0x00, 0x00}, //c
+	{0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f, 0x00, 0x00}, //d
+	{0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e, 0x00, 0x00}, //e
+	{0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08, 0x00, 0x00}, //f
+	{0x00, 0x00, 0x0f, 0x11, 0x11, 0x11, 0x0f, 0x01, 0x0e}, //g
+	{0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00, 0x00}, //h
+	{0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e, 0x00, 0x00}, //i
+	{0x02, 0x00, 0x06, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c}, //j
+	{0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12, 0x00, 0x00}, //k
+	{0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e, 0x00, 0x00}, //l
+	{0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11, 0x00, 0x00}, //m
+	{0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00, 0x00}, //n
+	{0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e, 0x00, 0x00}, //o
+	{0x00, 0x00, 0x1e, 0x11, 0x11, 0x11, 0x1e, 0x10, 0x10}, //p
+	{0x00, 0x00, 0x0f, 0x11, 0x11, 0x11, 0x0f, 0x01, 0x01}, //q
+	{0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10, 0x00, 0x00}, //r
+	{0x00, 0x00, 0x0e, 0x10, 0x0e, 0x01, 0x1e, 0x00, 0x00}, //s
+	{0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06, 0x00, 0x00}, //t
+	{0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d, 0x00, 0x00}, //u
+	{0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04, 0x00, 0x00}, //v
+	{0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a, 0x00, 0x00}, //w
+	{0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x00, 0x00}, //x
+	{0x00, 0x00, 0x11, 0x11, 0x11, 0x11, 0x0f, 0x01, 0x0e}, //y
+	{0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f, 0x00, 0x00}, //z
+	{0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02, 0x00, 0x00}, //{
+	{0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00}, //|
+	{0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08, 0x00, 0x00}, //}
+	{0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00, 0x00, 0x00} //~
+};
+
+
+TextRenderer::TextRenderer(Framebuffer & framebuffer, uint32_t scale)
+	: m_framebuffer(framebuffer)
+	, m_scale(scale > 0 ? scale : std::max(1u, framebuffer.getHeight() / 360))
+	, m_atlasWidth(GLYPH_COUNT * CELL_WIDTH * m_scale)
+{
+	//rasterize the font once at the final size. atlases for different colors are made from this
+	const uint32_t cellWidth = CELL_WIDTH * m_scale;
+	const uint32_t cellHeight = CELL_HEIGHT * m_scale;
+	m_coverage.resize((size_t)m_atlasWidth * cellHeight);
+	for (uint32_t glyph = 0; glyph < GLYPH_COUNT; ++glyph) {
+		for (uint32_t y = 0; y < cellHeight; ++y) {
+			const uint32_t row = y / m_scale;
+			uint8_t * dest = m_coverage.data() + (size_t)y * m_atlasWidth + glyph * cellWidth;
+			for (uint32_t x = 0; x < cellWidth; ++x) {
+				const uint32_t column = x / m_scale;
+				dest[x] = (row < FONT_ROWS && column < 5) ? (font[glyph][row] >> (4 - column)) & 1 : 0;
+			}
+		}
+	}
+}
+
+size_t TextRenderer::addLabel(int32_t x, int32_t y, uint32_t color, uint32_t backgroundColor, uint8_t opacity)
+{
+	Label label;
+	label.x = x;
+	label.y = y;
+	label.color = color;
+	label.backgroundColor = backgroundColor;
+	label.opacity = opacity;
+	label.dirty = false;
+	label.boxX = 0;
+	label.boxY = 0;
+	label.boxWidth = 0;
+	label.boxHeight = 0;
+	m_labels.push_back(label);
+	return m_labels.size() - 1;
+}
+
+void TextRenderer::setText(size_t label, const std::string & text)
+{
+	if (label < m_labels.size() && m_labels[label].text != text) {
+		m_labels[label].text = text;
+		m_labels[label].dirty = true;
+	}
+}
+
+void TextRenderer::invalidate()
+{
+	//what was under the labels is gone and the palette may have changed
+	m_atlases.clear();
+	for (auto & label : m_labels) {
+		label.dirty = true;
+		label.boxWidth = 0;
+		label.boxHeight = 0;
+		label.saved.clear();
+	}
+}
+
+uint32_t TextRenderer::getCharacterWidth() const
+{
+	return CELL_WIDTH * m_scale;
+}
+
+uint32_t TextRenderer::getCharacterHeight() const
+{
+	return CELL_HEIGHT * m_scale;
+}
+
+uint32_t TextRenderer::glyphIndex(char character)
+{
+	const uint32_t code = (uint8_t)character;
+	return (code >= FIRST_CHARACTER && code < FIRST_CHARACTER + GLYPH_COUNT) ? code - FIRST_CHARACTER : '?' - FIRST_CHARACTER;
+}
+
+const TextRenderer::Atlas & TextRenderer::getAtlas(uint32_t color, uint32_t backgroundColor)
+{
+	for (const auto & atlas : m_atlases) {
+		if (atlas.color == color && atlas.backgroundColor == backgroundColor) {
+			return atlas;
+		}
+	}
+	//convert both colors once and expand the coverage to them
+	Atlas atlas;
+	atlas.color = color;
+	atlas.backgroundColor = backgroundColor;
+	uint8_t foreground[4];
+	m_framebuffer.convertColor(foreground, color);
+	m_framebuffer.convertColor(atlas.background, backgroundColor);
+	const uint32_t bytesPerPixel = m_framebuffer.getFormatInfo().bytesPerPixel;
+	atlas.pixels.resize(m_coverage.size() * bytesPerPixel);
+	uint8_t * dest = atlas.pixels.data();
+	for (size_t i = 0; i < m_coverage.size(); ++i, dest += bytesPerPixel) {
+		memcpy(dest, m_coverage[i] ? foreground : atlas.background, bytesPerPixel);
+	}
+	m_atlases.push_back(std::move(atlas));
+	return m_atlases.back();
+}
+
+bool TextRenderer::layout(Label & label) const
+{
+	const uint32_t screenWidth = m_framebuffer.getWidth();
+	const uint32_t screenHeight = m_framebuffer.getHeight();
+	//boxes only grow, so a shorter text covers everything the longer one drew
+	uint32_t width = std::max(((uint32_t)label.text.size() * CELL_WIDTH + PADDING) * m_scale, label.boxWidth);
+	uint32_t height = (CELL_HEIGHT + PADDING) * m_scale;
+	if (label.text.empty() && label.boxWidth == 0) {
+		return false;
+	}
+	width = std::min(width, screenWidth);
+	height = std::min(height, screenHeight);
+	//negative positions are relative to the right/bottom edge
+	const int32_t x = label.x < 0 ? (int32_t)screenWidth + label.x - (int32_t)width + 1 : label.x;
+	const int32_t y = label.y < 0 ? (int32_t)screenHeight + label.y - (int32_t)height + 1 : label.y;
+	label.boxX = std::max(x, 0);
+	label.boxY = std::max(y, 0);
+	if (label.boxX >= screenWidth || label.boxY >= screenHeight) {
+		return false;
+	}
+	label.boxWidth = std::min(width, screenWidth - label.boxX);
+	label.boxHeight = std::min(height, screenHeight - label.boxY);
+	return true;
+}
+
+bool TextRenderer::present()
+{
+	bool drawn = false;
+	for (auto & label : m_labels) {
+		if (!label.dirty) {
+			continue;
+		}
+		label.dirty = false;
+		const uint32_t oldX = label.boxX;
+		const uint32_t oldY = label.boxY;
+		const uint32_t oldWidth = label.boxWidth;
+		const uint32_t oldHeight = label.boxHeight;
+		if (!layout(label)) {
+			continue;
+		}
+		if (label.opacity == 255) {
+			drawOpaque(label);
+		}
+		else {
+			drawTransparent(label, oldX, oldY, oldWidth, oldHeight);
+		}
+		drawn = true;
+	}
+	return drawn;
+}
+
+void TextRenderer::drawOpaque(const Label & label)
+{
+	const Atlas & atlas = getAtlas(label.color, label.backgroundColor);
+	const uint32_t bytesPerPixel = m_framebuffer.getFormatInfo().bytesPerPixel;
+	const size_t lineLength = (size_t)label.boxWidth * bytesPerPixel;
+	const uint32_t padding = PADDING * m_scale;
+	const uint32_t cellWidth = CELL_WIDTH * m_scale;
+	m_buffer.resize(lineLength * label.boxHeight);
+	//the first line is background. it is copied to the padding and the space right of the text
+	uint8_t * background = m_buffer.data();
+	for (uint32_t x = 0; x < label.boxWidth; ++x) {
+		memcpy(background + x * bytesPerPixel, atlas.background, bytesPerPixel);
+	}
+	for (uint32_t y = 1; y < std::min(padding, label.boxHeight); ++y) {
+		memcpy(m_buffer.data() + y * lineLength, background, lineLength);
+	}
+	//copy runs of glyph rows from the atlas. they are already in framebuffer format
+	for (uint32_t y = padding; y < label.boxHeight; ++y) {
+		uint8_t * dest = m_buffer.data() + y * lineLength;
+		const uint8_t * atlasLine = atlas.pixels.data() + (size_t)(y - padding) * m_atlasWidth * bytesPerPixel;
+		uint32_t x = std::min(padding, label.boxWidth);
+		memcpy(dest, background, x * bytesPerPixel);
+		for (auto character = label.text.cbegin(); character != label.text.cend() && x < label.boxWidth; ++character) {
+			const uint32_t count = std::min(cellWidth, label.boxWidth - x);
+			memcpy(dest + x * bytesPerPixel, atlasLine + glyphIndex(*character) * cellWidth * bytesPerPixel, count * bytesPerPixel);
+			x += count;
+		}
+		memcpy(dest + x * bytesPerPixel, background, (label.boxWidth - x) * bytesPerPixel);
+	}
+	m_framebuffer.blit(label.boxX, label.boxY, m_buffer.data(), label.boxWidth, label.boxHeight, m_framebuffer.getFormat());
+}
+
+void TextRenderer::drawTransparent(Label & label, uint32_t oldX, uint32_t oldY, uint32_t oldWidth, uint32_t oldHeight)
+{
+	const uint32_t width = label.boxWidth;
+	const uint32_t height = label.boxHeight;
+	if (label.saved.empty() || oldX != label.boxX || oldY != label.boxY || oldWidth != width || oldHeight != height) {
+		//the box grew. put back what was under the old box, then save what is under the new one
+		if (!label.saved.empty()) {
+			m_framebuffer.blit(oldX, oldY, reinterpret_cast<const uint8_t *>(label.saved.data()), oldWidth, oldHeight, Framebuffer::X8R8G8B8);
+		}
+		label.saved.resize((size_t)width * height);
+		if (!m_framebuffer.readRect(label.saved.data(), label.boxX, label.boxY, width, height)) {
+			label.saved.clear();
+			return;
+		}
+	}
+	//blend the box over the saved pixels and put the text on top. the box is opaque, so it is its own premultiplied A8R8G8B8 line
+	const uint32_t padding = PADDING * m_scale;
+	const uint32_t cellWidth = CELL_WIDTH * m_scale;
+	m_boxLine.assign(width, (label.backgroundColor & 0xffffff) | 0xff000000);
+	m_buffer.resize((size_t)width * height * 4);
+	for (uint32_t y = 0; y < height; ++y) {
+		uint32_t * dest = reinterpret_cast<uint32_t *>(m_buffer.data()) + (size_t)y * width;
+		memcpy(dest, label.saved.data() + (size_t)y * width, width * 4);
+		PixelOps::blendLine(dest, m_boxLine.data(), width, label.opacity);
+		if (y < padding) {
+			continue;
+		}
+		const uint8_t * coverageLine = m_coverage.data() + (size_t)(y - padding) * m_atlasWidth;
+		uint32_t x = padding;
+		for (auto character = label.text.cbegin(); character != label.text.cend() && x < width; ++character) {
+			const uint8_t * glyph = coverageLine + glyphIndex(*character) * cellWidth;
+			const uint32_t count = std::min(cellWidth, width - x);
+			for (uint32_t column = 0; column < count; ++column) {
+				if (glyph[column]) {
+					dest[x + column] = label.color;
+				}
+			}
+			x += count;
+		}
+	}
+	m_framebuffer.blit(label.boxX, label.boxY, m_buffer.data(), width, height, Framebuffer::X8R8G8B8);
+}
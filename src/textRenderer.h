@@ -0,0 +1,121 @@
+#pragma once
+
+#include "framebuffer.h"
+
+#include <string>
+#include <vector>
+
+
+/*!
+Draws short texts like captions, a clock or statistics over whatever is displayed, using a built-in bitmap font.
+The font is rasterized once per scale into a glyph atlas that is already converted to the framebuffer pixel format, so drawing a text is
+copying glyph rows into a buffer and blitting it. Texts are grouped into labels and a label is only drawn again when its text changed.
+*/
+class TextRenderer
+{
+public:
+	/*!
+	Construct text renderer.
+	\param[in] framebuffer Framebuffer to draw to.
+	\param[in] scale Optional. Size of a font pixel in screen pixels. Pass 0 to choose one from the screen height.
+	*/
+	TextRenderer(Framebuffer & framebuffer, uint32_t scale = 0);
+
+	/*!
+	Add a label. It is empty and not drawn until a text is set.
+	\param[in] x Horizontal position of label. Negative values are relative to the right edge, so -1 puts the label into the right corner.
+	\param[in] y Vertical position of label. Negative values are relative to the bottom edge.
+	\param[in] color Optional. X8R8G8B8 text color.
+	\param[in] backgroundColor Optional. X8R8G8B8 color of the box behind the text.
+	\param[in] opacity Optional. Opacity of the box behind the text. 255 is opaque and fastest. Lower values let the image shine through, 0 draws the text only.
+	\return Returns the index of the new label.
+	*/
+	size_t addLabel(int32_t x, int32_t y, uint32_t color = 0xffffff, uint32_t backgroundColor = 0, uint8_t opacity = 255);
+
+	/*!
+	Set the text of a label. Characters outside of printable ASCII are displayed as '?'.
+	The label is only drawn again by \sa present() if the text changed.
+	*/
+	void setText(size_t label, const std::string & text);
+
+	/*!
+	Tell the renderer that the image under the labels has been redrawn, e.g. when a new image is displayed. All labels are drawn again by the next \sa present().
+	Also call this after changing the palette of a PALETTE8 framebuffer.
+	*/
+	void invalidate();
+
+	/*!
+	Draw the labels that changed.
+	\return Returns true if anything was drawn.
+	\note Labels are drawn in the current orientation of the framebuffer.
+	*/
+	bool present();
+
+	/*!
+	Get size of a character cell in pixels.
+	*/
+	uint32_t getCharacterWidth() const;
+	uint32_t getCharacterHeight() const;
+
+private:
+	/*! Glyphs rendered in framebuffer format for a text and background color. */
+	struct Atlas
+	{
+		uint32_t color;
+		uint32_t backgroundColor;
+		uint8_t background[4]; //!<Background color in framebuffer format.
+		std::vector<uint8_t> pixels; //!<All glyphs side by side. Scanlines are \sa m_atlasWidth pixels long.
+	};
+
+	/*! A text at a fixed position. */
+	struct Label
+	{
+		int32_t x;
+		int32_t y;
+		uint32_t color;
+		uint32_t backgroundColor;
+		uint8_t opacity;
+		std::string text;
+		bool dirty; //!<True if the label needs to be drawn.
+		uint32_t boxX; //!<Position of drawn box in the framebuffer.
+		uint32_t boxY;
+		uint32_t boxWidth; //!<Width of drawn box. The box only grows until \sa invalidate() is called, so longer texts do not leave parts behind.
+		uint32_t boxHeight;
+		std::vector<uint32_t> saved; //!<X8R8G8B8 pixels under the box of a transparent label.
+	};
+
+	/*!
+	Get atlas for a text and background color. It is created on first use.
+	*/
+	const Atlas & getAtlas(uint32_t color, uint32_t backgroundColor);
+
+	/*!
+	Map a character to its glyph index.
+	*/
+	static uint32_t glyphIndex(char character);
+
+	/*!
+	Compute box of label in the framebuffer for its current text.
+	\return Returns false if the label is empty or outside of the framebuffer.
+	*/
+	bool layout(Label & label) const;
+
+	/*!
+	Draw an opaque label by copying glyph rows from the atlas.
+	*/
+	void drawOpaque(const Label & label);
+
+	/*!
+	Draw a transparent label by blending its box over the saved pixels under it.
+	*/
+	void drawTransparent(Label & label, uint32_t oldX, uint32_t oldY, uint32_t oldWidth, uint32_t oldHeight);
+
+	Framebuffer & m_framebuffer;
+	uint32_t m_scale; //!<Size of a font pixel in screen pixels.
+	uint32_t m_atlasWidth; //!<Width of atlas in pixels.
+	std::vector<uint8_t> m_coverage; //!<All glyphs side by side at \sa m_scale. 1 where a glyph pixel is set.
+	std::vector<Atlas> m_atlases;
+	std::vector<Label> m_labels;
+	std::vector<uint8_t> m_buffer; //!<Label being composed. Reused for all labels.
+	std::vector<uint32_t> m_boxLine; //!<One line of the opaque label background that transparent labels blend over the saved pixels.
+};
@@ -0,0 +1,148 @@
+#include "threadPool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <sched.h>
+
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+	: m_function(nullptr)
+	, m_count(0)
+	, m_chunkSize(1)
+	, m_nextItem(0)
+	, m_busyThreads(0)
+	, m_loop(0)
+	, m_quit(false)
+{
+	if (threadCount == 0) {
+		threadCount = getCpuCount();
+	}
+	//the calling thread works too, so start one less
+	for (uint32_t i = 1; i < threadCount; ++i) {
+		m_threads.push_back(std::thread(&ThreadPool::work, this));
+	}
+}
+
+bool ThreadPool::setCpus(const std::string & cpuList)
+{
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	//parse list of CPU numbers and ranges, like taskset does
+	const char * text = cpuList.c_str();
+	bool valid = (*text != '\0');
+	while (valid && *text != '\0') {
+		char * end = nullptr;
+		const unsigned long first = strtoul(text, &end, 10);
+		unsigned long last = first;
+		valid = (end != text);
+		if (valid && *end == '-') {
+			text = end + 1;
+			last = strtoul(text, &end, 10);
+			valid = (end != text);
+		}
+		valid = valid && first <= last && last < CPU_SETSIZE && (*end == ',' || *end == '\0');
+		for (unsigned long cpu = first; valid && cpu <= last; ++cpu) {
+			CPU_SET(cpu, &cpus);
+		}
+		text = (*end == ',') ? end + 1 : end;
+	}
+	if (!valid || CPU_COUNT(&cpus) == 0) {
+		std::cout << "Bad CPU list \"" << cpuList << "\"!" << std::endl;
+		return false;
+	}
+	//pinning pid 0 pins the calling thread, which all threads created later inherit
+	if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+		std::cout << "Failed to run on CPUs " << cpuList << "!" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+uint32_t ThreadPool::getCpuCount()
+{
+	cpu_set_t cpus;
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0 && CPU_COUNT(&cpus) > 0) {
+		return CPU_COUNT(&cpus);
+	}
+	return std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+uint32_t ThreadPool::getThreadCount() const
+{
+	return m_threads.size() + 1;
+}
+
+void ThreadPool::parallelFor(size_t count, const RangeFunction & function, size_t chunkSize)
+{
+	if (count == 0) {
+		return;
+	}
+	if (chunkSize == 0) {
+		//a few chunks per thread balance the load well enough
+		chunkSize = std::max(count / (getThreadCount() * 4), (size_t)1);
+	}
+	//do it ourselves if it's not worth waking up the workers
+	if (m_threads.empty() || count <= chunkSize) {
+		function(0, count);
+		return;
+	}
+	std::lock_guard<std::mutex> callLock(m_callMutex);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_function = &function;
+		m_count = count;
+		m_chunkSize = chunkSize;
+		m_nextItem = 0;
+		m_busyThreads = m_threads.size();
+		++m_loop;
+	}
+	m_wakeUp.notify_all();
+	processChunks();
+	//wait for workers to finish their last chunks
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this]() { return m_busyThreads == 0; });
+	m_function = nullptr;
+}
+
+void ThreadPool::processChunks()
+{
+	size_t begin;
+	while ((begin = m_nextItem.fetch_add(m_chunkSize)) < m_count) {
+		(*m_function)(begin, std::min(begin + m_chunkSize, m_count));
+	}
+}
+
+void ThreadPool::work()
+{
+	uint64_t loop = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeUp.wait(lock, [this, &loop]() { return m_quit || m_loop != loop; });
+			if (m_quit) {
+				return;
+			}
+			loop = m_loop;
+		}
+		processChunks();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (--m_busyThreads == 0) {
+				m_done.notify_all();
+			}
+		}
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wakeUp.notify_all();
+	for (auto threadIt = m_threads.begin(); threadIt != m_threads.end(); ++threadIt) {
+		threadIt->join();
+	}
+}
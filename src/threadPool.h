@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <inttypes.h>
+
+
+/*!
+Simple pool of worker threads for data-parallel loops.
+Threads are created once and sleep while there is no work, so using the pool for every frame is cheap.
+*/
+class ThreadPool
+{
+public:
+	typedef std::function<void(size_t begin, size_t end)> RangeFunction; //!<Function processing the range [begin, end).
+
+	/*!
+	Construct thread pool.
+	\param[in] threadCount Optional. Number of threads to use including the calling thread. Pass 0 to use one thread per CPU core the process may run on.
+	*/
+	ThreadPool(uint32_t threadCount = 0);
+
+	/*!
+	Restrict the process to a set of CPUs, e.g. to keep decoding and converting away from cores that run latency-critical services.
+	Threads started afterwards inherit the set, so call this before creating any threads or pools.
+	\param[in] cpuList Comma-separated list of CPU numbers and ranges, e.g. "2-3,6".
+	\return Returns false if the list is invalid or the CPUs could not be used.
+	*/
+	static bool setCpus(const std::string & cpuList);
+
+	/*!
+	Get number of CPUs the process may run on. This is what pools use by default.
+	*/
+	static uint32_t getCpuCount();
+
+	/*!
+	Get number of threads working on a loop including the calling thread.
+	*/
+	uint32_t getThreadCount() const;
+
+	/*!
+	Split the range [0, count) into chunks and process them on all threads. The calling thread works too.
+	Chunks are handed out dynamically, so uneven work is balanced between threads.
+	\param[in] count Number of items to process.
+	\param[in] function Function called for every chunk.
+	\param[in] chunkSize Optional. Number of items per chunk. Pass 0 to pick a size automatically.
+	\note Blocks until all items are processed. Do not call from inside \sa function.
+	*/
+	void parallelFor(size_t count, const RangeFunction & function, size_t chunkSize = 0);
+
+	~ThreadPool();
+
+private:
+	/*!
+	Worker thread main loop.
+	*/
+	void work();
+
+	/*!
+	Process chunks of the current loop until none are left.
+	*/
+	void processChunks();
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_callMutex; //!<Serializes calls to \sa parallelFor.
+	std::mutex m_mutex; //!<Protects the loop state below.
+	std::condition_variable m_wakeUp; //!<Signaled when a new loop starts or the pool quits.
+	std::condition_variable m_done; //!<Signaled when the last worker finished a loop.
+	const RangeFunction * m_function; //!<Function of current loop.
+	size_t m_count; //!<Number of items in current loop.
+	size_t m_chunkSize; //!<Items per chunk in current loop.
+	std::atomic<size_t> m_nextItem; //!<Next item to hand out.
+	uint32_t m_busyThreads; //!<Worker threads still working on current loop.
+	uint64_t m_loop; //!<Counter incremented for every loop, so workers know there is new work.
+	bool m_quit;
+};
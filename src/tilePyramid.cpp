@@ -0,0 +1,173 @@
+#include "tilePyramid.h"
+#include "imageMemory.h"
+
+#include <cstring>
+#include <algorithm>
+
+
+TilePyramid::TilePyramid(ImageBuffer && image, uint32_t width, uint32_t height, Framebuffer::PixelFormat format, uint32_t fitWidth, uint32_t fitHeight, uint32_t tileSize)
+	: m_format(format)
+	, m_tileSize(tileSize)
+	, m_readyLevels(0)
+	, m_abort(false)
+{
+	//set up dimensions of all levels beforehand, so they can be read while building
+	do {
+		Level level;
+		level.width = width;
+		level.height = height;
+		level.tilesX = (width + m_tileSize - 1) / m_tileSize;
+		level.tilesY = (height + m_tileSize - 1) / m_tileSize;
+		level.tiles.resize(level.tilesX * level.tilesY);
+		m_levels.push_back(std::move(level));
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	} while (m_levels.back().width > fitWidth || m_levels.back().height > fitHeight);
+	//level 0 is the original image
+	m_levels.front().image = std::move(image);
+	//start building the rest in the background
+	m_builder = std::thread(&TilePyramid::build, this);
+}
+
+uint32_t TilePyramid::getLevelCount() const
+{
+	return m_levels.size();
+}
+
+uint32_t TilePyramid::getLevelWidth(uint32_t level) const
+{
+	return m_levels[level].width;
+}
+
+uint32_t TilePyramid::getLevelHeight(uint32_t level) const
+{
+	return m_levels[level].height;
+}
+
+bool TilePyramid::isLevelReady(uint32_t level) const
+{
+	return (m_readyLevels & (1 << level)) != 0;
+}
+
+bool TilePyramid::isComplete() const
+{
+	return m_readyLevels == (uint32_t)((1ULL << m_levels.size()) - 1);
+}
+
+bool TilePyramid::getClosestReadyLevel(uint32_t level, uint32_t & readyLevel) const
+{
+	//search outwards from requested level, preferring the more detailed level
+	for (uint32_t distance = 0; distance < m_levels.size(); ++distance) {
+		if (level >= distance && isLevelReady(level - distance)) {
+			readyLevel = level - distance;
+			return true;
+		}
+		if (level + distance < m_levels.size() && isLevelReady(level + distance)) {
+			readyLevel = level + distance;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TilePyramid::render(Framebuffer & framebuffer, uint32_t level, uint32_t srcX, uint32_t srcY, uint32_t width, uint32_t height, uint32_t x, uint32_t y) const
+{
+	if (level >= m_levels.size() || !isLevelReady(level)) {
+		return;
+	}
+	const Level & current = m_levels[level];
+	//clip area to level dimensions
+	if (srcX >= current.width || srcY >= current.height) {
+		return;
+	}
+	if (srcX + width > current.width) {
+		width = current.width - srcX;
+	}
+	if (srcY + height > current.height) {
+		height = current.height - srcY;
+	}
+	const uint32_t bytesPerPixel = Framebuffer::getPixelFormatInfo(m_format).bytesPerPixel;
+	//blit the visible part of all tiles touched by the area
+	const uint32_t firstTileX = srcX / m_tileSize;
+	const uint32_t lastTileX = (srcX + width - 1) / m_tileSize;
+	const uint32_t firstTileY = srcY / m_tileSize;
+	const uint32_t lastTileY = (srcY + height - 1) / m_tileSize;
+	for (uint32_t tileY = firstTileY; tileY <= lastTileY; ++tileY) {
+		const uint32_t tileTop = tileY * m_tileSize;
+		const uint32_t tileHeight = std::min(m_tileSize, current.height - tileTop);
+		//vertical part of tile that is visible
+		const uint32_t top = std::max(srcY, tileTop);
+		const uint32_t bottom = std::min(srcY + height, tileTop + tileHeight);
+		for (uint32_t tileX = firstTileX; tileX <= lastTileX; ++tileX) {
+			const uint32_t tileLeft = tileX * m_tileSize;
+			const uint32_t tileWidth = std::min(m_tileSize, current.width - tileLeft);
+			//horizontal part of tile that is visible
+			const uint32_t left = std::max(srcX, tileLeft);
+			const uint32_t right = std::min(srcX + width, tileLeft + tileWidth);
+			const uint8_t * tile = current.tiles[tileY * current.tilesX + tileX].get();
+			const uint8_t * data = tile + ((top - tileTop) * tileWidth + (left - tileLeft)) * bytesPerPixel;
+			framebuffer.blit(x + left - srcX, y + top - srcY, data, right - left, bottom - top, m_format, tileWidth * bytesPerPixel);
+		}
+	}
+}
+
+void TilePyramid::downsample(const Level & source, Level & dest)
+{
+	const uint8_t * src = source.image.data();
+	const uint32_t srcLineLength = source.width * 4;
+	uint8_t * dst = dest.image.data();
+	for (uint32_t line = 0; line < dest.height; ++line) {
+		//clamp to last line / column for odd source dimensions
+		const uint8_t * srcLine0 = src + (size_t)(2 * line) * srcLineLength;
+		const uint8_t * srcLine1 = src + (size_t)std::min(2 * line + 1, source.height - 1) * srcLineLength;
+		for (uint32_t pixel = 0; pixel < dest.width; ++pixel, dst += 4) {
+			const uint32_t x0 = (2 * pixel) * 4;
+			const uint32_t x1 = std::min(2 * pixel + 1, source.width - 1) * 4;
+			for (uint32_t channel = 0; channel < 4; ++channel) {
+				dst[channel] = (srcLine0[x0 + channel] + srcLine0[x1 + channel] + srcLine1[x0 + channel] + srcLine1[x1 + channel] + 2) / 4;
+			}
+		}
+	}
+}
+
+void TilePyramid::build()
+{
+	//halve image down to the smallest level
+	for (size_t index = 1; index < m_levels.size() && !m_abort; ++index) {
+		Level & level = m_levels[index];
+		level.image.resize((size_t)level.width * level.height * 4);
+		downsample(m_levels[index - 1], level);
+	}
+	//cut levels into tiles and convert them to the pyramid format, smallest level first.
+	//the big level 0 comes last, so its 32bit data shrinks while its tiles grow
+	const uint32_t bytesPerPixel = Framebuffer::getPixelFormatInfo(m_format).bytesPerPixel;
+	for (size_t index = m_levels.size(); index > 0 && !m_abort; --index) {
+		Level & level = m_levels[index - 1];
+		for (uint32_t tileY = 0; tileY < level.tilesY && !m_abort; ++tileY) {
+			const uint32_t tileHeight = std::min(m_tileSize, level.height - tileY * m_tileSize);
+			for (uint32_t tileX = 0; tileX < level.tilesX; ++tileX) {
+				const uint32_t tileWidth = std::min(m_tileSize, level.width - tileX * m_tileSize);
+				//convert tile straight from the level image to tightly packed tile data
+				const uint8_t * src = level.image.data() + ((size_t)(tileY * m_tileSize) * level.width + tileX * m_tileSize) * 4;
+				std::unique_ptr<uint8_t[]> & tile = level.tiles[tileY * level.tilesX + tileX];
+				tile.reset(new uint8_t[tileWidth * tileHeight * bytesPerPixel]);
+				Framebuffer::convert(tile.get(), 0, m_format, src, level.width * 4, Framebuffer::X8R8G8B8, tileWidth, tileHeight);
+			}
+			//the next level has already been made from these lines, so they are not needed anymore
+			ImageMemory::discard(level.image.data(), level.image.capacity(), (size_t)(tileY * m_tileSize + tileHeight) * level.width * 4);
+		}
+		if (!m_abort) {
+			//32bit data is not needed anymore
+			ImageBuffer().swap(level.image);
+			m_readyLevels |= (1 << (index - 1));
+		}
+	}
+}
+
+TilePyramid::~TilePyramid()
+{
+	m_abort = true;
+	if (m_builder.joinable()) {
+		m_builder.join();
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "framebuffer.h"
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+
+/*!
+Mip pyramid of an image, cut into tiles that are stored in a framebuffer pixel format.
+Level 0 is the original image, every following level has half the size of the previous one.
+The pyramid is built once in a background thread and levels become usable as soon as they're done.
+*/
+class TilePyramid
+{
+public:
+	/*!
+	Construct pyramid and start building it in the background.
+	\param[in] image 32bit X8R8G8B8 image data. The pyramid takes ownership of the data.
+	\param[in] width Width of image in pixels.
+	\param[in] height Height of image in pixels.
+	\param[in] format Pixel format the tiles are stored in. Should be the framebuffer format.
+	\param[in] fitWidth Levels are added until one fits completely into \sa fitWidth x \sa fitHeight.
+	\param[in] fitHeight Levels are added until one fits completely into \sa fitWidth x \sa fitHeight.
+	\param[in] tileSize Optional. Width and height of a tile in pixels.
+	*/
+	TilePyramid(ImageBuffer && image, uint32_t width, uint32_t height, Framebuffer::PixelFormat format, uint32_t fitWidth, uint32_t fitHeight, uint32_t tileSize = 256);
+
+	uint32_t getLevelCount() const;
+	uint32_t getLevelWidth(uint32_t level) const;
+	uint32_t getLevelHeight(uint32_t level) const;
+
+	/*!
+	Check if a pyramid level has been built and can be rendered.
+	\param[in] level Pyramid level to check.
+	\return Returns true if the level can be rendered.
+	*/
+	bool isLevelReady(uint32_t level) const;
+
+	/*!
+	Check if all pyramid levels have been built.
+	\return Returns true if all levels are ready.
+	*/
+	bool isComplete() const;
+
+	/*!
+	Find the level closest to the requested one that has already been built.
+	\param[in] level Requested pyramid level.
+	\param[out] readyLevel Upon return contains closest level that is ready.
+	\return Returns false if no level is ready yet.
+	*/
+	bool getClosestReadyLevel(uint32_t level, uint32_t & readyLevel) const;
+
+	/*!
+	Draw part of a pyramid level to the framebuffer. Only the tiles that are visible are blitted.
+	\param[in] framebuffer Framebuffer to draw to. Must have the pixel format the pyramid was built with.
+	\param[in] level Pyramid level to draw. Must be ready.
+	\param[in] srcX Horizontal position of area in level pixels.
+	\param[in] srcY Vertical position of area in level pixels.
+	\param[in] width Width of area in pixels.
+	\param[in] height Height of area in pixels.
+	\param[in] x Horizontal position where to draw area in framebuffer.
+	\param[in] y Vertical position where to draw area in framebuffer.
+	*/
+	void render(Framebuffer & framebuffer, uint32_t level, uint32_t srcX, uint32_t srcY, uint32_t width, uint32_t height, uint32_t x, uint32_t y) const;
+
+	~TilePyramid();
+
+private:
+	/*! A single level of the pyramid. */
+	struct Level
+	{
+		uint32_t width;
+		uint32_t height;
+		uint32_t tilesX; //!<Number of tiles horizontally.
+		uint32_t tilesY; //!<Number of tiles vertically.
+		ImageBuffer image; //!<32bit X8R8G8B8 level data. Only valid while building.
+		std::vector<std::unique_ptr<uint8_t[]>> tiles; //!<Tile data in pixel format of the pyramid, row by row.
+	};
+
+	/*!
+	Build all levels. Runs in background thread.
+	Halves the image down to the smallest level first, then cuts and converts levels to tiles starting with the smallest,
+	so a viewer can display an overview as early as possible. Every level releases its 32bit data as soon as it is tiled.
+	Level 0 is tiled last and gives its memory back row of tiles by row of tiles, so the 32bit original and the finished tiles
+	are never held completely at the same time.
+	*/
+	void build();
+
+	/*!
+	Shrink 32bit image to half its size using a 2x2 box filter.
+	\param[in] source Source level. Must contain 32bit image data.
+	\param[in] dest Destination level. Width and height must be set.
+	*/
+	static void downsample(const Level & source, Level & dest);
+
+	Framebuffer::PixelFormat m_format; //!<Pixel format of tiles.
+	uint32_t m_tileSize; //!<Width and height of tiles in pixels.
+	std::vector<Level> m_levels;
+	std::atomic<uint32_t> m_readyLevels; //!<Bit mask of levels that have been built.
+	std::atomic<bool> m_abort; //!<Set to stop building early.
+	std::thread m_builder; //!<Background thread building the pyramid.
+};
@@ -0,0 +1,134 @@
+#include "transition.h"
+#include "pixelOps.h"
+
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+
+//number of scanlines computed at once by a thread. small enough to stay in cache
+static const uint32_t BAND_LINES = 16;
+
+bool Transition::typeFromString(const std::string & name, Type & type)
+{
+	if (name == "none") {
+		type = NONE;
+	}
+	else if (name == "crossfade" || name == "fade") {
+		type = CROSSFADE;
+	}
+	else if (name == "wipe") {
+		type = WIPE;
+	}
+	else if (name == "slide") {
+		type = SLIDE;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+Transition::Transition(Framebuffer & framebuffer, ThreadPool & threadPool, Type type, uint32_t duration, uint32_t frameRate)
+	: m_framebuffer(framebuffer)
+	, m_threadPool(threadPool)
+	, m_type(type)
+	, m_duration(duration)
+	, m_frameRate(frameRate > 0 ? frameRate : 60)
+	, m_framesRendered(0)
+	, m_framesDropped(0)
+{
+}
+
+uint32_t Transition::getFramesRendered() const
+{
+	return m_framesRendered;
+}
+
+uint32_t Transition::getFramesDropped() const
+{
+	return m_framesDropped;
+}
+
+void Transition::render(const uint8_t * from, const uint8_t * to, uint32_t progress)
+{
+	const uint32_t width = m_framebuffer.getWidth();
+	const uint32_t height = m_framebuffer.getHeight();
+	const Framebuffer::PixelFormat format = m_framebuffer.getFormat();
+	const uint32_t bytesPerPixel = m_framebuffer.getFormatInfo().bytesPerPixel;
+	const uint32_t lineLength = width * bytesPerPixel;
+	const uint32_t bandCount = (height + BAND_LINES - 1) / BAND_LINES;
+	//compute and draw bands of scanlines in parallel
+	m_threadPool.parallelFor(bandCount, [&](size_t firstBand, size_t endBand) {
+		for (size_t band = firstBand; band < endBand; ++band) {
+			const uint32_t top = band * BAND_LINES;
+			const uint32_t lines = std::min(BAND_LINES, height - top);
+			const size_t offset = (size_t)top * lineLength;
+			if (m_type == CROSSFADE) {
+				//interpolate band in cached memory, then copy it to the framebuffer
+				thread_local std::vector<uint8_t> bandBuffer;
+				bandBuffer.resize(BAND_LINES * lineLength);
+				const uint8_t weight = (progress * 255) >> 16;
+				for (uint32_t line = 0; line < lines; ++line) {
+					PixelOps::lerpLine(bandBuffer.data() + line * lineLength, from + offset + line * lineLength, to + offset + line * lineLength, format, width, weight);
+				}
+				m_framebuffer.blit(0, top, bandBuffer.data(), width, lines, format, lineLength);
+			}
+			else if (m_type == WIPE) {
+				//new frame is revealed from the left
+				const uint32_t position = ((uint64_t)progress * width) >> 16;
+				m_framebuffer.blit(0, top, to + offset, position, lines, format, lineLength);
+				m_framebuffer.blit(position, top, from + offset + position * bytesPerPixel, width - position, lines, format, lineLength);
+			}
+			else if (m_type == SLIDE) {
+				//new frame pushes the old one out to the left
+				const uint32_t position = ((uint64_t)progress * width) >> 16;
+				m_framebuffer.blit(0, top, from + offset + position * bytesPerPixel, width - position, lines, format, lineLength);
+				m_framebuffer.blit(width - position, top, to + offset, position, lines, format, lineLength);
+			}
+		}
+	}, 1);
+}
+
+void Transition::run(const uint8_t * from, const uint8_t * to)
+{
+	typedef std::chrono::steady_clock Clock;
+	m_framesRendered = 0;
+	m_framesDropped = 0;
+	const Clock::duration frameInterval = std::chrono::microseconds(1000000 / m_frameRate);
+	const Clock::time_point start = Clock::now();
+	const Clock::time_point end = start + std::chrono::milliseconds(m_duration);
+	Clock::time_point nextFrame = start;
+	while (m_type != NONE) {
+		const Clock::time_point now = Clock::now();
+		if (now >= end) {
+			break;
+		}
+		//render the frame that belongs to the current time, so slow frames make us skip ahead
+		const uint32_t progress = (uint32_t)((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(now - start).count() * 65536 / (m_duration * 1000ULL));
+		render(from, to, progress);
+		m_framesRendered++;
+		if (m_framebuffer.isPageFlipping()) {
+			//display paces us
+			m_framebuffer.flip();
+		}
+		else {
+			//wait until the frame budget is used up. if we're already late drop the frames we missed
+			nextFrame += frameInterval;
+			const Clock::time_point rendered = Clock::now();
+			if (rendered > nextFrame) {
+				nextFrame += ((rendered - nextFrame) / frameInterval + 1) * frameInterval;
+			}
+			std::this_thread::sleep_until(nextFrame);
+		}
+	}
+	//frames we should have drawn at our frame rate, but did not
+	const uint32_t expectedFrames = (uint64_t)m_duration * m_frameRate / 1000;
+	m_framesDropped = (m_type != NONE && expectedFrames > m_framesRendered) ? expectedFrames - m_framesRendered : 0;
+	//make sure we end exactly at the target frame
+	m_framebuffer.blit(0, 0, to, m_framebuffer.getWidth(), m_framebuffer.getHeight(), m_framebuffer.getFormat());
+	if (m_framebuffer.isPageFlipping()) {
+		m_framebuffer.flip();
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "framebuffer.h"
+#include "threadPool.h"
+
+#include <string>
+
+
+/*!
+Timed transition between two full-screen frames that are already in the framebuffer pixel format.
+Intermediate frames are computed for the current time, so if the hardware can not keep up frames are dropped instead of slowing the transition down.
+Frames are paced by page flipping if the framebuffer supports it, else by a fixed frame budget.
+*/
+class Transition
+{
+public:
+	enum Type { NONE, CROSSFADE, WIPE, SLIDE }; //!<The transitions we support.
+
+	/*!
+	Get transition type from its name.
+	\param[in] name Name of transition, e.g. "crossfade".
+	\param[out] type Upon return contains the transition type.
+	\return Returns false if the name is unknown.
+	*/
+	static bool typeFromString(const std::string & name, Type & type);
+
+	/*!
+	Construct transition.
+	\param[in] framebuffer Framebuffer to draw to.
+	\param[in] threadPool Threads to compute intermediate frames on.
+	\param[in] type Type of transition.
+	\param[in] duration Duration of transition in milliseconds.
+	\param[in] frameRate Frames per second to aim for if the framebuffer does not support page flipping.
+	*/
+	Transition(Framebuffer & framebuffer, ThreadPool & threadPool, Type type, uint32_t duration, uint32_t frameRate);
+
+	/*!
+	Run transition. Blocks until it is done. When this returns \sa to is displayed.
+	\param[in] from Frame to start from. Must be full-screen, tightly packed and in the framebuffer pixel format.
+	\param[in] to Frame to end with. Must be full-screen, tightly packed and in the framebuffer pixel format.
+	*/
+	void run(const uint8_t * from, const uint8_t * to);
+
+	/*!
+	Number of frames drawn during the last \sa run().
+	*/
+	uint32_t getFramesRendered() const;
+
+	/*!
+	Number of frames that should have been drawn at the target frame rate during the last \sa run(), but were dropped.
+	*/
+	uint32_t getFramesDropped() const;
+
+private:
+	/*!
+	Draw one intermediate frame.
+	\param[in] progress Progress of transition from 0 to 65536.
+	*/
+	void render(const uint8_t * from, const uint8_t * to, uint32_t progress);
+
+	Framebuffer & m_framebuffer;
+	ThreadPool & m_threadPool;
+	Type m_type;
+	uint32_t m_duration; //!<Duration in milliseconds.
+	uint32_t m_frameRate; //!<Frames per second without page flipping.
+	uint32_t m_framesRendered;
+	uint32_t m_framesDropped;
+};
@@ -0,0 +1,120 @@
+#include "viewer.h"
+#include "terminalInput.h"
+
+#include <algorithm>
+
+
+Viewer::Viewer(Framebuffer & framebuffer, const TilePyramid & pyramid)
+	: m_framebuffer(framebuffer)
+	, m_pyramid(pyramid)
+	, m_level(pyramid.getLevelCount() - 1)
+	, m_renderedLevel(0)
+	, m_rendered(false)
+	, m_centerX(pyramid.getLevelWidth(0) / 2)
+	, m_centerY(pyramid.getLevelHeight(0) / 2)
+{
+	//convert border color to framebuffer format once
+	const uint32_t black = 0;
+	m_borderColor.resize(m_framebuffer.getFormatInfo().bytesPerPixel);
+	Framebuffer::convert(m_borderColor.data(), 0, m_framebuffer.getFormat(), (const uint8_t *)&black, 0, Framebuffer::X8R8G8B8, 1);
+}
+
+void Viewer::render()
+{
+	uint32_t level = 0;
+	if (!m_pyramid.getClosestReadyLevel(m_level, level)) {
+		return;
+	}
+	const uint32_t screenWidth = m_framebuffer.getWidth();
+	const uint32_t screenHeight = m_framebuffer.getHeight();
+	const uint32_t levelWidth = m_pyramid.getLevelWidth(level);
+	const uint32_t levelHeight = m_pyramid.getLevelHeight(level);
+	//find visible area of level and where it goes on screen. center level if it is smaller than the screen
+	uint32_t srcX = 0;
+	uint32_t x = 0;
+	uint32_t width = levelWidth;
+	if (levelWidth <= screenWidth) {
+		x = (screenWidth - levelWidth) / 2;
+	}
+	else {
+		srcX = std::min(std::max((m_centerX >> level) - screenWidth / 2, (int64_t)0), (int64_t)(levelWidth - screenWidth));
+		width = screenWidth;
+	}
+	uint32_t srcY = 0;
+	uint32_t y = 0;
+	uint32_t height = levelHeight;
+	if (levelHeight <= screenHeight) {
+		y = (screenHeight - levelHeight) / 2;
+	}
+	else {
+		srcY = std::min(std::max((m_centerY >> level) - screenHeight / 2, (int64_t)0), (int64_t)(levelHeight - screenHeight));
+		height = screenHeight;
+	}
+	//fill borders around image. the image area itself is overwritten anyway
+	m_framebuffer.fillRect(0, 0, screenWidth, y, m_borderColor.data());
+	m_framebuffer.fillRect(0, y + height, screenWidth, screenHeight - y - height, m_borderColor.data());
+	m_framebuffer.fillRect(0, y, x, height, m_borderColor.data());
+	m_framebuffer.fillRect(x + width, y, screenWidth - x - width, height, m_borderColor.data());
+	//draw visible tiles
+	m_pyramid.render(m_framebuffer, level, srcX, srcY, width, height, x, y);
+	m_renderedLevel = level;
+	m_rendered = true;
+}
+
+void Viewer::pan(int32_t stepsX, int32_t stepsY)
+{
+	//steps are quarter screens in the current level. convert to level 0 pixels
+	m_centerX += (int64_t)stepsX * (m_framebuffer.getWidth() / 4) * ((int64_t)1 << m_level);
+	m_centerY += (int64_t)stepsY * (m_framebuffer.getHeight() / 4) * ((int64_t)1 << m_level);
+	m_centerX = std::min(std::max(m_centerX, (int64_t)0), (int64_t)m_pyramid.getLevelWidth(0));
+	m_centerY = std::min(std::max(m_centerY, (int64_t)0), (int64_t)m_pyramid.getLevelHeight(0));
+	render();
+}
+
+void Viewer::zoom(int32_t steps)
+{
+	//zooming in means going to a more detailed level
+	const int32_t level = std::min(std::max((int32_t)m_level - steps, 0), (int32_t)m_pyramid.getLevelCount() - 1);
+	m_level = level;
+	render();
+}
+
+void Viewer::run()
+{
+	TerminalInput terminal;
+	render();
+	bool quit = false;
+	std::vector<int32_t> keys;
+	while (!quit) {
+		//wait for a key, but wake up regularly to display levels that have been built in the meantime
+		const TerminalInput::Result result = TerminalInput::wait(100);
+		if (result == TerminalInput::INPUT) {
+			if (!TerminalInput::readKeys(keys)) {
+				//stdin closed
+				break;
+			}
+			for (size_t i = 0; i < keys.size() && !quit; ++i) {
+				switch (keys[i]) {
+					case TerminalInput::KEY_UP: pan(0, -1); break;
+					case TerminalInput::KEY_DOWN: pan(0, 1); break;
+					case TerminalInput::KEY_RIGHT: pan(1, 0); break;
+					case TerminalInput::KEY_LEFT: pan(-1, 0); break;
+					case '+': case '=': zoom(1); break;
+					case '-': zoom(-1); break;
+					case '0': zoom(-(int32_t)m_pyramid.getLevelCount()); break;
+					case 'q': case 'Q': case '\e': quit = true; break;
+				}
+			}
+		}
+		else if (result == TerminalInput::TIMEOUT) {
+			//check if a better level is ready now
+			uint32_t level = 0;
+			if (m_pyramid.getClosestReadyLevel(m_level, level) && (!m_rendered || level != m_renderedLevel)) {
+				render();
+			}
+		}
+		else {
+			break;
+		}
+	}
+}
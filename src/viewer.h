@@ -0,0 +1,56 @@
+#pragma once
+
+#include "framebuffer.h"
+#include "tilePyramid.h"
+
+#include <vector>
+
+
+/*!
+Interactive pan and zoom viewer for images bigger than the screen.
+Use cursor keys to pan, +/- to zoom in and out, 0 to fit the image to the screen and q or ESC to quit.
+Zoom steps are the levels of the \sa TilePyramid, so no rescaling is done while viewing.
+*/
+class Viewer
+{
+public:
+	/*!
+	Construct viewer.
+	\param[in] framebuffer Framebuffer to display the image on.
+	\param[in] pyramid Tile pyramid of the image built for the framebuffer pixel format.
+	*/
+	Viewer(Framebuffer & framebuffer, const TilePyramid & pyramid);
+
+	/*!
+	Read keys from stdin and update the display until the user quits.
+	*/
+	void run();
+
+private:
+	/*!
+	Draw the current viewport. Uses the closest level that is ready if the requested level is still being built.
+	*/
+	void render();
+
+	/*!
+	Move the viewport.
+	\param[in] stepsX Horizontal movement in quarter screen widths.
+	\param[in] stepsY Vertical movement in quarter screen heights.
+	*/
+	void pan(int32_t stepsX, int32_t stepsY);
+
+	/*!
+	Change the zoom level, keeping the center of the viewport.
+	\param[in] steps Positive values zoom in, negative values zoom out.
+	*/
+	void zoom(int32_t steps);
+
+	Framebuffer & m_framebuffer;
+	const TilePyramid & m_pyramid;
+	uint32_t m_level; //!<The level the user wants to see.
+	uint32_t m_renderedLevel; //!<The level that is actually on screen.
+	bool m_rendered; //!<True if anything has been drawn yet.
+	int64_t m_centerX; //!<Center of viewport in level 0 pixels.
+	int64_t m_centerY; //!<Center of viewport in level 0 pixels.
+	std::vector<uint8_t> m_borderColor; //!<Color to fill the screen around the image with in framebuffer format.
+};